@@ -18,12 +18,24 @@
 //  - rectangles
 //  - circles
 //  - triangles
+//  - triangles with blended vertex colors
+//  - depth tested triangles
+//  - textured triangles, in perspective
 //  - grids
 //  - text
-//  - color RGBA, Black&White, easily add more formats
-//  - PPM file reading and writing
+//  - color RGBA, RGB, Grayscale, Black&White, easily add more formats
+//  - PPM and PAM file reading and writing
+//  - QOI file reading and writing
+//  - PNG file writing
+//  - YUV4MPEG2 video writing
+//  - asynchronous frame writing on a background thread
 //  - resize
 //  - overlap
+//  - command lists, recorded once and replayed
+//  - jobs with dependencies on a work-stealing thread pool
+//  - damage tracking, to present only the areas drawn on
+//  - lazy clear, writing only the cleared tiles that are drawn on
+//  - clip rectangles, pushed and popped on a stack
 //
 // Usage
 // -----
@@ -49,6 +61,20 @@
 // To enable PPM related functions, you need to #define MIRO_DRAW_PPM.
 // More info: https://en.wikipedia.org/wiki/Netpbm
 //
+// To enable QOI related functions, you need to #define MICRO_DRAW_QOI.
+// More info: https://qoiformat.org
+//
+// To enable PNG related functions, you need to #define MICRO_DRAW_PNG.
+//
+// To enable the YUV4MPEG2 video writer, you need to #define MICRO_DRAW_Y4M.
+//
+// To write frames on a background thread, you need to #define
+// MICRO_DRAW_ASYNC_WRITER and link with pthreads.
+//
+// To draw on multiple threads, you need to #define MICRO_DRAW_THREADS
+// to the number of threads and link with pthreads, or #define your own
+// MICRO_DRAW_PARALLEL_FOR.
+//
 // The usage is quite straight forward: you supply a data buffer to a
 // micro-draw.h function which will fill the pixels accordingly. For
 // example, you can use this buffer to render a frame on screen, or to
@@ -69,12 +95,6 @@
 //
 //     https://github.com/San7o/micro-headers
 //
-//
-// TODO
-// ----
-//
-//  - Implement micro_draw_from_ppm
-//
 
 #ifndef MICRO_DRAW
 #define MICRO_DRAW
@@ -95,6 +115,83 @@ extern "C" {
   #define MICRO_DRAW_PPM
 #endif
 
+// Config: disable the SIMD code paths with MICRO_DRAW_NO_SIMD. They
+// are used only if the compiler targets the needed instruction set,
+// for example with -march=native
+#if 0
+  #define MICRO_DRAW_NO_SIMD
+#endif
+
+// Config: enable PSF2 and BDF bitmap font loading with
+// MICRO_DRAW_BITMAP_FONTS
+#if 0
+  #define MICRO_DRAW_BITMAP_FONTS
+#endif
+
+// Config: enable QOI format reading / writing with MICRO_DRAW_QOI
+#if 0
+  #define MICRO_DRAW_QOI
+#endif
+
+// Config: enable PNG writing with MICRO_DRAW_PNG
+#if 0
+  #define MICRO_DRAW_PNG
+#endif
+
+// Config: enable the YUV4MPEG2 video writer with MICRO_DRAW_Y4M
+#if 0
+  #define MICRO_DRAW_Y4M
+#endif
+
+// Config: enable the asynchronous frame writer with
+// MICRO_DRAW_ASYNC_WRITER, it needs pthreads
+#if 0
+  #define MICRO_DRAW_ASYNC_WRITER
+#endif
+
+// Config: run the parallel parts (see MICRO_DRAW_PARALLEL_FOR) on up
+// to MICRO_DRAW_THREADS threads, it needs pthreads
+#if 0
+  #define MICRO_DRAW_THREADS 4
+#endif
+
+// Config: run the row loops of the heavy functions in parallel.
+// MICRO_DRAW_PARALLEL_FOR(count, grain, fn, context) must call
+// fn(context, begin, end) once for every item in [0, count), in
+// ranges of about [grain] items, and return when all of them are
+// done. It can be called again from inside [fn]. It is serial by
+// default, with MICRO_DRAW_THREADS it uses a pool of that many threads.
+#ifndef MICRO_DRAW_PARALLEL_FOR
+  #ifdef MICRO_DRAW_THREADS
+    #define MICRO_DRAW_PARALLEL_FOR(count, grain, fn, context) \
+      micro_draw_parallel_for((count), (grain), (fn), (context))
+  #else
+    #define MICRO_DRAW_PARALLEL_FOR(count, grain, fn, context) \
+      ((void)(grain), (fn)((context), 0, (count)))
+  #endif
+#endif
+
+// Config: size in pixels of the tiles of micro_draw_execute_tiled
+#ifndef MICRO_DRAW_TILE_SIZE
+  #define MICRO_DRAW_TILE_SIZE 64
+#endif
+
+// Config: how many clip rectangles can be pushed
+#ifndef MICRO_DRAW_CLIP_STACK_SIZE
+  #define MICRO_DRAW_CLIP_STACK_SIZE 16
+#endif
+
+// Config: size in pixels of the tiles tracked by MicroDrawDamage
+#ifndef MICRO_DRAW_DAMAGE_TILE_SIZE
+  #define MICRO_DRAW_DAMAGE_TILE_SIZE 16
+#endif
+
+// Config: size in pixels of the tiles of MicroDrawDepth that keep
+// the nearest and farthest depth
+#ifndef MICRO_DRAW_DEPTH_TILE_SIZE
+  #define MICRO_DRAW_DEPTH_TILE_SIZE 8
+#endif
+
 // Config: Prefix for all functions
 // For function inlining, set this to `static inline` and then define
 // the implementation in all the files
@@ -102,13 +199,26 @@ extern "C" {
   #define MICRO_DRAW_DEF extern
 #endif
 
+// Config: Memory allocator, used by the functions that need to
+// allocate memory. Define all three to use your own allocator.
+#ifndef MICRO_DRAW_MALLOC
+  #include <stdlib.h>
+  #define MICRO_DRAW_MALLOC(size) malloc(size)
+  #define MICRO_DRAW_REALLOC(ptr, size) realloc(ptr, size)
+  #define MICRO_DRAW_FREE(ptr) free(ptr)
+#endif
+
 //
 // Types
 //
 
+#include <stddef.h> // size_t
+
 typedef enum {
   MICRO_DRAW_RGBA8 = 0,
   MICRO_DRAW_BLACK_WHITE,
+  MICRO_DRAW_RGB8,
+  MICRO_DRAW_GRAY8,
   _MICRO_DRAW_PIXEL_MAX,
 } MicroDrawPixel;
 
@@ -117,9 +227,109 @@ typedef enum {
   MICRO_DRAW_ERROR_OPEN_FILE,
   MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER,
   MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE,
+  MICRO_DRAW_ERROR_ALLOCATION,
+  MICRO_DRAW_ERROR_INVALID_FORMAT,
+  MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT,
+  MICRO_DRAW_ERROR_WRITE_FILE,
+  MICRO_DRAW_ERROR_CLIP_STACK_FULL,
   _MICRO_DRAW_ERROR_MAX,
 } MicroDrawError;
 
+typedef struct {
+  int x;
+  int y;
+  int w;
+  int h;
+} MicroDrawRect;
+
+// The tiles of MICRO_DRAW_DAMAGE_TILE_SIZE pixels of a surface that
+// were drawn on since the last micro_draw_damage_clear
+typedef struct {
+  int width;
+  int height;
+  int columns;
+  int rows;
+  unsigned char *tiles; // 1 if drawn on
+  int count;            // Tiles drawn on
+} MicroDrawDamage;
+
+// The tiles of MICRO_DRAW_TILE_SIZE pixels of a surface that were
+// cleared to [color] but not written yet. The encoders read only the
+// data, call micro_draw_lazy_clear_resolve before encoding a surface.
+typedef struct {
+  int columns;
+  int rows;
+  unsigned char *tiles;   // 1 if pending
+  unsigned char color[4]; // In the pixel format of the surface
+} MicroDrawLazyClear;
+
+typedef enum {
+  MICRO_DRAW_DEPTH16 = 0, // unsigned short
+  MICRO_DRAW_DEPTH32,     // unsigned int
+  _MICRO_DRAW_DEPTH_MAX,
+} MicroDrawDepthFormat;
+
+// A depth buffer, 0 is the nearest depth. Every tile of
+// MICRO_DRAW_DEPTH_TILE_SIZE pixels keeps the range of its depths, so
+// that the triangles behind all of it are skipped.
+typedef struct {
+  void *data;
+  int width;
+  int height;
+  MicroDrawDepthFormat format;
+  int columns;
+  int rows;
+  unsigned int *tile_min;
+  unsigned int *tile_max;
+} MicroDrawDepth;
+
+// An image and its pixel format, with rows [stride] bytes apart. Only
+// texture sampling reads rows with padding, drawing on a surface
+// requires [stride] to be [width] times the size of a pixel.
+typedef struct {
+  unsigned char *data;
+  int width;
+  int height;
+  int stride; // bytes
+  MicroDrawPixel pixel;
+  // If not NULL, the areas drawn by micro_draw_execute and
+  // micro_draw_execute_tiled are added to it
+  MicroDrawDamage *damage;
+  // If not NULL, micro_draw_surface_clear only marks the tiles as
+  // cleared. They are written when a command draws on them, or by
+  // micro_draw_lazy_clear_resolve, needed before encoding the data.
+  MicroDrawLazyClear *lazy_clear;
+  // Private, the file mapping of micro_draw_ppm_map
+  void *_mapping;
+  size_t _mapping_size;
+} MicroDrawSurface;
+
+// How a texture is sampled between its pixels
+typedef enum {
+  MICRO_DRAW_FILTER_NEAREST = 0,
+  MICRO_DRAW_FILTER_BILINEAR,
+  _MICRO_DRAW_FILTER_MAX,
+} MicroDrawFilter;
+
+// How a texture is sampled outside of it
+typedef enum {
+  MICRO_DRAW_WRAP_REPEAT = 0,
+  MICRO_DRAW_WRAP_CLAMP,
+  _MICRO_DRAW_WRAP_MAX,
+} MicroDrawWrap;
+
+// A vertex of a textured triangle, at [u, v] in the texture from 0
+// to 1. [w] is the distance from the viewer, positive, used to map
+// the texture in perspective. It is the same on all the vertices
+// for a flat mapping.
+typedef struct {
+  int x;
+  int y;
+  float u;
+  float v;
+  float w;
+} MicroDrawVertex;
+
 #define MICRO_DRAW_FONT_HEIGHT 6
 #define MICRO_DRAW_FONT_WIDTH 5
 extern unsigned char
@@ -128,6 +338,113 @@ micro_draw_font[128][MICRO_DRAW_FONT_HEIGHT][MICRO_DRAW_FONT_WIDTH];
 #define MICRO_DRAW_CHARACTER_PIXELS_X 50
 #define MICRO_DRAW_CHARACTER_PIXELS_Y 50
 
+// A glyph placed by a text layout, relative to the text origin
+typedef struct {
+  int x;
+  int y;
+  int glyph;
+} MicroDrawGlyphPosition;
+
+// Line breaks and glyph positions of a string, computed once by
+// micro_draw_text_layout and reused by every micro_draw_text_layout_draw.
+// Zero-initialize it before the first use, rebuilding it reuses its
+// memory.
+typedef struct {
+  MicroDrawGlyphPosition *glyphs;
+  int glyphs_count;
+  int glyphs_capacity;
+  int lines;
+  int char_width;  // pixels
+  int char_height; // pixels
+  int width;       // bounding box, pixels
+  int height;      // bounding box, pixels
+} MicroDrawTextLayout;
+
+// A glyph of a bitmap font. The bitmap is stored in the font atlas at
+// [offset], with rows of (width + 7) / 8 bytes, most significant bit
+// first. [x] and [y] are the position of the bitmap relative to the
+// pen, which is on the top of the line.
+typedef struct {
+  int codepoint;
+  int offset; // bytes
+  int x;
+  int y;
+  int width;
+  int height;
+  int advance;
+} MicroDrawFontGlyph;
+
+// [count] consecutive codepoints starting from [codepoint], mapped
+// to consecutive glyphs starting from [glyph]
+typedef struct {
+  int codepoint;
+  int count;
+  int glyph;
+} MicroDrawFontRange;
+
+// A bitmap font with all the glyphs packed in a single 1-bpp atlas.
+// Codepoints are mapped to glyphs by a table of ranges sorted by
+// codepoint, so its size depends only on the glyphs in the font.
+// Codepoints without a glyph are drawn with the first glyph.
+typedef struct {
+  unsigned char *atlas;
+  int atlas_size; // bytes
+  MicroDrawFontGlyph *glyphs;
+  int glyphs_count;
+  MicroDrawFontRange *ranges;
+  int ranges_count;
+  int line_height;
+} MicroDrawFont;
+
+// A string drawn by micro_draw_text_batch
+typedef struct {
+  char *text;
+  int x;
+  int y;
+  unsigned char *color;
+} MicroDrawTextItem;
+
+// The body of a parallel loop, called on the items [begin, end)
+typedef void (*MicroDrawRangeFn)(void *context, int begin, int end);
+
+typedef void (*MicroDrawJobFn)(void *context);
+
+// A function to run with micro_draw_run_jobs, after the jobs it
+// depends on. Initialize it with micro_draw_job_init.
+typedef struct MicroDrawJob {
+  MicroDrawJobFn fn;
+  void *context;
+  
+  // Private
+  int _pending;                      // Dependencies not done, plus one
+  int *_remaining;                   // Jobs of the run not done yet
+  struct MicroDrawJob **_dependents; // Jobs that depend on this one
+  int _dependents_count;
+  int _dependents_capacity;
+  struct MicroDrawJob *_next;        // Ready jobs, when run serially
+} MicroDrawJob;
+
+typedef enum {
+  MICRO_DRAW_COMMAND_LINE = 0,
+  MICRO_DRAW_COMMAND_RECT,
+  MICRO_DRAW_COMMAND_CIRCLE,
+  MICRO_DRAW_COMMAND_TRIANGLE,
+  MICRO_DRAW_COMMAND_TEXT,
+  MICRO_DRAW_COMMAND_OVERLAP,
+  _MICRO_DRAW_COMMAND_MAX,
+} MicroDrawCommandType;
+
+// Primitives recorded in a byte stream, replayed by micro_draw_execute.
+// Colors and strings are copied in the stream, the images of overlap
+// commands are referenced. Zero-initialize it before the first use,
+// clearing it keeps its memory.
+typedef struct {
+  unsigned char *bytes;
+  size_t size;     // bytes
+  size_t capacity; // bytes
+  int count;
+} MicroDrawCommandList;
+
 //
 // Function declarations
 //
@@ -163,6 +480,22 @@ MICRO_DRAW_DEF void
 micro_draw_get_color(unsigned char* data, int data_width, int data_height,
                      int x, int y, unsigned char** color, MicroDrawPixel pixel);
 
+// Clip --------------------------------------------------------------
+
+// Restrict all drawing, except micro_draw_pixel, to [rect] inside the
+// current clip, until the matching micro_draw_clip_pop. The clip is
+// global, change it only while no other thread is drawing.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_clip_push(MicroDrawRect rect);
+
+MICRO_DRAW_DEF void
+micro_draw_clip_pop(void);
+
+// The area that can be drawn on data of [data_width] x [data_height]
+// pixels, with the current clip
+MICRO_DRAW_DEF MicroDrawRect
+micro_draw_clip_rect(int data_width, int data_height);
+
 // Primitives --------------------------------------------------------
   
 MICRO_DRAW_DEF void
@@ -189,6 +522,24 @@ micro_draw_fill_triangle(unsigned char *data, int data_width, int data_height,
                          int a_x, int a_y, int b_x, int b_y, int c_x, int c_y,
                          unsigned char *color, MicroDrawPixel pixel);
 
+// Fill a triangle with the colors of the vertices, in the [pixel]
+// format, blended across it. Both windings are drawn.
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_gouraud(unsigned char *data, int data_width, int data_height,
+                                 int a_x, int a_y, unsigned char *a_color,
+                                 int b_x, int b_y, unsigned char *b_color,
+                                 int c_x, int c_y, unsigned char *c_color,
+                                 MicroDrawPixel pixel);
+
+// Fill a triangle with [texture], sampled with [filter] and [wrap].
+// Both windings are drawn.
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_textured(unsigned char *data, int data_width, int data_height,
+                                  MicroDrawPixel pixel, MicroDrawVertex a,
+                                  MicroDrawVertex b, MicroDrawVertex c,
+                                  MicroDrawSurface *texture, MicroDrawFilter filter,
+                                  MicroDrawWrap wrap);
+
 MICRO_DRAW_DEF void
 micro_draw_grid(unsigned char* data, int data_width, int data_height,
                 int columns, int rows, unsigned char* color, MicroDrawPixel pixel);
@@ -220,723 +571,6899 @@ micro_draw_text(unsigned char* data, int data_width, int data_height,
                 MicroDrawPixel pixel_data, char* text, int text_x,
                 int text_y, float text_scale, unsigned char* text_color);
 
-// PPM ---------------------------------------------------------------
-  
-#ifdef MICRO_DRAW_PPM
+// Returns the pixel bounding box of [text] drawn at [text_x], [text_y]
+// with [text_scale], without drawing anything
+MICRO_DRAW_DEF MicroDrawRect
+micro_draw_text_measure(char* text, int text_x, int text_y, float text_scale);
 
+// Compute the line breaks and glyph positions of [text] into [layout]
 MICRO_DRAW_DEF MicroDrawError
-micro_draw_to_ppm(const char *filename, unsigned char *data,
-                  int data_width, int data_height, MicroDrawPixel pixel);
+micro_draw_text_layout(MicroDrawTextLayout *layout, char* text, float text_scale);
+
+// Draw a layout previously computed with micro_draw_text_layout
+MICRO_DRAW_DEF void
+micro_draw_text_layout_draw(unsigned char* data, int data_width, int data_height,
+                            MicroDrawPixel pixel_data, MicroDrawTextLayout *layout,
+                            int text_x, int text_y, unsigned char* text_color);
+
+MICRO_DRAW_DEF void
+micro_draw_text_layout_free(MicroDrawTextLayout *layout);
+
+// Returns the index of the glyph of [codepoint] in [font], or 0 if
+// the font does not have it
+MICRO_DRAW_DEF int
+micro_draw_font_glyph(MicroDrawFont *font, int codepoint);
 
+// Draw the UTF-8 [text] with a bitmap [font] at its native size.
+// Only the set pixels of the glyphs are drawn.
+MICRO_DRAW_DEF void
+micro_draw_text_font(unsigned char* data, int data_width, int data_height,
+                     MicroDrawPixel pixel_data, MicroDrawFont *font, char* text,
+                     int text_x, int text_y, unsigned char* text_color);
 
+// Draw [items_count] strings with the same [font] at its native size,
+// or with the default font scaled by [text_scale] if [font] is NULL.
+// Glyphs are drawn sorted by row instead of by string, so the order
+// of overlapping strings is preserved only on the same row.
 MICRO_DRAW_DEF MicroDrawError
-micro_draw_from_ppm(const char *filename, unsigned char **data,
-                    int *data_width, int *data_height, MicroDrawPixel *pixel);
+micro_draw_text_batch(unsigned char* data, int data_width, int data_height,
+                      MicroDrawPixel pixel_data, MicroDrawFont *font,
+                      float text_scale, MicroDrawTextItem *items,
+                      int items_count);
 
-#endif // MICRO_DRAW_PPM
+#ifdef MICRO_DRAW_BITMAP_FONTS
 
-//
-// Implementation
-//
+// Load a PSF2 font from memory
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_from_psf2(MicroDrawFont *font, const unsigned char *buffer,
+                          int buffer_size);
 
-#ifdef MICRO_DRAW_IMPLEMENTATION
+// Load a BDF font from memory
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_from_bdf(MicroDrawFont *font, const unsigned char *buffer,
+                         int buffer_size);
 
-#include <assert.h>
+// Load a PSF2 or BDF font from [filename]
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_load(MicroDrawFont *font, const char *filename);
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_draw_get_channels");
-MICRO_DRAW_DEF unsigned int micro_draw_get_channels(MicroDrawPixel pixel)
-{
-  switch(pixel)
-  {
-  case MICRO_DRAW_RGBA8:
-    return 4;
-  case MICRO_DRAW_BLACK_WHITE:
-    return 1;
-  default:
-    break;
-  }
+MICRO_DRAW_DEF void
+micro_draw_font_free(MicroDrawFont *font);
 
-  return 0;
-}
+#endif // MICRO_DRAW_BITMAP_FONTS
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_draw_get_channel_size");
-MICRO_DRAW_DEF unsigned int micro_draw_get_channel_size(MicroDrawPixel pixel)
-{
-  switch(pixel)
-  {
-  case MICRO_DRAW_RGBA8:
-    return 1;
-  case MICRO_DRAW_BLACK_WHITE:
-    return 1;
-  default:
-    break;
-  }
+// Command list ------------------------------------------------------
 
-  return 0;
-}
+// Record the same primitives of the functions above. Colors are in
+// [pixel] format and are converted to the format of the surface when
+// the list is executed.
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_draw_color_to_rgba8");
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_line(MicroDrawCommandList *list, int a_x, int a_y,
+                       int b_x, int b_y, unsigned char* color, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_rect(MicroDrawCommandList *list, int x, int y, int w, int h,
+                            unsigned char *color, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_circle(MicroDrawCommandList *list, int center_x,
+                              int center_y, int radius,
+                              unsigned char *color, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_triangle(MicroDrawCommandList *list, int a_x, int a_y,
+                                int b_x, int b_y, int c_x, int c_y,
+                                unsigned char *color, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_text(MicroDrawCommandList *list, char* text, int text_x,
+                       int text_y, float text_scale, unsigned char* text_color,
+                       MicroDrawPixel pixel);
+
+// [src_data] is not copied, it must be valid until the list is executed
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_overlap(MicroDrawCommandList *list, unsigned char* src_data,
+                          int src_data_width, int src_data_height,
+                          MicroDrawPixel src_pixel, int x_offset, int y_offset);
+
+// Draw the commands of [list] on [surface] in the order they were
+// recorded. Commands outside of the surface are skipped. Returns
+// MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT if the rows of the surface are
+// padded.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_execute(MicroDrawCommandList *list, MicroDrawSurface *surface);
+
+// Same as micro_draw_execute, with the same result, but the surface is
+// split in tiles of MICRO_DRAW_TILE_SIZE pixels and every tile draws
+// only the commands overlapping it. Tiles are drawn in parallel with
+// MICRO_DRAW_PARALLEL_FOR.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_execute_tiled(MicroDrawCommandList *list, MicroDrawSurface *surface);
+
+// Remove all the commands, keeping the memory
 MICRO_DRAW_DEF void
-micro_draw_color_to_rgba8(unsigned char* color_src, MicroDrawPixel pixel_src,
-                          unsigned char color_dest[4])
-{
-  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
-  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
-  
-  switch(pixel_src)
-  {
-  case MICRO_DRAW_RGBA8:
-    for (int i = 0; i < 4; ++i)
-      color_dest[i] = color_src[i];
-    break;
-  case MICRO_DRAW_BLACK_WHITE:
-    color_dest[0] = color_src[0] * 255;
-    color_dest[1] = color_src[0] * 255;
-    color_dest[2] = color_src[0] * 255;
-    color_dest[3] = 255;
-    break;
-  default:
-    break;
-  }
-}
+micro_draw_command_list_clear(MicroDrawCommandList *list);
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_draw_color_from_rgba8");
 MICRO_DRAW_DEF void
-micro_draw_color_from_rgba8(unsigned char color_src[4],
-                            unsigned char *color_dest, MicroDrawPixel pixel_dest)
-{
-  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
-  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
+micro_draw_command_list_free(MicroDrawCommandList *list);
 
-  switch(pixel_dest)
-  {
-  case MICRO_DRAW_RGBA8:
-    for (int i = 0; i < 4; ++i)
-      color_dest[i] = color_src[i];
-    break;
-  case MICRO_DRAW_BLACK_WHITE:
-    color_dest[0] = color_src[0] == 255 ? 1 : 0;
-    break;
-  default:
-    break;
-  }
-  return;
-}
+// Damage ------------------------------------------------------------
 
+// Track the damage of a surface of [width] x [height] pixels, with
+// no tile drawn on
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_damage_init(MicroDrawDamage *damage, int width, int height);
+
+// Mark the tiles overlapping [rect] as drawn on
 MICRO_DRAW_DEF void
-micro_draw_color_convert(unsigned char *color_src, MicroDrawPixel pixel_src,
-                         unsigned char *color_dest, MicroDrawPixel pixel_dest)
-{
-  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
-  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
+micro_draw_damage_add(MicroDrawDamage *damage, MicroDrawRect rect);
 
-  unsigned char color_rgba[4] = {0};
-  micro_draw_color_to_rgba8(color_src, pixel_src, color_rgba);
-  micro_draw_color_from_rgba8(color_rgba, color_dest, pixel_dest);
-  
-  return;
-}
+MICRO_DRAW_DEF void
+micro_draw_damage_clear(MicroDrawDamage *damage);
+
+// Write in [rects] the damaged area as rectangles inside the surface,
+// runs of tiles in a row merged with the same runs below them. At most
+// [max] rectangles are written, the ones after are merged in the last.
+// Returns the number of rectangles written.
+MICRO_DRAW_DEF int
+micro_draw_damage_rects(MicroDrawDamage *damage, MicroDrawRect *rects, int max);
 
-static inline void *
-_micro_draw_memcpy(void *dest, const void *src, unsigned int n)
-{
-  for (unsigned int i = 0; i < n; ++i)
-    ((char*)dest)[i] = ((char*)src)[i];
-  return dest;
-}
-  
 MICRO_DRAW_DEF void
-micro_draw_pixel(unsigned char* data, int data_width, int data_height,
-                 int x, int y, unsigned char* color, MicroDrawPixel pixel)
-{
-  if (x >= data_width || x < 0 || y >= data_height || y < 0) return;
+micro_draw_damage_free(MicroDrawDamage *damage);
 
-  int channel_size = micro_draw_get_channel_size(pixel); // bytes
-  unsigned int channels = micro_draw_get_channels(pixel);
-  int index = (y * data_width + x) * channels * channel_size;
-  
-  _micro_draw_memcpy(&data[index], color, channels * channel_size);
+// Lazy clear --------------------------------------------------------
 
-  return;
-}
+// Track the cleared tiles of a surface of [width] x [height] pixels,
+// with no tile pending
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_lazy_clear_init(MicroDrawLazyClear *clear, int width, int height);
+
+// Clear [surface] to [color], in the pixel format of the surface. With
+// a lazy clear the tiles are written later, resolve them before using
+// the data directly, as when encoding it. Returns MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT if
+// the rows of the surface are padded.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_surface_clear(MicroDrawSurface *surface, unsigned char *color);
 
+// Write the pending tiles of [surface]
 MICRO_DRAW_DEF void
-micro_draw_line(unsigned char* data, int data_width, int data_height,
-                int a_x, int a_y, int b_x, int b_y,
-                unsigned char* color, MicroDrawPixel pixel)
-{
-  // Line equation
-  double m = (a_y - b_y) / (double)(a_x - b_x);
-  double q = a_y - m * a_x;
-  int is_steep = (m > 1 || m < -1);
+micro_draw_lazy_clear_resolve(MicroDrawSurface *surface);
 
-  if (is_steep)
-  {
-    // Transpose the image
-    int tmp = a_x;
-    a_x = a_y;
-    a_y = tmp;
+MICRO_DRAW_DEF void
+micro_draw_lazy_clear_free(MicroDrawLazyClear *clear);
 
-    tmp = b_x;
-    b_x = b_y;
-    b_y = tmp;
+// Depth -------------------------------------------------------------
 
-    m = (a_y - b_y) / (double)(a_x - b_x);
-    q = a_y - m * a_x;
-  }
+// Allocate a depth buffer of [width] x [height] pixels, cleared to
+// the farthest depth
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_depth_init(MicroDrawDepth *depth, int width, int height,
+                      MicroDrawDepthFormat format);
 
-  int start, end;
-  if (a_x > b_x)
-  {
-    start = b_x;
-    end = a_x;
-  }
-  else
-  {
-    start = a_x;
+// Set all the depth buffer to [z], from 0 (nearest) to 1 (farthest)
+MICRO_DRAW_DEF void
+micro_draw_depth_clear(MicroDrawDepth *depth, float z);
+
+MICRO_DRAW_DEF void
+micro_draw_depth_free(MicroDrawDepth *depth);
+
+// Fill a triangle with vertices at depths from 0 (nearest) to 1
+// (farthest), only on the pixels where it is nearer than [depth], and
+// update [depth]. Both windings are drawn.
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_z(unsigned char *data, int data_width, int data_height,
+                           MicroDrawDepth *depth,
+                           int a_x, int a_y, float a_z,
+                           int b_x, int b_y, float b_z,
+                           int c_x, int c_y, float c_z,
+                           unsigned char *color, MicroDrawPixel pixel);
+
+// Jobs --------------------------------------------------------------
+
+MICRO_DRAW_DEF void
+micro_draw_job_init(MicroDrawJob *job, MicroDrawJobFn fn, void *context);
+
+// [job] runs after [dependency] is done. Both must be run by the same
+// micro_draw_run_jobs, and the dependencies must not form a cycle.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_job_depend(MicroDrawJob *job, MicroDrawJob *dependency);
+
+// Run [count] jobs, each one after its dependencies, and return when
+// all of them are done. With MICRO_DRAW_THREADS they run on the pool
+// of micro_draw_parallel_for, otherwise on the calling thread. Jobs
+// can run other jobs and loops. The dependencies are forgotten at the
+// end, the jobs can be run again.
+MICRO_DRAW_DEF void
+micro_draw_run_jobs(MicroDrawJob *jobs, int count);
+
+#ifdef MICRO_DRAW_THREADS
+
+// Call [fn] on [0, count) in ranges of at most [grain] items, on a
+// pool of MICRO_DRAW_THREADS threads including the calling one. The
+// range is split in halves, and the threads with nothing to do steal
+// halves from the others, so uneven items are balanced. The threads
+// are started on the first call. Only one thread outside of the pool
+// uses it at a time, the others run serially.
+MICRO_DRAW_DEF void
+micro_draw_parallel_for(int count, int grain, MicroDrawRangeFn fn, void *context);
+
+#endif // MICRO_DRAW_THREADS
+
+// PPM ---------------------------------------------------------------
+  
+#ifdef MICRO_DRAW_PPM
+
+#include <stdio.h> // FILE
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel);
+
+
+// Read an image in any of the netpbm formats, P1 to P7. Bitmaps and
+// BLACKANDWHITE PAM are read as Black&White, everything else as RGBA8.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm(const char *filename, unsigned char **data,
+                    int *data_width, int *data_height, MicroDrawPixel *pixel);
+
+// Write an image to an open [file], which is left open
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_file(FILE *file, unsigned char *data,
+                       int data_width, int data_height, MicroDrawPixel pixel);
+
+// Read an image from an open [file], which is left open. Binary
+// images are read up to the end of their raster, so that many images
+// can be read one after the other from the same file or pipe. ASCII
+// images are read up to the end of the file.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_file(FILE *file, unsigned char **data,
+                         int *data_width, int *data_height, MicroDrawPixel *pixel);
+
+// Size in bytes of the encoded image, or 0 if [pixel] is not supported
+MICRO_DRAW_DEF size_t
+micro_draw_ppm_size(int data_width, int data_height, MicroDrawPixel pixel);
+
+// Encode an image in [buffer], of [capacity] bytes, and set [size] to
+// the bytes written. Returns MICRO_DRAW_ERROR_WRITE_FILE if the image
+// does not fit, see micro_draw_ppm_size.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel);
+
+// Decode an image from the [size] bytes of [buffer]
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_memory(const unsigned char *buffer, size_t size,
+                           unsigned char **data, int *data_width,
+                           int *data_height, MicroDrawPixel *pixel);
+
+// Write an image as PAM (P7), which keeps the alpha of RGBA8. All the
+// formats except Black&White are written as they are in memory, with
+// a single write. PAM files are read by micro_draw_from_ppm.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_file(FILE *file, unsigned char *data,
+                       int data_width, int data_height, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF size_t
+micro_draw_pam_size(int data_width, int data_height, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel);
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Same of micro_draw_to_ppm_file on a file descriptor, such as a
+// pipe or a socket. Partial writes are retried.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_fd(int fd, unsigned char *data,
+                     int data_width, int data_height, MicroDrawPixel pixel);
+
+// Same of micro_draw_from_ppm_file on a file descriptor. Nothing
+// past the raster of binary images is read.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_fd(int fd, unsigned char **data,
+                       int *data_width, int *data_height, MicroDrawPixel *pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_fd(int fd, unsigned char *data,
+                     int data_width, int data_height, MicroDrawPixel pixel);
+
+#endif // __unix__ || __APPLE__
+
+// Streaming writer, which encodes an image a few rows at a time so
+// that the whole image never needs to be in memory
+typedef struct {
+  FILE *file;
+  int width;
+  int height;
+  MicroDrawPixel pixel;
+  int rows_written;
+  // Private
+  unsigned char *_staging;
+  int _staging_rows;
+} MicroDrawPPMWriter;
+
+// Streaming reader, which decodes an image a few rows at a time.
+// [width], [height] and [pixel] are set by micro_draw_ppm_reader_begin
+// and the pixel format is the same of micro_draw_from_ppm.
+typedef struct {
+  FILE *file;
+  int width;
+  int height;
+  MicroDrawPixel pixel;
+  int rows_read;
+  // Private
+  int _type;
+  int _color_max;
+  int _depth;
+  unsigned char *_buffer; // Unparsed ASCII raster
+  int _buffer_start;
+  int _buffer_end;
+  int _buffer_complete; // End of the complete values
+  int _buffer_capacity;
+} MicroDrawPPMReader;
+
+// Create [filename] and write the header of an image
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_begin(MicroDrawPPMWriter *writer, const char *filename,
+                            int data_width, int data_height, MicroDrawPixel pixel);
+
+// Write the next [rows_count] rows from [rows], which has the pixel
+// format and width of the writer
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_write_rows(MicroDrawPPMWriter *writer, unsigned char *rows,
+                                 int rows_count);
+
+// Close the file. Returns an error if not all the rows were written.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_end(MicroDrawPPMWriter *writer);
+
+// Open [filename] and read the header of the image
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_reader_begin(MicroDrawPPMReader *reader, const char *filename);
+
+// Read the next [rows_count] rows into [rows], which must fit
+// [rows_count] rows with the pixel format and width of the reader
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_reader_read_rows(MicroDrawPPMReader *reader, unsigned char *rows,
+                                int rows_count);
+
+MICRO_DRAW_DEF void
+micro_draw_ppm_reader_end(MicroDrawPPMReader *reader);
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Map a binary PPM file in memory and point [surface] to its raster,
+// without copying it. Only the files whose raster is already in a
+// supported format can be mapped: P6 with a max color value of 255
+// (RGB8), P5 with 255 (GRAY8) and P5 with 1 (Black&White), and PAM
+// files with RGB_ALPHA, RGB or GRAYSCALE with 255 or BLACKANDWHITE.
+// Writes to the surface are private and are not saved to the file.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_map(const char *filename, MicroDrawSurface *surface);
+
+// Release a surface mapped by micro_draw_ppm_map
+MICRO_DRAW_DEF void
+micro_draw_ppm_unmap(MicroDrawSurface *surface);
+
+#endif // __unix__ || __APPLE__
+
+#endif // MICRO_DRAW_PPM
+
+// QOI ---------------------------------------------------------------
+
+#ifdef MICRO_DRAW_QOI
+
+// Upper bound of the size of an encoded image, or 0 if [pixel] is not
+// supported
+MICRO_DRAW_DEF size_t
+micro_draw_qoi_max_size(int data_width, int data_height, MicroDrawPixel pixel);
+
+// Encode an image in [buffer], of [capacity] bytes, and set [size] to
+// the bytes written. RGBA8 is written with 4 channels, the other
+// formats with 3. Returns MICRO_DRAW_ERROR_WRITE_FILE if the image
+// does not fit, see micro_draw_qoi_max_size.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_qoi_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel);
+
+// Decode an image from the [size] bytes of [buffer]. Images with 4
+// channels are read as RGBA8, with 3 as RGB8.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_qoi_memory(const unsigned char *buffer, size_t size,
+                           unsigned char **data, int *data_width,
+                           int *data_height, MicroDrawPixel *pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_qoi(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_qoi(const char *filename, unsigned char **data,
+                    int *data_width, int *data_height, MicroDrawPixel *pixel);
+
+#endif // MICRO_DRAW_QOI
+
+// PNG ---------------------------------------------------------------
+
+#ifdef MICRO_DRAW_PNG
+
+// How the image data is compressed. Both are made for speed, not
+// for the size of the file.
+typedef enum {
+  // Uncompressed, rows are not filtered
+  MICRO_DRAW_PNG_STORED = 0,
+  // Runs of equal bytes with fixed Huffman codes, each row uses the
+  // None, Sub or Up filter that makes longer runs
+  MICRO_DRAW_PNG_RLE,
+} MicroDrawPNGCompression;
+
+// Upper bound of the size of an encoded image, or 0 if [pixel] is not
+// supported
+MICRO_DRAW_DEF size_t
+micro_draw_png_max_size(int data_width, int data_height, MicroDrawPixel pixel);
+
+// Encode an image in [buffer], of [capacity] bytes, and set [size] to
+// the bytes written. Images are written as:
+//  - RGBA8: truecolor with alpha
+//  - RGB8: truecolor
+//  - GRAY8: grayscale
+//  - Black&White: grayscale with 1 bit per pixel
+// Returns MICRO_DRAW_ERROR_WRITE_FILE if the image does not fit, see
+// micro_draw_png_max_size.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_png_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel, MicroDrawPNGCompression compression);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_png(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel,
+                  MicroDrawPNGCompression compression);
+
+#endif // MICRO_DRAW_PNG
+
+// Y4M ---------------------------------------------------------------
+
+#ifdef MICRO_DRAW_Y4M
+
+#include <stdio.h> // FILE
+
+// Convert an RGBA8 image to YCbCr 4:2:0 (I420) with BT.601 limited
+// range. [y_plane] has [data_width] * [data_height] bytes, [u_plane]
+// and [v_plane] have half the width and half the height rounded up.
+// Each chroma sample is the average of a 2x2 block of pixels.
+MICRO_DRAW_DEF void
+micro_draw_rgba8_to_i420(const unsigned char *data, int data_width,
+                         int data_height, unsigned char *y_plane,
+                         unsigned char *u_plane, unsigned char *v_plane);
+
+// Writer of a YUV4MPEG2 video stream, which can be read by most
+// video encoders. The frame buffer is allocated once, when the
+// writer begins.
+typedef struct {
+  FILE *file;
+  int width;
+  int height;
+  int frames_written;
+  // Private
+  unsigned char *_frame; // I420 planes of a frame
+  int _owns_file;
+} MicroDrawY4MWriter;
+
+// Create [filename] and write the header of the stream, at
+// [fps_num] / [fps_den] frames per second
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_begin(MicroDrawY4MWriter *writer, const char *filename,
+                            int width, int height, int fps_num, int fps_den);
+
+// Same as micro_draw_y4m_writer_begin, on an open [file] such as
+// stdout or a pipe, which is left open by micro_draw_y4m_writer_end
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_begin_file(MicroDrawY4MWriter *writer, FILE *file,
+                                 int width, int height, int fps_num, int fps_den);
+
+// Append a frame, [data] is an RGBA8 image with the size of the writer
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_write_frame(MicroDrawY4MWriter *writer, unsigned char *data,
+                                  MicroDrawPixel pixel);
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_end(MicroDrawY4MWriter *writer);
+
+#endif // MICRO_DRAW_Y4M
+
+// Async writer ------------------------------------------------------
+
+#ifdef MICRO_DRAW_ASYNC_WRITER
+
+#include <pthread.h>
+
+// What happens to a new frame when all the buffers are in use
+typedef enum {
+  // Wait until the writer thread is done with a frame
+  MICRO_DRAW_ASYNC_BLOCK = 0,
+  // Replace the oldest frame that was not written yet
+  MICRO_DRAW_ASYNC_DROP_OLDEST,
+  // Drop the new frame
+  MICRO_DRAW_ASYNC_DROP_NEWEST,
+} MicroDrawAsyncPolicy;
+
+// Encodes and writes a frame, called on the writer thread. [frame]
+// is the index of the frame in the order it was submitted.
+typedef MicroDrawError (*MicroDrawFrameWriteFn)(void *context, int frame,
+                                                unsigned char *data,
+                                                int data_width, int data_height,
+                                                MicroDrawPixel pixel);
+
+// Writes frames on a background thread. Frames are copied, or
+// rendered directly, in a pool of recycled buffers which are handed
+// to the thread through a bounded queue. Frames must be submitted
+// from a single thread.
+typedef struct {
+  int width;
+  int height;
+  MicroDrawPixel pixel;
+  MicroDrawAsyncPolicy policy;
+  MicroDrawFrameWriteFn write;
+  void *context;
+  int frames_submitted;
+  int frames_written;
+  int frames_dropped;
+  MicroDrawError error; // First error of the writer thread
+  // Private
+  pthread_t _thread;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _queued;   // A frame was queued or the writer ended
+  pthread_cond_t _released; // A buffer was released
+  unsigned char *_pool;
+  unsigned char **_free;    // Stack of the free buffers
+  int _free_count;
+  unsigned char **_queue;   // Ring of the queued buffers
+  int *_queue_frames;
+  int _queue_capacity;
+  int _queue_start;
+  int _queue_count;
+  int _ending;
+} MicroDrawAsyncWriter;
+
+// Start the writer thread, with room for [queue_capacity] frames
+// waiting to be written
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_begin(MicroDrawAsyncWriter *writer, int data_width,
+                              int data_height, MicroDrawPixel pixel,
+                              int queue_capacity, MicroDrawAsyncPolicy policy,
+                              MicroDrawFrameWriteFn write, void *context);
+
+// Copy [data] in a buffer and queue it
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_submit(MicroDrawAsyncWriter *writer, unsigned char *data);
+
+// Get a free buffer to render a frame in, without copying it. Returns
+// NULL if the frame is dropped. The buffer must be passed to
+// micro_draw_async_writer_commit.
+MICRO_DRAW_DEF unsigned char *
+micro_draw_async_writer_acquire(MicroDrawAsyncWriter *writer);
+
+MICRO_DRAW_DEF void
+micro_draw_async_writer_commit(MicroDrawAsyncWriter *writer, unsigned char *buffer);
+
+// Write all the queued frames and stop the thread. Returns the first
+// error of the writer thread.
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_end(MicroDrawAsyncWriter *writer);
+
+#endif // MICRO_DRAW_ASYNC_WRITER
+
+//
+// Implementation
+//
+
+#ifdef MICRO_DRAW_IMPLEMENTATION
+
+#include <assert.h>
+
+#if defined(__SSSE3__) && !defined(MICRO_DRAW_NO_SIMD)
+  #include <tmmintrin.h>
+#endif
+
+#ifdef MICRO_DRAW_THREADS
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_draw_get_channels");
+MICRO_DRAW_DEF unsigned int micro_draw_get_channels(MicroDrawPixel pixel)
+{
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+    return 4;
+  case MICRO_DRAW_BLACK_WHITE:
+    return 1;
+  case MICRO_DRAW_RGB8:
+    return 3;
+  case MICRO_DRAW_GRAY8:
+    return 1;
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_draw_get_channel_size");
+MICRO_DRAW_DEF unsigned int micro_draw_get_channel_size(MicroDrawPixel pixel)
+{
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+    return 1;
+  case MICRO_DRAW_BLACK_WHITE:
+    return 1;
+  case MICRO_DRAW_RGB8:
+    return 1;
+  case MICRO_DRAW_GRAY8:
+    return 1;
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_draw_color_to_rgba8");
+MICRO_DRAW_DEF void
+micro_draw_color_to_rgba8(unsigned char* color_src, MicroDrawPixel pixel_src,
+                          unsigned char color_dest[4])
+{
+  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
+  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
+  
+  switch(pixel_src)
+  {
+  case MICRO_DRAW_RGBA8:
+    for (int i = 0; i < 4; ++i)
+      color_dest[i] = color_src[i];
+    break;
+  case MICRO_DRAW_BLACK_WHITE:
+    color_dest[0] = color_src[0] * 255;
+    color_dest[1] = color_src[0] * 255;
+    color_dest[2] = color_src[0] * 255;
+    color_dest[3] = 255;
+    break;
+  case MICRO_DRAW_RGB8:
+    for (int i = 0; i < 3; ++i)
+      color_dest[i] = color_src[i];
+    color_dest[3] = 255;
+    break;
+  case MICRO_DRAW_GRAY8:
+    color_dest[0] = color_src[0];
+    color_dest[1] = color_src[0];
+    color_dest[2] = color_src[0];
+    color_dest[3] = 255;
+    break;
+  default:
+    break;
+  }
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_draw_color_from_rgba8");
+MICRO_DRAW_DEF void
+micro_draw_color_from_rgba8(unsigned char color_src[4],
+                            unsigned char *color_dest, MicroDrawPixel pixel_dest)
+{
+  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
+  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
+
+  switch(pixel_dest)
+  {
+  case MICRO_DRAW_RGBA8:
+    for (int i = 0; i < 4; ++i)
+      color_dest[i] = color_src[i];
+    break;
+  case MICRO_DRAW_BLACK_WHITE:
+    color_dest[0] = color_src[0] == 255 ? 1 : 0;
+    break;
+  case MICRO_DRAW_RGB8:
+    for (int i = 0; i < 3; ++i)
+      color_dest[i] = color_src[i];
+    break;
+  case MICRO_DRAW_GRAY8:
+    // BT.601 luma
+    color_dest[0] = (color_src[0] * 77 + color_src[1] * 150
+                     + color_src[2] * 29) >> 8;
+    break;
+  default:
+    break;
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_color_convert(unsigned char *color_src, MicroDrawPixel pixel_src,
+                         unsigned char *color_dest, MicroDrawPixel pixel_dest)
+{
+  assert(micro_draw_get_channels(MICRO_DRAW_RGBA8) == 4);
+  assert(micro_draw_get_channel_size(MICRO_DRAW_RGBA8) == 1);
+
+  unsigned char color_rgba[4] = {0};
+  micro_draw_color_to_rgba8(color_src, pixel_src, color_rgba);
+  micro_draw_color_from_rgba8(color_rgba, color_dest, pixel_dest);
+  
+  return;
+}
+
+static inline void *
+_micro_draw_memcpy(void *dest, const void *src, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; ++i)
+    ((char*)dest)[i] = ((char*)src)[i];
+  return dest;
+}
+
+#define _micro_draw_min(a, b) ((a) < (b) ? (a) : (b))
+#define _micro_draw_max(a, b) ((a) > (b) ? (a) : (b))
+#define _micro_draw_min3(a, b, c) (_micro_draw_min(_micro_draw_min((a), (b)), (c)))
+#define _micro_draw_max3(a, b, c) (_micro_draw_max(_micro_draw_max((a), (b)), (c)))
+
+// Rows of [row_size] bytes that fit in 64 KiB, the size of the ranges
+// of the parallel row loops
+static inline int _micro_draw_rows_grain(int row_size)
+{
+  return _micro_draw_max(1, (64 * 1024) / _micro_draw_max(row_size, 1));
+}
+
+#ifdef MICRO_DRAW_THREADS
+
+// Jobs that a deque can hold, a power of two
+#define _MICRO_DRAW_DEQUE_SIZE 1024
+
+// Chase-Lev deque: the thread owning it pushes and pops jobs at the
+// bottom, the other threads steal them from the top
+typedef struct {
+  long top;
+  long bottom;
+  MicroDrawJob *jobs[_MICRO_DRAW_DEQUE_SIZE];
+} _MicroDrawDeque;
+
+typedef struct {
+  _MicroDrawDeque deques[MICRO_DRAW_THREADS]; // 0 is the calling thread's
+  int slots[MICRO_DRAW_THREADS];              // Index of every deque
+  pthread_once_t once;
+  pthread_key_t slot;     // The slot of the current thread, if any
+  int external_busy;      // A thread outside the pool owns deque 0
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;    // A job was pushed
+  int sleeping;           // Threads waiting for jobs
+} _MicroDrawPool;
+
+static _MicroDrawPool _micro_draw_pool = {
+  .once = PTHREAD_ONCE_INIT,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// Returns 0 if the deque is full
+static inline int
+_micro_draw_deque_push(_MicroDrawDeque *deque, MicroDrawJob *job)
+{
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= _MICRO_DRAW_DEQUE_SIZE) return 0;
+  
+  __atomic_store_n(&deque->jobs[bottom & (_MICRO_DRAW_DEQUE_SIZE - 1)], job,
+                   __ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static inline MicroDrawJob *_micro_draw_deque_pop(_MicroDrawDeque *deque)
+{
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+  
+  MicroDrawJob *job = NULL;
+  if (top <= bottom)
+  {
+    job = __atomic_load_n(&deque->jobs[bottom & (_MICRO_DRAW_DEQUE_SIZE - 1)],
+                          __ATOMIC_ACQUIRE);
+    if (top < bottom) return job;
+    
+    // The last job, the thieves may be taking it too
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      job = NULL;
+  }
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return job;
+}
+
+// Returns NULL if the deque is empty or another thread took the job
+static inline MicroDrawJob *_micro_draw_deque_steal(_MicroDrawDeque *deque)
+{
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) return NULL;
+  
+  MicroDrawJob *job =
+    __atomic_load_n(&deque->jobs[top & (_MICRO_DRAW_DEQUE_SIZE - 1)],
+                    __ATOMIC_ACQUIRE);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return NULL;
+  return job;
+}
+
+static inline int _micro_draw_pool_has_jobs(_MicroDrawPool *pool)
+{
+  for (int i = 0; i < MICRO_DRAW_THREADS; ++i)
+    if (__atomic_load_n(&pool->deques[i].top, __ATOMIC_SEQ_CST)
+        < __atomic_load_n(&pool->deques[i].bottom, __ATOMIC_SEQ_CST))
+      return 1;
+  return 0;
+}
+
+static inline void _micro_draw_pool_wake(_MicroDrawPool *pool)
+{
+  // Pairs with the check of a thread going to sleep
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->sleeping, __ATOMIC_RELAXED) == 0) return;
+  pthread_mutex_lock(&pool->mutex);
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+  return;
+}
+
+// A job from the deque of [slot], or stolen from the others
+static inline MicroDrawJob *_micro_draw_pool_find(_MicroDrawPool *pool, int slot)
+{
+  MicroDrawJob *job = _micro_draw_deque_pop(&pool->deques[slot]);
+  for (int i = 1; job == NULL && i < MICRO_DRAW_THREADS; ++i)
+    job = _micro_draw_deque_steal(&pool->deques[(slot + i) % MICRO_DRAW_THREADS]);
+  return job;
+}
+
+static void _micro_draw_pool_run(_MicroDrawPool *pool, int slot, MicroDrawJob *job);
+
+static inline void
+_micro_draw_pool_ready(_MicroDrawPool *pool, int slot, MicroDrawJob *job)
+{
+  if (_micro_draw_deque_push(&pool->deques[slot], job))
+    _micro_draw_pool_wake(pool);
+  else
+    _micro_draw_pool_run(pool, slot, job);
+  return;
+}
+
+// Run [job], then push the jobs waiting only for it
+static void _micro_draw_pool_run(_MicroDrawPool *pool, int slot, MicroDrawJob *job)
+{
+  job->fn(job->context);
+  
+  // The job may be freed as soon as remaining is decremented
+  int *remaining = job->_remaining;
+  for (int i = 0; i < job->_dependents_count; ++i)
+  {
+    MicroDrawJob *dependent = job->_dependents[i];
+    if (__atomic_sub_fetch(&dependent->_pending, 1, __ATOMIC_ACQ_REL) == 0)
+      _micro_draw_pool_ready(pool, slot, dependent);
+  }
+  __atomic_sub_fetch(remaining, 1, __ATOMIC_RELEASE);
+  return;
+}
+
+// Run jobs until [remaining] is 0
+static inline void
+_micro_draw_pool_wait(_MicroDrawPool *pool, int slot, int *remaining)
+{
+  while (__atomic_load_n(remaining, __ATOMIC_ACQUIRE) > 0)
+  {
+    MicroDrawJob *job = _micro_draw_pool_find(pool, slot);
+    if (job != NULL)
+      _micro_draw_pool_run(pool, slot, job);
+    else
+      sched_yield();
+  }
+  return;
+}
+
+static void *_micro_draw_pool_worker(void *arg)
+{
+  _MicroDrawPool *pool = &_micro_draw_pool;
+  int slot = *(int*)arg;
+  pthread_setspecific(pool->slot, arg);
+  for (;;)
+  {
+    MicroDrawJob *job = NULL;
+    for (int spin = 0; spin < 64 && job == NULL; ++spin)
+    {
+      job = _micro_draw_pool_find(pool, slot);
+      if (job == NULL) sched_yield();
+    }
+    if (job != NULL)
+    {
+      _micro_draw_pool_run(pool, slot, job);
+      continue;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (!_micro_draw_pool_has_jobs(pool))
+      pthread_cond_wait(&pool->wake, &pool->mutex);
+    __atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+  return NULL;
+}
+
+static void _micro_draw_pool_start(void)
+{
+  _MicroDrawPool *pool = &_micro_draw_pool;
+  pthread_key_create(&pool->slot, NULL);
+  for (int i = 0; i < MICRO_DRAW_THREADS; ++i)
+    pool->slots[i] = i;
+  for (int i = 1; i < MICRO_DRAW_THREADS; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _micro_draw_pool_worker, &pool->slots[i]) == 0)
+      pthread_detach(thread);
+  }
+  return;
+}
+
+// The deque of the calling thread, or -1 if it has none. The threads
+// of the pool have their own, one thread outside of it takes deque 0
+// and sets [owner] until _micro_draw_pool_leave.
+static inline int _micro_draw_pool_enter(_MicroDrawPool *pool, int *owner)
+{
+  pthread_once(&pool->once, _micro_draw_pool_start);
+  *owner = 0;
+  int *slot = pthread_getspecific(pool->slot);
+  if (slot != NULL) return *slot;
+  
+  int expected = 0;
+  if (!__atomic_compare_exchange_n(&pool->external_busy, &expected, 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return -1;
+  pthread_setspecific(pool->slot, &pool->slots[0]);
+  *owner = 1;
+  return 0;
+}
+
+static inline void _micro_draw_pool_leave(_MicroDrawPool *pool, int owner)
+{
+  if (!owner) return;
+  pthread_setspecific(pool->slot, NULL);
+  __atomic_store_n(&pool->external_busy, 0, __ATOMIC_RELEASE);
+  return;
+}
+
+typedef struct {
+  MicroDrawJob job;
+  MicroDrawRangeFn fn;
+  void *context;
+  int begin;
+  int end;
+  int grain;
+} _MicroDrawRangeJob;
+
+static void _micro_draw_range_job(void *context);
+
+// Push the second half of the range for the other threads, run the
+// first one, then wait for the second
+static void
+_micro_draw_pool_split(_MicroDrawPool *pool, int slot, MicroDrawRangeFn fn,
+                       void *context, int begin, int end, int grain)
+{
+  if (end - begin <= grain)
+  {
+    fn(context, begin, end);
+    return;
+  }
+  
+  int middle = begin + (end - begin) / 2;
+  int remaining = 1;
+  _MicroDrawRangeJob half = {
+    .fn = fn,
+    .context = context,
+    .begin = middle,
+    .end = end,
+    .grain = grain,
+  };
+  micro_draw_job_init(&half.job, _micro_draw_range_job, &half);
+  half.job._remaining = &remaining;
+  if (!_micro_draw_deque_push(&pool->deques[slot], &half.job))
+  {
+    _micro_draw_pool_split(pool, slot, fn, context, begin, middle, grain);
+    _micro_draw_pool_split(pool, slot, fn, context, middle, end, grain);
+    return;
+  }
+  _micro_draw_pool_wake(pool);
+  
+  _micro_draw_pool_split(pool, slot, fn, context, begin, middle, grain);
+  _micro_draw_pool_wait(pool, slot, &remaining);
+  return;
+}
+
+static void _micro_draw_range_job(void *context)
+{
+  _MicroDrawRangeJob *range = context;
+  _MicroDrawPool *pool = &_micro_draw_pool;
+  int slot = *(int*)pthread_getspecific(pool->slot);
+  _micro_draw_pool_split(pool, slot, range->fn, range->context,
+                         range->begin, range->end, range->grain);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_parallel_for(int count, int grain, MicroDrawRangeFn fn, void *context)
+{
+  _MicroDrawPool *pool = &_micro_draw_pool;
+  grain = _micro_draw_max(grain, 1);
+  if (count <= 0) return;
+  if (count <= grain)
+  {
+    fn(context, 0, count);
+    return;
+  }
+  
+  int owner;
+  int slot = _micro_draw_pool_enter(pool, &owner);
+  if (slot < 0)
+  {
+    for (int begin = 0; begin < count; begin += grain)
+      fn(context, begin, _micro_draw_min(begin + grain, count));
+    return;
+  }
+  _micro_draw_pool_split(pool, slot, fn, context, 0, count, grain);
+  _micro_draw_pool_leave(pool, owner);
+  return;
+}
+
+#endif // MICRO_DRAW_THREADS
+
+MICRO_DRAW_DEF void
+micro_draw_job_init(MicroDrawJob *job, MicroDrawJobFn fn, void *context)
+{
+  *job = (MicroDrawJob) {
+    .fn = fn,
+    .context = context,
+    ._pending = 1,
+  };
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_job_depend(MicroDrawJob *job, MicroDrawJob *dependency)
+{
+  if (dependency->_dependents_count == dependency->_dependents_capacity)
+  {
+    int capacity = _micro_draw_max(4, dependency->_dependents_capacity * 2);
+    MicroDrawJob **dependents =
+      MICRO_DRAW_REALLOC(dependency->_dependents, capacity * sizeof(MicroDrawJob*));
+    if (dependents == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+    dependency->_dependents = dependents;
+    dependency->_dependents_capacity = capacity;
+  }
+  dependency->_dependents[dependency->_dependents_count++] = job;
+  job->_pending++;
+  return MICRO_DRAW_OK;
+}
+
+// Run the jobs on the calling thread, the ready ones in a stack
+static inline void _micro_draw_run_jobs_serial(MicroDrawJob *jobs, int count)
+{
+  MicroDrawJob *ready = NULL;
+  for (int i = count - 1; i >= 0; --i)
+  {
+    if (--jobs[i]._pending > 0) continue;
+    jobs[i]._next = ready;
+    ready = &jobs[i];
+  }
+  
+  while (ready != NULL)
+  {
+    MicroDrawJob *job = ready;
+    ready = job->_next;
+    job->fn(job->context);
+    for (int i = job->_dependents_count - 1; i >= 0; --i)
+    {
+      MicroDrawJob *dependent = job->_dependents[i];
+      if (--dependent->_pending > 0) continue;
+      dependent->_next = ready;
+      ready = dependent;
+    }
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_run_jobs(MicroDrawJob *jobs, int count)
+{
+#ifdef MICRO_DRAW_THREADS
+  _MicroDrawPool *pool = &_micro_draw_pool;
+  int owner;
+  int slot = _micro_draw_pool_enter(pool, &owner);
+  if (slot >= 0)
+  {
+    // Every job holds one on its own pending count until it is pushed
+    // here, so that it is pushed only once
+    int remaining = count;
+    for (int i = 0; i < count; ++i)
+      jobs[i]._remaining = &remaining;
+    for (int i = 0; i < count; ++i)
+      if (__atomic_sub_fetch(&jobs[i]._pending, 1, __ATOMIC_ACQ_REL) == 0)
+        _micro_draw_pool_ready(pool, slot, &jobs[i]);
+    _micro_draw_pool_wait(pool, slot, &remaining);
+    _micro_draw_pool_leave(pool, owner);
+  }
+  else
+#endif
+  {
+    _micro_draw_run_jobs_serial(jobs, count);
+  }
+
+  for (int i = 0; i < count; ++i)
+  {
+    MICRO_DRAW_FREE(jobs[i]._dependents);
+    micro_draw_job_init(&jobs[i], jobs[i].fn, jobs[i].context);
+  }
+  return;
+}
+
+// Empty rectangles have a zero size
+static inline MicroDrawRect _micro_draw_rect_intersect(MicroDrawRect a, MicroDrawRect b)
+{
+  MicroDrawRect rect = {
+    .x = _micro_draw_max(a.x, b.x),
+    .y = _micro_draw_max(a.y, b.y),
+  };
+  rect.w = _micro_draw_max(0, _micro_draw_min(a.x + a.w, b.x + b.w) - rect.x);
+  rect.h = _micro_draw_max(0, _micro_draw_min(a.y + a.h, b.y + b.h) - rect.y);
+  return rect;
+}
+
+static struct {
+  MicroDrawRect rects[MICRO_DRAW_CLIP_STACK_SIZE];
+  int count;
+} _micro_draw_clip;
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_clip_push(MicroDrawRect rect)
+{
+  if (_micro_draw_clip.count == MICRO_DRAW_CLIP_STACK_SIZE)
+    return MICRO_DRAW_ERROR_CLIP_STACK_FULL;
+  if (_micro_draw_clip.count > 0)
+    rect = _micro_draw_rect_intersect(rect,
+                                      _micro_draw_clip.rects[_micro_draw_clip.count - 1]);
+  _micro_draw_clip.rects[_micro_draw_clip.count++] = rect;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_clip_pop(void)
+{
+  if (_micro_draw_clip.count > 0)
+    _micro_draw_clip.count--;
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawRect
+micro_draw_clip_rect(int data_width, int data_height)
+{
+  MicroDrawRect screen = { .w = data_width, .h = data_height };
+  if (_micro_draw_clip.count == 0) return screen;
+  return _micro_draw_rect_intersect(screen,
+                                    _micro_draw_clip.rects[_micro_draw_clip.count - 1]);
+}
+  
+MICRO_DRAW_DEF void
+micro_draw_pixel(unsigned char* data, int data_width, int data_height,
+                 int x, int y, unsigned char* color, MicroDrawPixel pixel)
+{
+  if (x >= data_width || x < 0 || y >= data_height || y < 0) return;
+
+  int channel_size = micro_draw_get_channel_size(pixel); // bytes
+  unsigned int channels = micro_draw_get_channels(pixel);
+  int index = (y * data_width + x) * channels * channel_size;
+  
+  _micro_draw_memcpy(&data[index], color, channels * channel_size);
+
+  return;
+}
+
+// The primitives draw only the pixels inside a clip rectangle, which
+// is inside the image. The clip does not change which pixels are
+// drawn inside of it, so an image drawn in many clips is the same as
+// the image drawn at once.
+
+static inline void
+_micro_draw_line_clipped(unsigned char* data, int data_width, int data_height,
+                         MicroDrawRect clip, int a_x, int a_y, int b_x, int b_y,
+                         unsigned char* color, MicroDrawPixel pixel)
+{
+  // Line equation
+  double m = (a_y - b_y) / (double)(a_x - b_x);
+  double q = a_y - m * a_x;
+  int is_steep = (m > 1 || m < -1);
+
+  if (is_steep)
+  {
+    // Transpose the image
+    int tmp = a_x;
+    a_x = a_y;
+    a_y = tmp;
+
+    tmp = b_x;
+    b_x = b_y;
+    b_y = tmp;
+
+    m = (a_y - b_y) / (double)(a_x - b_x);
+    q = a_y - m * a_x;
+  }
+
+  int start, end;
+  if (a_x > b_x)
+  {
+    start = b_x;
+    end = a_x;
+  }
+  else
+  {
+    start = a_x;
     end = b_x;
   }
 
-  if (is_steep)
+  if (is_steep)
+  {
+    // Iterate by columns
+    start = _micro_draw_max(start, clip.y);
+    end = _micro_draw_min(end, clip.y + clip.h);
+    for (int p_x = start; p_x < end; ++p_x)
+    {
+      int p_y = m * p_x + q;
+      if (p_y < clip.x || p_y >= clip.x + clip.w) continue;
+      // Retranspose the image
+      micro_draw_pixel(data, data_width, data_height,
+                       p_y, p_x, color, pixel);
+    }
+  }
+  else
+  {
+    // Transposed
+    start = _micro_draw_max(start, clip.x);
+    end = _micro_draw_min(end, clip.x + clip.w);
+    for (int p_x = start; p_x < end; ++p_x)
+    {
+      int p_y = m * p_x + q;
+      if (p_y < clip.y || p_y >= clip.y + clip.h) continue;
+      micro_draw_pixel(data, data_width, data_height,
+                       p_x, p_y, color, pixel);
+    }
+  }
+  
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_line(unsigned char* data, int data_width, int data_height,
+                int a_x, int a_y, int b_x, int b_y,
+                unsigned char* color, MicroDrawPixel pixel)
+{
+  MicroDrawRect screen = micro_draw_clip_rect(data_width, data_height);
+  _micro_draw_line_clipped(data, data_width, data_height, screen,
+                           a_x, a_y, b_x, b_y, color, pixel);
+  return;
+}
+
+typedef struct {
+  unsigned char *data;
+  int width;
+  int height;
+  unsigned char *color;
+  MicroDrawPixel pixel;
+  MicroDrawRect clip;
+} _MicroDrawClearJob;
+
+static void _micro_draw_clear_rows(void *context, int begin, int end)
+{
+  _MicroDrawClearJob *job = context;
+  for (int row = job->clip.y + begin; row < job->clip.y + end; ++row)
+    for (int col = job->clip.x; col < job->clip.x + job->clip.w; ++col)
+      micro_draw_pixel(job->data, job->width, job->height,
+                       col, row, job->color, job->pixel);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_clear(unsigned char* data, int data_width, int data_height,
+                 unsigned char *color, MicroDrawPixel pixel)
+{
+  _MicroDrawClearJob job = {
+    data, data_width, data_height, color, pixel,
+    micro_draw_clip_rect(data_width, data_height),
+  };
+  int row_size = job.clip.w * micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+  MICRO_DRAW_PARALLEL_FOR(job.clip.h, _micro_draw_rows_grain(row_size),
+                          _micro_draw_clear_rows, &job);
+  return;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that color_dest in micro_draw_overlap is enough");
+static inline void
+_micro_draw_overlap_clipped(unsigned char* src_data, int src_data_width,
+                            int src_data_height, MicroDrawPixel src_pixel,
+                            unsigned char* dest_data, int dest_data_width,
+                            int dest_data_height, MicroDrawPixel dest_pixel,
+                            MicroDrawRect clip, int x_offset, int y_offset)
+{
+  int channel_size = micro_draw_get_channel_size(src_pixel); // bytes
+  unsigned int channels = micro_draw_get_channels(src_pixel);
+  int row_end = _micro_draw_min(src_data_height, clip.y + clip.h - y_offset);
+  int col_end = _micro_draw_min(src_data_width, clip.x + clip.w - x_offset);
+
+  for (int row = _micro_draw_max(0, clip.y - y_offset); row < row_end; ++row)
+  {
+    for (int col = _micro_draw_max(0, clip.x - x_offset); col < col_end; ++col)
+    {
+      int index = (row * src_data_width + col) * channels * channel_size;
+      unsigned char color_dest[4] = {0}; // 4 is enough for now
+      micro_draw_color_convert(src_data + index, src_pixel,
+                               color_dest, dest_pixel);
+      micro_draw_pixel(dest_data, dest_data_width, dest_data_height,
+                       col + x_offset, row + y_offset, color_dest, dest_pixel);
+    }
+  }
+  
+  return;
+}
+
+typedef struct {
+  unsigned char *src_data;
+  int src_width;
+  int src_height;
+  MicroDrawPixel src_pixel;
+  unsigned char *dest_data;
+  int dest_width;
+  int dest_height;
+  MicroDrawPixel dest_pixel;
+  int x;
+  int y;
+  MicroDrawRect clip;
+  int first_row;
+} _MicroDrawOverlapJob;
+
+static void _micro_draw_overlap_rows(void *context, int begin, int end)
+{
+  _MicroDrawOverlapJob *job = context;
+  MicroDrawRect band = {
+    .x = job->clip.x,
+    .y = job->first_row + begin,
+    .w = job->clip.w,
+    .h = end - begin,
+  };
+  _micro_draw_overlap_clipped(job->src_data, job->src_width, job->src_height,
+                              job->src_pixel, job->dest_data, job->dest_width,
+                              job->dest_height, job->dest_pixel, band,
+                              job->x, job->y);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_overlap(unsigned char* src_data, int src_data_width,
+                   int src_data_height, MicroDrawPixel src_pixel,
+                   unsigned char* dest_data, int dest_data_width,
+                   int dest_data_height, MicroDrawPixel dest_pixel,
+                   int x_offset, int y_offset)
+{
+  // Only the rows of the destination under the source
+  MicroDrawRect clip = micro_draw_clip_rect(dest_data_width, dest_data_height);
+  int first_row = _micro_draw_max(y_offset, clip.y);
+  int rows = _micro_draw_min(y_offset + src_data_height, clip.y + clip.h) - first_row;
+  _MicroDrawOverlapJob job = {
+    src_data, src_data_width, src_data_height, src_pixel,
+    dest_data, dest_data_width, dest_data_height, dest_pixel,
+    x_offset, y_offset, clip, first_row,
+  };
+  int row_size = src_data_width * micro_draw_get_channels(src_pixel)
+    * micro_draw_get_channel_size(src_pixel);
+  if (rows > 0)
+    MICRO_DRAW_PARALLEL_FOR(rows, _micro_draw_rows_grain(row_size),
+                            _micro_draw_overlap_rows, &job);
+  return;
+}
+
+static inline void
+_micro_draw_fill_rect_clipped(unsigned char* data, int data_width, int data_height,
+                              MicroDrawRect clip, int x, int y, int w, int h,
+                              unsigned char *color, MicroDrawPixel pixel)
+{
+  int row_end = _micro_draw_min(h + y, clip.y + clip.h);
+  int col_end = _micro_draw_min(w + x, clip.x + clip.w);
+  for (int row = _micro_draw_max(y, clip.y); row < row_end; ++row)
+  {
+    for (int col = _micro_draw_max(x, clip.x); col < col_end; ++col)
+    {
+      micro_draw_pixel(data, data_width, data_height,
+                       col, row, color, pixel);
+    }
+  }
+  
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_fill_rect(unsigned char* data, int data_width, int data_height,
+                     int x, int y, int w, int h, unsigned char *color,
+                     MicroDrawPixel pixel)
+{
+  MicroDrawRect screen = micro_draw_clip_rect(data_width, data_height);
+  _micro_draw_fill_rect_clipped(data, data_width, data_height, screen,
+                                x, y, w, h, color, pixel);
+  return;
+}
+
+#define MICRO_DRAW_ABS(x) (((x) >= 0) ? (x) : -(x))
+
+static inline void
+_micro_draw_fill_circle_clipped(unsigned char* data, int data_width,
+                                int data_height, MicroDrawRect clip,
+                                int center_x, int center_y, int radius,
+                                unsigned char *color, MicroDrawPixel pixel)
+{
+  int row_end = _micro_draw_min(center_y + radius, clip.y + clip.h);
+  int col_end = _micro_draw_min(center_x + radius, clip.x + clip.w);
+  for (int row = _micro_draw_max(center_y - radius, clip.y); row < row_end; ++row)
+  {
+    for (int col = _micro_draw_max(center_x - radius, clip.x); col < col_end; ++col)
+    {
+      int dx = MICRO_DRAW_ABS(col - center_x);
+      int dy = MICRO_DRAW_ABS(row - center_y);
+      if (dx*dx + dy*dy > radius*radius) continue;
+      
+      micro_draw_pixel(data, data_width, data_height,
+                       col, row, color, pixel);
+    }
+  }
+
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_fill_circle(unsigned char* data, int data_width, int data_height,
+                       int center_x, int center_y, int radius,
+                       unsigned char *color, MicroDrawPixel pixel)
+{
+  MicroDrawRect screen = micro_draw_clip_rect(data_width, data_height);
+  _micro_draw_fill_circle_clipped(data, data_width, data_height, screen,
+                                  center_x, center_y, radius, color, pixel);
+  return;
+}
+
+// Get the orientation of three 2D points (a, b, c).
+//
+// This computes the determinant:
+//
+// det( [[ a_x, a_y, 1 ],
+//       [ b_x, b_y, 1 ],
+//       [ c_x, c_y, 1 ]] )
+//
+// Algebraically, this is equal to
+//
+//   (b_x - a_x) * (c_y - a_y) - (b_y - a_y) * (c_x - a_x)
+//
+// which is twice the signed area of the triangle (a, b, c).
+//
+// The sign of the result indicates the orientation:
+//   > 0 : counterclockwise
+//   < 0 : clockwise
+//   = 0 : collinear
+//
+// This orientation test is important for rasterization. Suppose we
+// want to test whether a point P lies inside the triangle (a, b, c).
+// We form the three sub-triangles (P, b, c), (a, P, c), and (a, b, P).
+// If P is inside, all of these orientations will have the same sign
+// as the orientation of the original triangle. If P is outside, at
+// least one orientation will differ.
+//
+// See also: Fabian Giesen,
+// “The barycentric conspiracies”
+// https://fgiesen.wordpress.com/2013/02/06/the-barycentric-conspirac/
+#define _micro_draw_orient2D(a_x, a_y, b_x, b_y, c_x, c_y) \
+    ( ((b_x) - (a_x)) * ((c_y) - (a_y)) - ((b_y) - (a_y)) * ((c_x) - (a_x)) )
+
+// https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
+static inline void
+_micro_draw_fill_triangle_clipped(unsigned char *data, int data_width,
+                                  int data_height, MicroDrawRect clip,
+                                  int a_x, int a_y, int b_x, int b_y,
+                                  int c_x, int c_y, unsigned char *color,
+                                  MicroDrawPixel pixel)
+{
+  // Compute triangle bounding box
+  int minX = _micro_draw_min3(a_x, b_x, c_x);
+  int minY = _micro_draw_min3(a_y, b_y, c_y);
+  int maxX = _micro_draw_max3(a_x, b_x, c_x);
+  int maxY = _micro_draw_max3(a_y, b_y, c_y);
+
+  // Clip against the clip bounds
+  minX = _micro_draw_max(minX, clip.x);
+  minY = _micro_draw_max(minY, clip.y);
+  maxX = _micro_draw_min(maxX, clip.x + clip.w - 1);
+  maxY = _micro_draw_min(maxY, clip.y + clip.h - 1);
+
+  for (int row = minY; row <= maxY; ++row)
+  {
+    for (int col = minX; col <= maxX; ++col)
+    {  
+      // Determine barycentric coordinates
+      int w0 = _micro_draw_orient2D(b_x, b_y, c_x, c_y, col, row);
+      int w1 = _micro_draw_orient2D(c_x, c_y, a_x, a_y, col, row);
+      int w2 = _micro_draw_orient2D(a_x, a_y, b_x, b_y, col, row);
+
+      // If p is on or inside all edges, render pixel.
+      if (w0 >= 0 && w1 >= 0 && w2 >= 0)
+        micro_draw_pixel(data, data_width, data_height,
+                         col, row, color, pixel);
+    }
+  }
+
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle(unsigned char *data, int data_width, int data_height,
+                         int a_x, int a_y, int b_x, int b_y,
+                         int c_x, int c_y, unsigned char *color,
+                         MicroDrawPixel pixel)
+{
+  MicroDrawRect screen = micro_draw_clip_rect(data_width, data_height);
+  _micro_draw_fill_triangle_clipped(data, data_width, data_height, screen,
+                                    a_x, a_y, b_x, b_y, c_x, c_y, color, pixel);
+  return;
+}
+
+// Values are interpolated on triangles in fixed point, with this many
+// fractional bits
+#define _MICRO_DRAW_FIXED_FRACTION 16
+
+static inline long long _micro_draw_round(double value)
+{
+  return (value >= 0) ? (long long)(value + 0.5) : -(long long)(0.5 - value);
+}
+
+// The edge functions of a triangle at [x, y], stepping by one pixel
+// in x or y. With any winding they are all positive inside the
+// triangle, and their sum is [area].
+typedef struct {
+  int x;
+  int y;
+  int w[3];
+  int step_x[3];
+  int step_y[3];
+  int area;
+} _MicroDrawTriangleSetup;
+
+// A value interpolated on a triangle in fixed point, at the origin of
+// the setup
+typedef struct {
+  long long value;
+  long long step_x;
+  long long step_y;
+} _MicroDrawTrianglePlane;
+
+// Set up the edge functions at the corner of [bounds], the bounding
+// box of the triangle inside [clip]. Returns 0 if nothing is drawn.
+static inline int
+_micro_draw_triangle_setup(_MicroDrawTriangleSetup *setup, MicroDrawRect *bounds,
+                           MicroDrawRect clip, int a_x, int a_y, int b_x, int b_y,
+                           int c_x, int c_y)
+{
+  int area = _micro_draw_orient2D(a_x, a_y, b_x, b_y, c_x, c_y);
+  if (area == 0) return 0;
+  *bounds = (MicroDrawRect) {
+    .x = _micro_draw_min3(a_x, b_x, c_x),
+    .y = _micro_draw_min3(a_y, b_y, c_y),
+  };
+  bounds->w = _micro_draw_max3(a_x, b_x, c_x) - bounds->x + 1;
+  bounds->h = _micro_draw_max3(a_y, b_y, c_y) - bounds->y + 1;
+  *bounds = _micro_draw_rect_intersect(*bounds, clip);
+  if (bounds->w == 0 || bounds->h == 0) return 0;
+
+  *setup = (_MicroDrawTriangleSetup) {
+    .x = bounds->x,
+    .y = bounds->y,
+    .w = {
+      _micro_draw_orient2D(b_x, b_y, c_x, c_y, bounds->x, bounds->y),
+      _micro_draw_orient2D(c_x, c_y, a_x, a_y, bounds->x, bounds->y),
+      _micro_draw_orient2D(a_x, a_y, b_x, b_y, bounds->x, bounds->y),
+    },
+    .step_x = { b_y - c_y, c_y - a_y, a_y - b_y },
+    .step_y = { c_x - b_x, a_x - c_x, b_x - a_x },
+    .area = area,
+  };
+  if (area < 0)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      setup->w[i] = -setup->w[i];
+      setup->step_x[i] = -setup->step_x[i];
+      setup->step_y[i] = -setup->step_y[i];
+    }
+    setup->area = -area;
+  }
+  return 1;
+}
+
+// The plane through the values [a], [b] and [c] at the vertices: the
+// average of the values weighted by the edge functions, it steps by a
+// constant amount like them
+static inline _MicroDrawTrianglePlane
+_micro_draw_triangle_plane(_MicroDrawTriangleSetup *setup, double a, double b, double c)
+{
+  return (_MicroDrawTrianglePlane) {
+    .value = _micro_draw_round((setup->w[0] * a + setup->w[1] * b
+                                + setup->w[2] * c) / setup->area),
+    .step_x = _micro_draw_round((setup->step_x[0] * a + setup->step_x[1] * b
+                                 + setup->step_x[2] * c) / setup->area),
+    .step_y = _micro_draw_round((setup->step_y[0] * a + setup->step_y[1] * b
+                                 + setup->step_y[2] * c) / setup->area),
+  };
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that the colors in micro_draw_fill_triangle_gouraud are enough");
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_gouraud(unsigned char *data, int data_width, int data_height,
+                                 int a_x, int a_y, unsigned char *a_color,
+                                 int b_x, int b_y, unsigned char *b_color,
+                                 int c_x, int c_y, unsigned char *c_color,
+                                 MicroDrawPixel pixel)
+{
+  _MicroDrawTriangleSetup setup;
+  MicroDrawRect bounds;
+  if (!_micro_draw_triangle_setup(&setup, &bounds,
+                                  micro_draw_clip_rect(data_width, data_height),
+                                  a_x, a_y, b_x, b_y, c_x, c_y))
+    return;
+
+  int size = micro_draw_get_channels(pixel) * micro_draw_get_channel_size(pixel);
+  double one = 1 << _MICRO_DRAW_FIXED_FRACTION;
+  _MicroDrawTrianglePlane planes[4];
+  for (int i = 0; i < size; ++i)
+  {
+    planes[i] = _micro_draw_triangle_plane(&setup, a_color[i] * one,
+                                           b_color[i] * one, c_color[i] * one);
+    // Round to the nearest
+    planes[i].value += 1 << (_MICRO_DRAW_FIXED_FRACTION - 1);
+  }
+
+  unsigned char color[4];
+  for (int y = 0; y < bounds.h; ++y)
+  {
+    int w0 = setup.w[0], w1 = setup.w[1], w2 = setup.w[2];
+    long long values[4];
+    for (int i = 0; i < size; ++i)
+      values[i] = planes[i].value;
+    for (int x = 0; x < bounds.w; ++x)
+    {
+      if ((w0 | w1 | w2) >= 0)
+      {
+        for (int i = 0; i < size; ++i)
+          color[i] = _micro_draw_min(_micro_draw_max(values[i] >> _MICRO_DRAW_FIXED_FRACTION,
+                                                     0), 255);
+        micro_draw_pixel(data, data_width, data_height,
+                         bounds.x + x, bounds.y + y, color, pixel);
+      }
+      w0 += setup.step_x[0];
+      w1 += setup.step_x[1];
+      w2 += setup.step_x[2];
+      for (int i = 0; i < size; ++i)
+        values[i] += planes[i].step_x;
+    }
+    for (int i = 0; i < 3; ++i)
+      setup.w[i] += setup.step_y[i];
+    for (int i = 0; i < size; ++i)
+      planes[i].value += planes[i].step_y;
+  }
+  return;
+}
+
+// Textures are mapped exactly at the ends of spans of this many
+// pixels, and linearly inside of them
+#define _MICRO_DRAW_TEXTURE_SPAN 16
+
+static inline long long
+_micro_draw_texture_wrap(long long coordinate, int size, MicroDrawWrap wrap)
+{
+  if (wrap == MICRO_DRAW_WRAP_CLAMP)
+    return _micro_draw_min(_micro_draw_max(coordinate, 0), size - 1);
+  coordinate %= size;
+  return (coordinate < 0) ? coordinate + size : coordinate;
+}
+
+// Sample [texture] at the fixed point coordinates [u, v] in pixels,
+// in RGBA8
+static inline void
+_micro_draw_texture_sample(MicroDrawSurface *texture, long long u, long long v,
+                           MicroDrawFilter filter, MicroDrawWrap wrap,
+                           unsigned char *color)
+{
+  int size = micro_draw_get_channels(texture->pixel)
+    * micro_draw_get_channel_size(texture->pixel);
+  if (filter == MICRO_DRAW_FILTER_NEAREST)
+  {
+    long long x = _micro_draw_texture_wrap(u >> _MICRO_DRAW_FIXED_FRACTION,
+                                           texture->width, wrap);
+    long long y = _micro_draw_texture_wrap(v >> _MICRO_DRAW_FIXED_FRACTION,
+                                           texture->height, wrap);
+    micro_draw_color_to_rgba8(texture->data + y * texture->stride + x * size,
+                              texture->pixel, color);
+    return;
+  }
+
+  // The four pixels around the sample, weighted by the distance from
+  // their centers in 1/256
+  u -= 1 << (_MICRO_DRAW_FIXED_FRACTION - 1);
+  v -= 1 << (_MICRO_DRAW_FIXED_FRACTION - 1);
+  int weight_x = (u >> (_MICRO_DRAW_FIXED_FRACTION - 8)) & 255;
+  int weight_y = (v >> (_MICRO_DRAW_FIXED_FRACTION - 8)) & 255;
+  long long x[2], y[2];
+  for (int i = 0; i < 2; ++i)
+  {
+    x[i] = _micro_draw_texture_wrap((u >> _MICRO_DRAW_FIXED_FRACTION) + i,
+                                    texture->width, wrap);
+    y[i] = _micro_draw_texture_wrap((v >> _MICRO_DRAW_FIXED_FRACTION) + i,
+                                    texture->height, wrap);
+  }
+  unsigned char texels[2][2][4];
+  for (int j = 0; j < 2; ++j)
+    for (int i = 0; i < 2; ++i)
+      micro_draw_color_to_rgba8(texture->data + y[j] * texture->stride + x[i] * size,
+                                texture->pixel, texels[j][i]);
+  for (int c = 0; c < 4; ++c)
+  {
+    int top = texels[0][0][c] * (256 - weight_x) + texels[0][1][c] * weight_x;
+    int bottom = texels[1][0][c] * (256 - weight_x) + texels[1][1][c] * weight_x;
+    color[c] = (top * (256 - weight_y) + bottom * weight_y + (1 << 15)) >> 16;
+  }
+  return;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that the colors in micro_draw_fill_triangle_textured are enough");
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_textured(unsigned char *data, int data_width, int data_height,
+                                  MicroDrawPixel pixel, MicroDrawVertex a,
+                                  MicroDrawVertex b, MicroDrawVertex c,
+                                  MicroDrawSurface *texture, MicroDrawFilter filter,
+                                  MicroDrawWrap wrap)
+{
+  if (texture->width <= 0 || texture->height <= 0) return;
+  if (a.w <= 0 || b.w <= 0 || c.w <= 0) return;
+  _MicroDrawTriangleSetup setup;
+  MicroDrawRect bounds;
+  if (!_micro_draw_triangle_setup(&setup, &bounds,
+                                  micro_draw_clip_rect(data_width, data_height),
+                                  a.x, a.y, b.x, b.y, c.x, c.y))
+    return;
+
+  // u / w, v / w and 1 / w are linear on the screen, u and v are not.
+  // They are sampled at the center of the pixels.
+  MicroDrawVertex *vertices[3] = { &a, &b, &c };
+  double attributes[3][3];
+  for (int i = 0; i < 3; ++i)
+  {
+    double q = 1.0 / vertices[i]->w;
+    attributes[0][i] = vertices[i]->u * texture->width * q;
+    attributes[1][i] = vertices[i]->v * texture->height * q;
+    attributes[2][i] = q;
+  }
+  double planes[3][3]; // value, step x, step y
+  for (int i = 0; i < 3; ++i)
+  {
+    double *values = attributes[i];
+    planes[i][1] = (setup.step_x[0] * values[0] + setup.step_x[1] * values[1]
+                    + setup.step_x[2] * values[2]) / setup.area;
+    planes[i][2] = (setup.step_y[0] * values[0] + setup.step_y[1] * values[1]
+                    + setup.step_y[2] * values[2]) / setup.area;
+    planes[i][0] = (setup.w[0] * values[0] + setup.w[1] * values[1]
+                    + setup.w[2] * values[2]) / setup.area
+      + (planes[i][1] + planes[i][2]) / 2;
+  }
+
+  double one = 1 << _MICRO_DRAW_FIXED_FRACTION;
+  unsigned char rgba[4], color[4];
+  for (int y = 0; y < bounds.h; ++y)
+  {
+    int w0 = setup.w[0], w1 = setup.w[1], w2 = setup.w[2];
+    double s = planes[0][0], t = planes[1][0], q = planes[2][0];
+    double u_start = s / q, v_start = t / q;
+    for (int x = 0; x < bounds.w; x += _MICRO_DRAW_TEXTURE_SPAN)
+    {
+      int span = _micro_draw_min(_MICRO_DRAW_TEXTURE_SPAN, bounds.w - x);
+      s += planes[0][1] * span;
+      t += planes[1][1] * span;
+      q += planes[2][1] * span;
+      double reciprocal = 1 / q;
+      double u_end = s * reciprocal, v_end = t * reciprocal;
+      long long u = _micro_draw_round(u_start * one);
+      long long v = _micro_draw_round(v_start * one);
+      long long u_step = _micro_draw_round((u_end - u_start) * one / span);
+      long long v_step = _micro_draw_round((v_end - v_start) * one / span);
+      for (int i = 0; i < span; ++i)
+      {
+        if ((w0 | w1 | w2) >= 0)
+        {
+          _micro_draw_texture_sample(texture, u, v, filter, wrap, rgba);
+          micro_draw_color_from_rgba8(rgba, color, pixel);
+          micro_draw_pixel(data, data_width, data_height,
+                           bounds.x + x + i, bounds.y + y, color, pixel);
+        }
+        w0 += setup.step_x[0];
+        w1 += setup.step_x[1];
+        w2 += setup.step_x[2];
+        u += u_step;
+        v += v_step;
+      }
+      u_start = u_end;
+      v_start = v_end;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      setup.w[i] += setup.step_y[i];
+      planes[i][0] += planes[i][2];
+    }
+  }
+  return;
+}
+  
+MICRO_DRAW_DEF void
+micro_draw_grid(unsigned char* data, int data_width, int data_height,
+                int columns, int rows, unsigned char* color, MicroDrawPixel pixel)
+{
+  // Draw columns
+  for (int x = 0; x < data_width; x += data_width / columns)
+  {
+    micro_draw_line(data, data_width, data_height,
+                     x, 0, x, data_height,
+                     color, pixel);
+  }
+  
+  // Draw rows
+  for (int y = 0; y < data_height; y += data_height / rows)
+  {
+    micro_draw_line(data, data_width, data_height,
+                     0, y, data_width, y,
+                     color, pixel);
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_get_color(unsigned char* data, int data_width, int data_height,
+                     int x, int y, unsigned char** color, MicroDrawPixel pixel)
+{
+  if (x >= data_width || x < 0 || y >= data_height || y < 0) return;
+
+  int channel_size = micro_draw_get_channel_size(pixel); // bytes
+  unsigned int channels = micro_draw_get_channels(pixel);
+  int index = (y * data_width + x) * channels * channel_size;
+
+  *color = data + index;
+  return;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that color_dest in micro_draw_scaled is enough");
+typedef struct {
+  unsigned char *src_data;
+  int src_data_width;
+  int src_data_height;
+  MicroDrawPixel src_pixel;
+  unsigned char *dest_data;
+  int dest_data_width;
+  int dest_data_height;
+  MicroDrawPixel dest_pixel;
+  MicroDrawRect clip;
+} _MicroDrawScaledJob;
+
+static void _micro_draw_scaled_rows(void *context, int begin, int end)
+{
+  _MicroDrawScaledJob *job = context;
+  unsigned char *src_data = job->src_data;
+  int src_data_width = job->src_data_width;
+  int src_data_height = job->src_data_height;
+  MicroDrawPixel src_pixel = job->src_pixel;
+  int dest_data_width = job->dest_data_width;
+  int dest_data_height = job->dest_data_height;
+  MicroDrawPixel dest_pixel = job->dest_pixel;
+  
+  for (int y = job->clip.y + begin; y < job->clip.y + end; ++y)
+  {
+    for (int x = job->clip.x; x < job->clip.x + job->clip.w; ++x)
+    {
+      int x_frame = (x * src_data_width) / (double)dest_data_width;
+      int y_frame = (y * src_data_height) / (double)dest_data_height;
+      unsigned char *color;
+      micro_draw_get_color(src_data, src_data_width, src_data_height,
+                           x_frame, y_frame, &color, src_pixel);
+
+      unsigned char color_dest[4] = {0}; // 4 is enough for now
+      micro_draw_color_convert(color, src_pixel, color_dest, dest_pixel);
+      micro_draw_pixel(job->dest_data, dest_data_width, dest_data_height,
+                       x, y, color_dest, dest_pixel);
+    }
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_scaled(unsigned char* src_data, int src_data_width, int src_data_height,
+                  MicroDrawPixel src_pixel, unsigned char* dest_data,
+                  int dest_data_width, int dest_data_height,
+                  MicroDrawPixel dest_pixel)
+{
+  _MicroDrawScaledJob job = {
+    src_data, src_data_width, src_data_height, src_pixel,
+    dest_data, dest_data_width, dest_data_height, dest_pixel,
+    micro_draw_clip_rect(dest_data_width, dest_data_height),
+  };
+  int row_size = job.clip.w * micro_draw_get_channels(dest_pixel)
+    * micro_draw_get_channel_size(dest_pixel);
+  MICRO_DRAW_PARALLEL_FOR(job.clip.h, _micro_draw_rows_grain(row_size),
+                          _micro_draw_scaled_rows, &job);
+  return;
+}
+
+static inline int _micro_draw_get_horizontal_characters(char* str)
+{
+  int max_num = 0;
+  int num = 0;
+  while (*str != '\0')
+  {
+    if (*str == '\n')
+    {
+      max_num = (num > max_num) ? num : max_num;
+      num = 0;
+    }
+    else if ((*str & 0xC0) != 0x80) // Skip UTF-8 continuation bytes
+    {
+      num++;
+    }
+    str++;
+  }
+  return (num > max_num) ? num : max_num;
+}
+
+static inline int _micro_draw_get_vertical_characters(char* str)
+{
+  int num = 1;
+  while (*str != '\0')
+  {
+    if (*str == '\n') num++;
+    str++;
+  }
+  return num;
+}
+
+static inline int _micro_draw_strlen(char* str)
+{
+  int len = 0;
+  while (str[len] != '\0') len++;
+  return len;
+}
+
+// Decode the UTF-8 sequence at the start of [str], setting [len] to
+// its size in bytes. Returns the codepoint, or -1 if the sequence is
+// invalid.
+static inline int
+_micro_draw_utf8_decode(const unsigned char *str, int size, int *len)
+{
+  static const unsigned char lead_mask[] = { 0x7F, 0x1F, 0x0F, 0x07 };
+  static const int min_codepoint[] = { 0, 0x80, 0x800, 0x10000 };
+  int count;
+  
+  *len = 1;
+  if (size <= 0)                return -1;
+  if (str[0] < 0x80)            count = 1;
+  else if ((str[0] >> 5) == 0x6) count = 2;
+  else if ((str[0] >> 4) == 0xE) count = 3;
+  else if ((str[0] >> 3) == 0x1E) count = 4;
+  else                          return -1;
+  
+  if (count > size) return -1;
+  int codepoint = str[0] & lead_mask[count - 1];
+  for (int i = 1; i < count; ++i)
+  {
+    if ((str[i] & 0xC0) != 0x80) return -1;
+    codepoint = (codepoint << 6) | (str[i] & 0x3F);
+  }
+  *len = count;
+  if (codepoint < min_codepoint[count - 1] || codepoint > 0x10FFFF)
+    return -1;
+  return codepoint;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that color_dest in _micro_draw_glyph is enough");
+// Draw a single glyph of the default font scaled to [char_x] x [char_y]
+// pixels with the top-left corner in [glyph_x], [glyph_y]
+static inline void
+_micro_draw_glyph_clipped(unsigned char* data, int data_width, int data_height,
+                          MicroDrawRect clip, MicroDrawPixel pixel_data, int glyph,
+                          int glyph_x, int glyph_y, int char_x, int char_y,
+                          unsigned char* text_color)
+{
+  int channel_size = micro_draw_get_channel_size(pixel_data); // bytes
+  unsigned int channels = micro_draw_get_channels(pixel_data);
+  if (glyph < 0 || glyph >= 128) glyph = 0;
+  int y_end = _micro_draw_min(char_y, clip.y + clip.h - glyph_y);
+  int x_end = _micro_draw_min(char_x, clip.x + clip.w - glyph_x);
+  
+  for (int y = _micro_draw_max(0, clip.y - glyph_y); y < y_end; ++y)
+  {
+    // Rescale the pixel
+    int font_y = (y * MICRO_DRAW_FONT_HEIGHT) / (double)char_y;
+    for (int x = _micro_draw_max(0, clip.x - glyph_x); x < x_end; ++x)
+    {
+      int font_x = (x * MICRO_DRAW_FONT_WIDTH) / (double)char_x;
+
+      // Calculate color
+      unsigned char color_dest[4] = {0};
+      for (unsigned int i = 0; i < channels * channel_size; ++i)
+        color_dest[i] = text_color[i] * micro_draw_font[glyph][font_y][font_x];
+
+      // Draw with translation
+      micro_draw_pixel(data, data_width, data_height,
+                       x + glyph_x, y + glyph_y, color_dest, pixel_data);
+    }
+  }
+  return;
+}
+
+static inline void
+_micro_draw_glyph(unsigned char* data, int data_width, int data_height,
+                  MicroDrawPixel pixel_data, int glyph, int glyph_x, int glyph_y,
+                  int char_x, int char_y, unsigned char* text_color)
+{
+  MicroDrawRect screen = micro_draw_clip_rect(data_width, data_height);
+  _micro_draw_glyph_clipped(data, data_width, data_height, screen, pixel_data,
+                            glyph, glyph_x, glyph_y, char_x, char_y, text_color);
+  return;
+}
+
+static inline void
+_micro_draw_text_clipped(unsigned char* data, int data_width, int data_height,
+                         MicroDrawRect clip, MicroDrawPixel pixel_data,
+                         char* text, int text_x, int text_y, float text_scale,
+                         unsigned char* text_color)
+{
+  int char_x = MICRO_DRAW_CHARACTER_PIXELS_X * text_scale;
+  int char_y = MICRO_DRAW_CHARACTER_PIXELS_Y * text_scale;
+  int text_row = 0;
+  int text_col = 0;
+  int text_len = _micro_draw_strlen(text);
+  int len;
+  
+  for (int c = 0; c < text_len; c += len)
+  {
+    int codepoint =
+      _micro_draw_utf8_decode((unsigned char*)text + c, text_len - c, &len);
+    if (codepoint == '\n')
+    {
+      text_row++;
+      text_col = 0;
+      continue;
+    }
+    _micro_draw_glyph_clipped(data, data_width, data_height, clip, pixel_data,
+                              codepoint,
+                              text_x + text_col * char_x,
+                              text_y + text_row * char_y,
+                              char_x, char_y, text_color);
+    text_col++;
+  }
+  return;
+}
+
+typedef struct {
+  unsigned char *data;
+  int width;
+  int height;
+  MicroDrawPixel pixel;
+  char *text;
+  int x;
+  int y;
+  float scale;
+  unsigned char *color;
+  MicroDrawRect clip;
+  int first_row;
+} _MicroDrawTextJob;
+
+static void _micro_draw_text_rows(void *context, int begin, int end)
+{
+  _MicroDrawTextJob *job = context;
+  MicroDrawRect band = {
+    .x = job->clip.x,
+    .y = job->first_row + begin,
+    .w = job->clip.w,
+    .h = end - begin,
+  };
+  _micro_draw_text_clipped(job->data, job->width, job->height, band, job->pixel,
+                           job->text, job->x, job->y, job->scale, job->color);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_text(unsigned char* data, int data_width, int data_height,
+                MicroDrawPixel pixel_data, char* text, int text_x,
+                int text_y, float text_scale, unsigned char* text_color)
+{
+  // Only the rows of the text
+  MicroDrawRect bounds = micro_draw_text_measure(text, text_x, text_y, text_scale);
+  MicroDrawRect clip = micro_draw_clip_rect(data_width, data_height);
+  int first_row = _micro_draw_max(bounds.y, clip.y);
+  int rows = _micro_draw_min(bounds.y + bounds.h, clip.y + clip.h) - first_row;
+  _MicroDrawTextJob job = {
+    data, data_width, data_height, pixel_data, text,
+    text_x, text_y, text_scale, text_color, clip, first_row,
+  };
+  int row_size = data_width * micro_draw_get_channels(pixel_data)
+    * micro_draw_get_channel_size(pixel_data);
+  if (rows > 0)
+    MICRO_DRAW_PARALLEL_FOR(rows, _micro_draw_rows_grain(row_size),
+                            _micro_draw_text_rows, &job);
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawRect
+micro_draw_text_measure(char* text, int text_x, int text_y, float text_scale)
+{
+  int char_x = MICRO_DRAW_CHARACTER_PIXELS_X * text_scale;
+  int char_y = MICRO_DRAW_CHARACTER_PIXELS_Y * text_scale;
+  MicroDrawRect rect = {
+    .x = text_x,
+    .y = text_y,
+    .w = _micro_draw_get_horizontal_characters(text) * char_x,
+    .h = _micro_draw_get_vertical_characters(text) * char_y,
+  };
+  return rect;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_text_layout(MicroDrawTextLayout *layout, char* text, float text_scale)
+{
+  int text_len = _micro_draw_strlen(text);
+  if (text_len > layout->glyphs_capacity)
+  {
+    MicroDrawGlyphPosition *glyphs =
+      MICRO_DRAW_REALLOC(layout->glyphs, text_len * sizeof(MicroDrawGlyphPosition));
+    if (glyphs == NULL)
+      return MICRO_DRAW_ERROR_ALLOCATION;
+    layout->glyphs = glyphs;
+    layout->glyphs_capacity = text_len;
+  }
+
+  layout->char_width = MICRO_DRAW_CHARACTER_PIXELS_X * text_scale;
+  layout->char_height = MICRO_DRAW_CHARACTER_PIXELS_Y * text_scale;
+  layout->glyphs_count = 0;
+  layout->lines = 1;
+  
+  int text_col = 0;
+  int max_cols = 0;
+  int len;
+  for (int c = 0; c < text_len; c += len)
+  {
+    int codepoint =
+      _micro_draw_utf8_decode((unsigned char*)text + c, text_len - c, &len);
+    if (codepoint == '\n')
+    {
+      layout->lines++;
+      text_col = 0;
+      continue;
+    }
+    MicroDrawGlyphPosition *glyph = &layout->glyphs[layout->glyphs_count++];
+    glyph->x = text_col * layout->char_width;
+    glyph->y = (layout->lines - 1) * layout->char_height;
+    glyph->glyph = codepoint;
+    text_col++;
+    max_cols = (text_col > max_cols) ? text_col : max_cols;
+  }
+
+  layout->width = max_cols * layout->char_width;
+  layout->height = layout->lines * layout->char_height;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_text_layout_draw(unsigned char* data, int data_width, int data_height,
+                            MicroDrawPixel pixel_data, MicroDrawTextLayout *layout,
+                            int text_x, int text_y, unsigned char* text_color)
+{
+  for (int g = 0; g < layout->glyphs_count; ++g)
+  {
+    MicroDrawGlyphPosition *glyph = &layout->glyphs[g];
+    _micro_draw_glyph(data, data_width, data_height, pixel_data,
+                      glyph->glyph, text_x + glyph->x, text_y + glyph->y,
+                      layout->char_width, layout->char_height, text_color);
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_text_layout_free(MicroDrawTextLayout *layout)
+{
+  MICRO_DRAW_FREE(layout->glyphs);
+  layout->glyphs = NULL;
+  layout->glyphs_count = 0;
+  layout->glyphs_capacity = 0;
+  return;
+}
+  
+// Draw the set pixels of a bitmap font glyph, clipped to the data
+static inline void
+_micro_draw_font_glyph(unsigned char* data, int data_width, MicroDrawRect clip,
+                       MicroDrawPixel pixel_data, MicroDrawFont *font,
+                       MicroDrawFontGlyph *glyph, int pen_x, int pen_y,
+                       unsigned char* color)
+{
+  int pixel_size = micro_draw_get_channels(pixel_data)
+    * micro_draw_get_channel_size(pixel_data); // bytes
+  int stride = (glyph->width + 7) / 8;
+  int glyph_x = pen_x + glyph->x;
+  int glyph_y = pen_y + glyph->y;
+
+  // Clip once, so that the inner loop has no bound checks
+  int row_start = _micro_draw_max(0, clip.y - glyph_y);
+  int row_end = _micro_draw_min(glyph->height, clip.y + clip.h - glyph_y);
+  int col_start = _micro_draw_max(0, clip.x - glyph_x);
+  int col_end = _micro_draw_min(glyph->width, clip.x + clip.w - glyph_x);
+
+  for (int row = row_start; row < row_end; ++row)
+  {
+    unsigned char *bits = font->atlas + glyph->offset + row * stride;
+    unsigned char *dest = data
+      + ((glyph_y + row) * data_width + glyph_x) * pixel_size;
+    for (int col = col_start; col < col_end; ++col)
+    {
+      if (bits[col >> 3] & (0x80 >> (col & 7)))
+        _micro_draw_memcpy(dest + col * pixel_size, color, pixel_size);
+    }
+  }
+  return;
+}
+
+// Binary search of the range containing [codepoint], NULL if missing
+static inline MicroDrawFontRange *
+_micro_draw_font_range(MicroDrawFont *font, int codepoint)
+{
+  int low = 0;
+  int high = font->ranges_count - 1;
+  while (low <= high)
+  {
+    int mid = low + (high - low) / 2;
+    MicroDrawFontRange *range = &font->ranges[mid];
+    if (codepoint < range->codepoint)
+      high = mid - 1;
+    else if (codepoint >= range->codepoint + range->count)
+      low = mid + 1;
+    else
+      return range;
+  }
+  return NULL;
+}
+
+MICRO_DRAW_DEF int
+micro_draw_font_glyph(MicroDrawFont *font, int codepoint)
+{
+  MicroDrawFontRange *range = _micro_draw_font_range(font, codepoint);
+  if (range == NULL) return 0;
+  return range->glyph + codepoint - range->codepoint;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_text_font(unsigned char* data, int data_width, int data_height,
+                     MicroDrawPixel pixel_data, MicroDrawFont *font, char* text,
+                     int text_x, int text_y, unsigned char* text_color)
+{
+  MicroDrawRect clip = micro_draw_clip_rect(data_width, data_height);
+  int pen_x = text_x;
+  int pen_y = text_y;
+  int text_len = _micro_draw_strlen(text);
+  // Text is mostly made of runs from the same range, check the last
+  // one before searching
+  MicroDrawFontRange *range = NULL;
+  int len;
+  
+  for (int c = 0; c < text_len; c += len)
+  {
+    int codepoint =
+      _micro_draw_utf8_decode((unsigned char*)text + c, text_len - c, &len);
+    if (codepoint == '\n')
+    {
+      pen_x = text_x;
+      pen_y += font->line_height;
+      continue;
+    }
+    if (range == NULL || codepoint < range->codepoint
+        || codepoint >= range->codepoint + range->count)
+      range = _micro_draw_font_range(font, codepoint);
+    int glyph_id = (range != NULL) ? range->glyph + codepoint - range->codepoint : 0;
+    MicroDrawFontGlyph *glyph = &font->glyphs[glyph_id];
+    _micro_draw_font_glyph(data, data_width, clip, pixel_data,
+                           font, glyph, pen_x, pen_y, text_color);
+    pen_x += glyph->advance;
+  }
+  return;
+}
+
+// A glyph to draw in micro_draw_text_batch
+typedef struct {
+  int x;
+  int y;
+  int glyph;
+  int item;
+} _MicroDrawGlyphBlit;
+
+// Draw a glyph of the default font from its scaled [mask] of
+// [char_x] x [char_y] pixels. Like _micro_draw_glyph, the unset pixels
+// are drawn with a zero color.
+static inline void
+_micro_draw_glyph_mask(unsigned char* data, int data_width, MicroDrawRect clip,
+                       int pixel_size, unsigned char *mask, int glyph_x,
+                       int glyph_y, int char_x, int char_y,
+                       unsigned char* color)
+{
+  int row_start = _micro_draw_max(0, clip.y - glyph_y);
+  int row_end = _micro_draw_min(char_y, clip.y + clip.h - glyph_y);
+  int col_start = _micro_draw_max(0, clip.x - glyph_x);
+  int col_end = _micro_draw_min(char_x, clip.x + clip.w - glyph_x);
+
+  for (int row = row_start; row < row_end; ++row)
+  {
+    unsigned char *bits = mask + row * char_x;
+    unsigned char *dest = data
+      + ((glyph_y + row) * data_width + glyph_x) * pixel_size;
+    for (int col = col_start; col < col_end; ++col)
+      for (int i = 0; i < pixel_size; ++i)
+        dest[col * pixel_size + i] = color[i] * bits[col];
+  }
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_text_batch(unsigned char* data, int data_width, int data_height,
+                      MicroDrawPixel pixel_data, MicroDrawFont *font,
+                      float text_scale, MicroDrawTextItem *items,
+                      int items_count)
+{
+  MicroDrawError error = MICRO_DRAW_OK;
+  int pixel_size = micro_draw_get_channels(pixel_data)
+    * micro_draw_get_channel_size(pixel_data); // bytes
+  int char_x = MICRO_DRAW_CHARACTER_PIXELS_X * text_scale;
+  int char_y = MICRO_DRAW_CHARACTER_PIXELS_Y * text_scale;
+  int line_height = (font != NULL) ? font->line_height : char_y;
+  _MicroDrawGlyphBlit *blits = NULL;
+  _MicroDrawGlyphBlit *sorted = NULL;
+  int *rows = NULL;
+  unsigned char *masks = NULL;
+  int mask_index[128];
+  int masks_count = 0;
+  int blits_count = 0;
+  MicroDrawRect clip = micro_draw_clip_rect(data_width, data_height);
+  
+  if (clip.w <= 0 || clip.h <= 0) return MICRO_DRAW_OK;
+  for (int i = 0; i < 128; ++i)
+    mask_index[i] = -1;
+
+  // There is at most one glyph per byte
+  int bytes = 0;
+  for (int i = 0; i < items_count; ++i)
+    bytes += _micro_draw_strlen(items[i].text);
+  blits = MICRO_DRAW_MALLOC((bytes > 0 ? bytes : 1) * sizeof(_MicroDrawGlyphBlit));
+  sorted = MICRO_DRAW_MALLOC((bytes > 0 ? bytes : 1) * sizeof(_MicroDrawGlyphBlit));
+  rows = MICRO_DRAW_MALLOC((data_height + 1) * sizeof(int));
+  if (blits == NULL || sorted == NULL || rows == NULL)
+  {
+    error = MICRO_DRAW_ERROR_ALLOCATION;
+    goto done;
+  }
+
+  // Lay out the glyphs, dropping the ones outside of the data
+  MicroDrawFontRange *range = NULL;
+  for (int i = 0; i < items_count; ++i)
+  {
+    char *text = items[i].text;
+    int text_len = _micro_draw_strlen(text);
+    int pen_x = items[i].x;
+    int pen_y = items[i].y;
+    int len;
+    for (int c = 0; c < text_len; c += len)
+    {
+      int codepoint =
+        _micro_draw_utf8_decode((unsigned char*)text + c, text_len - c, &len);
+      if (codepoint == '\n')
+      {
+        pen_x = items[i].x;
+        pen_y += line_height;
+        continue;
+      }
+
+      _MicroDrawGlyphBlit blit = { .x = pen_x, .y = pen_y, .item = i };
+      int w, h;
+      if (font != NULL)
+      {
+        if (range == NULL || codepoint < range->codepoint
+            || codepoint >= range->codepoint + range->count)
+          range = _micro_draw_font_range(font, codepoint);
+        blit.glyph = (range != NULL) ? range->glyph + codepoint - range->codepoint : 0;
+        MicroDrawFontGlyph *glyph = &font->glyphs[blit.glyph];
+        pen_x += glyph->advance;
+        blit.x += glyph->x;
+        blit.y += glyph->y;
+        w = glyph->width;
+        h = glyph->height;
+      }
+      else
+      {
+        blit.glyph = (codepoint >= 0 && codepoint < 128) ? codepoint : 0;
+        pen_x += char_x;
+        w = char_x;
+        h = char_y;
+      }
+      
+      if (blit.x >= clip.x + clip.w || blit.y >= clip.y + clip.h
+          || blit.x + w <= clip.x || blit.y + h <= clip.y || w <= 0 || h <= 0)
+        continue;
+      if (font == NULL && mask_index[blit.glyph] < 0)
+        mask_index[blit.glyph] = masks_count++;
+      blits[blits_count++] = blit;
+    }
+  }
+
+  // Scale each glyph of the default font used only once
+  if (font == NULL && masks_count > 0)
+  {
+    masks = MICRO_DRAW_MALLOC(masks_count * char_x * char_y);
+    if (masks == NULL)
+    {
+      error = MICRO_DRAW_ERROR_ALLOCATION;
+      goto done;
+    }
+    for (int glyph = 0; glyph < 128; ++glyph)
+    {
+      if (mask_index[glyph] < 0) continue;
+      unsigned char *mask = masks + mask_index[glyph] * char_x * char_y;
+      for (int y = 0; y < char_y; ++y)
+      {
+        int font_y = (y * MICRO_DRAW_FONT_HEIGHT) / (double)char_y;
+        for (int x = 0; x < char_x; ++x)
+        {
+          int font_x = (x * MICRO_DRAW_FONT_WIDTH) / (double)char_x;
+          mask[y * char_x + x] = micro_draw_font[glyph][font_y][font_x];
+        }
+      }
+    }
+  }
+
+  // Counting sort by first visible row, stable to keep the order of
+  // the strings on the same row
+  for (int row = 0; row <= data_height; ++row)
+    rows[row] = 0;
+  for (int b = 0; b < blits_count; ++b)
+    rows[_micro_draw_max(blits[b].y, 0) + 1]++;
+  for (int row = 0; row < data_height; ++row)
+    rows[row + 1] += rows[row];
+  for (int b = 0; b < blits_count; ++b)
+    sorted[rows[_micro_draw_max(blits[b].y, 0)]++] = blits[b];
+
+  for (int b = 0; b < blits_count; ++b)
+  {
+    _MicroDrawGlyphBlit *blit = &sorted[b];
+    if (font != NULL)
+    {
+      MicroDrawFontGlyph *glyph = &font->glyphs[blit->glyph];
+      _micro_draw_font_glyph(data, data_width, clip, pixel_data, font,
+                             glyph, blit->x - glyph->x, blit->y - glyph->y,
+                             items[blit->item].color);
+    }
+    else
+    {
+      _micro_draw_glyph_mask(data, data_width, clip, pixel_size,
+                             masks + mask_index[blit->glyph] * char_x * char_y,
+                             blit->x, blit->y, char_x, char_y,
+                             items[blit->item].color);
+    }
+  }
+
+ done:
+  MICRO_DRAW_FREE(masks);
+  MICRO_DRAW_FREE(rows);
+  MICRO_DRAW_FREE(sorted);
+  MICRO_DRAW_FREE(blits);
+  return error;
+}
+
+// Every command starts with a header followed by its arguments, and
+// by the string of text commands. Commands are 8 bytes aligned.
+typedef struct {
+  MicroDrawCommandType type;
+  int size; // bytes, header included
+  MicroDrawRect bounds;
+} _MicroDrawCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  int a_x, a_y, b_x, b_y;
+  unsigned char color[4]; // RGBA8
+} _MicroDrawLineCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  int x, y, w, h;
+  unsigned char color[4]; // RGBA8
+} _MicroDrawRectCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  int center_x, center_y, radius;
+  unsigned char color[4]; // RGBA8
+} _MicroDrawCircleCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  int a_x, a_y, b_x, b_y, c_x, c_y;
+  unsigned char color[4]; // RGBA8
+} _MicroDrawTriangleCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  int x, y;
+  float scale;
+  unsigned char color[4]; // RGBA8
+} _MicroDrawTextCommand;
+
+typedef struct {
+  _MicroDrawCommand command;
+  unsigned char *data;
+  int width, height;
+  MicroDrawPixel pixel;
+  int x, y;
+} _MicroDrawOverlapCommand;
+
+// Append a command of [size] bytes to [list]. Returns NULL if the
+// list cannot grow.
+static inline void *
+_micro_draw_command_push(MicroDrawCommandList *list, MicroDrawCommandType type,
+                         size_t size, MicroDrawRect bounds)
+{
+  size = (size + 7) & ~(size_t)7;
+  if (list->size + size > list->capacity)
+  {
+    size_t capacity = _micro_draw_max(list->capacity * 2, 4096);
+    capacity = _micro_draw_max(capacity, list->size + size);
+    unsigned char *bytes = MICRO_DRAW_REALLOC(list->bytes, capacity);
+    if (bytes == NULL) return NULL;
+    list->bytes = bytes;
+    list->capacity = capacity;
+  }
+  _MicroDrawCommand *command = (_MicroDrawCommand*)(list->bytes + list->size);
+  command->type = type;
+  command->size = size;
+  command->bounds = bounds;
+  list->size += size;
+  list->count++;
+  return command;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_line(MicroDrawCommandList *list, int a_x, int a_y,
+                       int b_x, int b_y, unsigned char* color, MicroDrawPixel pixel)
+{
+  MicroDrawRect bounds = {
+    .x = _micro_draw_min(a_x, b_x),
+    .y = _micro_draw_min(a_y, b_y),
+    .w = MICRO_DRAW_ABS(a_x - b_x) + 1,
+    .h = MICRO_DRAW_ABS(a_y - b_y) + 1,
+  };
+  _MicroDrawLineCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_LINE,
+                             sizeof(_MicroDrawLineCommand), bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->a_x = a_x;
+  command->a_y = a_y;
+  command->b_x = b_x;
+  command->b_y = b_y;
+  micro_draw_color_to_rgba8(color, pixel, command->color);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_rect(MicroDrawCommandList *list, int x, int y, int w, int h,
+                            unsigned char *color, MicroDrawPixel pixel)
+{
+  MicroDrawRect bounds = { .x = x, .y = y, .w = w, .h = h };
+  _MicroDrawRectCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_RECT,
+                             sizeof(_MicroDrawRectCommand), bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->x = x;
+  command->y = y;
+  command->w = w;
+  command->h = h;
+  micro_draw_color_to_rgba8(color, pixel, command->color);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_circle(MicroDrawCommandList *list, int center_x,
+                              int center_y, int radius,
+                              unsigned char *color, MicroDrawPixel pixel)
+{
+  MicroDrawRect bounds = {
+    .x = center_x - radius,
+    .y = center_y - radius,
+    .w = radius * 2,
+    .h = radius * 2,
+  };
+  _MicroDrawCircleCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_CIRCLE,
+                             sizeof(_MicroDrawCircleCommand), bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->center_x = center_x;
+  command->center_y = center_y;
+  command->radius = radius;
+  micro_draw_color_to_rgba8(color, pixel, command->color);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_fill_triangle(MicroDrawCommandList *list, int a_x, int a_y,
+                                int b_x, int b_y, int c_x, int c_y,
+                                unsigned char *color, MicroDrawPixel pixel)
+{
+  MicroDrawRect bounds = {
+    .x = _micro_draw_min3(a_x, b_x, c_x),
+    .y = _micro_draw_min3(a_y, b_y, c_y),
+  };
+  bounds.w = _micro_draw_max3(a_x, b_x, c_x) - bounds.x + 1;
+  bounds.h = _micro_draw_max3(a_y, b_y, c_y) - bounds.y + 1;
+  _MicroDrawTriangleCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_TRIANGLE,
+                             sizeof(_MicroDrawTriangleCommand), bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->a_x = a_x;
+  command->a_y = a_y;
+  command->b_x = b_x;
+  command->b_y = b_y;
+  command->c_x = c_x;
+  command->c_y = c_y;
+  micro_draw_color_to_rgba8(color, pixel, command->color);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_text(MicroDrawCommandList *list, char* text, int text_x,
+                       int text_y, float text_scale, unsigned char* text_color,
+                       MicroDrawPixel pixel)
+{
+  int text_len = _micro_draw_strlen(text);
+  MicroDrawRect bounds = micro_draw_text_measure(text, text_x, text_y, text_scale);
+  _MicroDrawTextCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_TEXT,
+                             sizeof(_MicroDrawTextCommand) + text_len + 1, bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->x = text_x;
+  command->y = text_y;
+  command->scale = text_scale;
+  micro_draw_color_to_rgba8(text_color, pixel, command->color);
+  _micro_draw_memcpy(command + 1, text, text_len + 1);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_record_overlap(MicroDrawCommandList *list, unsigned char* src_data,
+                          int src_data_width, int src_data_height,
+                          MicroDrawPixel src_pixel, int x_offset, int y_offset)
+{
+  MicroDrawRect bounds = {
+    .x = x_offset,
+    .y = y_offset,
+    .w = src_data_width,
+    .h = src_data_height,
+  };
+  _MicroDrawOverlapCommand *command =
+    _micro_draw_command_push(list, MICRO_DRAW_COMMAND_OVERLAP,
+                             sizeof(_MicroDrawOverlapCommand), bounds);
+  if (command == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  command->data = src_data;
+  command->width = src_data_width;
+  command->height = src_data_height;
+  command->pixel = src_pixel;
+  command->x = x_offset;
+  command->y = y_offset;
+  return MICRO_DRAW_OK;
+}
+
+static inline int _micro_draw_rect_overlaps(MicroDrawRect a, MicroDrawRect b)
+{
+  return a.x < b.x + b.w && b.x < a.x + a.w
+    && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// The primitives draw rows [width] pixels apart
+static inline int _micro_draw_surface_is_packed(MicroDrawSurface *surface)
+{
+  int size = micro_draw_get_channels(surface->pixel)
+    * micro_draw_get_channel_size(surface->pixel);
+  return surface->stride == surface->width * size;
+}
+
+_Static_assert(_MICRO_DRAW_COMMAND_MAX == 6,
+               "Updated MicroDrawCommandType, should also update _micro_draw_execute_command");
+// Execute [command] only inside [clip]
+static inline void
+_micro_draw_execute_command(_MicroDrawCommand *command, MicroDrawSurface *surface,
+                            MicroDrawRect clip)
+{
+  unsigned char *data = surface->data;
+  int width = surface->width;
+  int height = surface->height;
+  MicroDrawPixel pixel = surface->pixel;
+  unsigned char color[4] = {0};
+  
+  switch(command->type)
+  {
+  case MICRO_DRAW_COMMAND_LINE:
+  {
+    _MicroDrawLineCommand *line = (_MicroDrawLineCommand*)command;
+    micro_draw_color_from_rgba8(line->color, color, pixel);
+    _micro_draw_line_clipped(data, width, height, clip, line->a_x, line->a_y,
+                             line->b_x, line->b_y, color, pixel);
+    break;
+  }
+  case MICRO_DRAW_COMMAND_RECT:
+  {
+    _MicroDrawRectCommand *rect = (_MicroDrawRectCommand*)command;
+    micro_draw_color_from_rgba8(rect->color, color, pixel);
+    _micro_draw_fill_rect_clipped(data, width, height, clip, rect->x, rect->y,
+                                  rect->w, rect->h, color, pixel);
+    break;
+  }
+  case MICRO_DRAW_COMMAND_CIRCLE:
+  {
+    _MicroDrawCircleCommand *circle = (_MicroDrawCircleCommand*)command;
+    micro_draw_color_from_rgba8(circle->color, color, pixel);
+    _micro_draw_fill_circle_clipped(data, width, height, clip, circle->center_x,
+                                    circle->center_y, circle->radius, color, pixel);
+    break;
+  }
+  case MICRO_DRAW_COMMAND_TRIANGLE:
+  {
+    _MicroDrawTriangleCommand *triangle = (_MicroDrawTriangleCommand*)command;
+    micro_draw_color_from_rgba8(triangle->color, color, pixel);
+    _micro_draw_fill_triangle_clipped(data, width, height, clip,
+                                      triangle->a_x, triangle->a_y,
+                                      triangle->b_x, triangle->b_y,
+                                      triangle->c_x, triangle->c_y, color, pixel);
+    break;
+  }
+  case MICRO_DRAW_COMMAND_TEXT:
+  {
+    _MicroDrawTextCommand *text = (_MicroDrawTextCommand*)command;
+    micro_draw_color_from_rgba8(text->color, color, pixel);
+    _micro_draw_text_clipped(data, width, height, clip, pixel, (char*)(text + 1),
+                             text->x, text->y, text->scale, color);
+    break;
+  }
+  case MICRO_DRAW_COMMAND_OVERLAP:
+  {
+    _MicroDrawOverlapCommand *overlap = (_MicroDrawOverlapCommand*)command;
+    _micro_draw_overlap_clipped(overlap->data, overlap->width, overlap->height,
+                                overlap->pixel, data, width, height, pixel,
+                                clip, overlap->x, overlap->y);
+    break;
+  }
+  default:
+    break;
+  }
+  return;
+}
+
+static inline MicroDrawRect
+_micro_draw_tile_rect(MicroDrawSurface *surface, int tile_x, int tile_y)
+{
+  MicroDrawRect tile = {
+    .x = tile_x * MICRO_DRAW_TILE_SIZE,
+    .y = tile_y * MICRO_DRAW_TILE_SIZE,
+  };
+  tile.w = _micro_draw_min(MICRO_DRAW_TILE_SIZE, surface->width - tile.x);
+  tile.h = _micro_draw_min(MICRO_DRAW_TILE_SIZE, surface->height - tile.y);
+  return tile;
+}
+
+// Write the cleared tile at [tile_x, tile_y] if pending, unless
+// [command] is going to write all of it inside [clip]
+static inline void
+_micro_draw_lazy_clear_tile(MicroDrawSurface *surface, int tile_x, int tile_y,
+                            _MicroDrawCommand *command, MicroDrawRect clip)
+{
+  MicroDrawLazyClear *clear = surface->lazy_clear;
+  unsigned char *pending = &clear->tiles[tile_y * clear->columns + tile_x];
+  if (!*pending) return;
+  *pending = 0;
+  
+  MicroDrawRect tile = _micro_draw_tile_rect(surface, tile_x, tile_y);
+  if (command != NULL && command->type == MICRO_DRAW_COMMAND_RECT)
+  {
+    _MicroDrawRectCommand *rect = (_MicroDrawRectCommand*)command;
+    MicroDrawRect drawn = _micro_draw_rect_intersect(
+      (MicroDrawRect) { rect->x, rect->y, rect->w, rect->h }, clip);
+    if (drawn.x <= tile.x && drawn.y <= tile.y
+        && drawn.x + drawn.w >= tile.x + tile.w
+        && drawn.y + drawn.h >= tile.y + tile.h)
+      return;
+  }
+  _micro_draw_fill_rect_clipped(surface->data, surface->width, surface->height,
+                                tile, tile.x, tile.y, tile.w, tile.h,
+                                clear->color, surface->pixel);
+  return;
+}
+
+// Write the pending tiles under [rect], before [command] draws in [clip]
+static inline void
+_micro_draw_lazy_clear_rect(MicroDrawSurface *surface, MicroDrawRect rect,
+                            _MicroDrawCommand *command, MicroDrawRect clip)
+{
+  int x_start = _micro_draw_max(rect.x, 0);
+  int y_start = _micro_draw_max(rect.y, 0);
+  int x_end = _micro_draw_min(rect.x + rect.w, surface->width);
+  int y_end = _micro_draw_min(rect.y + rect.h, surface->height);
+  if (x_start >= x_end || y_start >= y_end) return;
+  
+  for (int tile_y = y_start / MICRO_DRAW_TILE_SIZE;
+       tile_y <= (y_end - 1) / MICRO_DRAW_TILE_SIZE; ++tile_y)
+    for (int tile_x = x_start / MICRO_DRAW_TILE_SIZE;
+         tile_x <= (x_end - 1) / MICRO_DRAW_TILE_SIZE; ++tile_x)
+      _micro_draw_lazy_clear_tile(surface, tile_x, tile_y, command, clip);
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_execute(MicroDrawCommandList *list, MicroDrawSurface *surface)
+{
+  if (!_micro_draw_surface_is_packed(surface))
+    return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  
+  MicroDrawRect screen = micro_draw_clip_rect(surface->width, surface->height);
+  size_t offset = 0;
+  while (offset < list->size)
+  {
+    _MicroDrawCommand *command = (_MicroDrawCommand*)(list->bytes + offset);
+    offset += command->size;
+    if (!_micro_draw_rect_overlaps(command->bounds, screen)) continue;
+    MicroDrawRect drawn = _micro_draw_rect_intersect(command->bounds, screen);
+    if (surface->lazy_clear != NULL)
+      _micro_draw_lazy_clear_rect(surface, drawn, command, screen);
+    _micro_draw_execute_command(command, surface, screen);
+    if (surface->damage != NULL)
+      micro_draw_damage_add(surface->damage, drawn);
+  }
+  return MICRO_DRAW_OK;
+}
+
+// Commands binned in the tiles they overlap. The commands of tile
+// [i] are the offsets commands[starts[i]] to commands[starts[i + 1]],
+// in the order they were recorded.
+typedef struct {
+  MicroDrawCommandList *list;
+  MicroDrawSurface *surface;
+  MicroDrawRect screen;
+  int columns;
+  int rows;
+  int *starts;
+  size_t *commands;
+} _MicroDrawTiles;
+
+static void _micro_draw_tiles_draw(void *context, int begin, int end)
+{
+  _MicroDrawTiles *tiles = context;
+  for (int tile = begin; tile < end; ++tile)
+  {
+    int tile_x = tile % tiles->columns;
+    int tile_y = tile / tiles->columns;
+    MicroDrawRect clip = _micro_draw_rect_intersect(
+      _micro_draw_tile_rect(tiles->surface, tile_x, tile_y), tiles->screen);
+    if (clip.w == 0 || clip.h == 0) continue;
+    // Only the first command can cover the cleared tile
+    if (tiles->surface->lazy_clear != NULL && tiles->starts[tile] < tiles->starts[tile + 1])
+      _micro_draw_lazy_clear_tile(tiles->surface, tile_x, tile_y,
+                                  (_MicroDrawCommand*)(tiles->list->bytes
+                                    + tiles->commands[tiles->starts[tile]]),
+                                  clip);
+    for (int i = tiles->starts[tile]; i < tiles->starts[tile + 1]; ++i)
+    {
+      _MicroDrawCommand *command =
+        (_MicroDrawCommand*)(tiles->list->bytes + tiles->commands[i]);
+      _micro_draw_execute_command(command, tiles->surface, clip);
+    }
+  }
+  return;
+}
+
+// Visit the tiles overlapped by the bounds of [command]
+#define _micro_draw_for_tiles(command, tiles, tile_x, tile_y)             \
+  for (int tile_y = _micro_draw_max((command)->bounds.y, 0) / MICRO_DRAW_TILE_SIZE; \
+       tile_y <= _micro_draw_min((command)->bounds.y + (command)->bounds.h - 1, \
+                                 (tiles)->surface->height - 1) / MICRO_DRAW_TILE_SIZE; \
+       ++tile_y)                                                          \
+    for (int tile_x = _micro_draw_max((command)->bounds.x, 0) / MICRO_DRAW_TILE_SIZE; \
+         tile_x <= _micro_draw_min((command)->bounds.x + (command)->bounds.w - 1, \
+                                   (tiles)->surface->width - 1) / MICRO_DRAW_TILE_SIZE; \
+         ++tile_x)
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_execute_tiled(MicroDrawCommandList *list, MicroDrawSurface *surface)
+{
+  if (!_micro_draw_surface_is_packed(surface))
+    return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  
+  MicroDrawRect screen = micro_draw_clip_rect(surface->width, surface->height);
+  _MicroDrawTiles tiles = {
+    .list = list,
+    .surface = surface,
+    .screen = screen,
+    .columns = (surface->width + MICRO_DRAW_TILE_SIZE - 1) / MICRO_DRAW_TILE_SIZE,
+    .rows = (surface->height + MICRO_DRAW_TILE_SIZE - 1) / MICRO_DRAW_TILE_SIZE,
+  };
+  int tiles_count = tiles.columns * tiles.rows;
+  if (tiles_count == 0) return MICRO_DRAW_OK;
+  
+  // Count the commands of every tile, then place them after the
+  // prefix sum of the counts
+  tiles.starts = MICRO_DRAW_MALLOC((tiles_count + 1) * sizeof(int));
+  if (tiles.starts == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  for (int i = 0; i <= tiles_count; ++i) tiles.starts[i] = 0;
+  
+  for (size_t offset = 0; offset < list->size; )
+  {
+    _MicroDrawCommand *command = (_MicroDrawCommand*)(list->bytes + offset);
+    offset += command->size;
+    if (!_micro_draw_rect_overlaps(command->bounds, screen)) continue;
+    if (surface->damage != NULL)
+      micro_draw_damage_add(surface->damage,
+                            _micro_draw_rect_intersect(command->bounds, screen));
+    _micro_draw_for_tiles(command, &tiles, tile_x, tile_y)
+      tiles.starts[tile_y * tiles.columns + tile_x + 1]++;
+  }
+  int binned = 0;
+  for (int i = 0; i <= tiles_count; ++i)
+  {
+    binned += tiles.starts[i];
+    tiles.starts[i] = binned;
+  }
+  
+  tiles.commands = MICRO_DRAW_MALLOC(_micro_draw_max(binned, 1) * sizeof(size_t));
+  if (tiles.commands == NULL)
+  {
+    MICRO_DRAW_FREE(tiles.starts);
+    return MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  for (size_t offset = 0; offset < list->size; )
+  {
+    _MicroDrawCommand *command = (_MicroDrawCommand*)(list->bytes + offset);
+    if (_micro_draw_rect_overlaps(command->bounds, screen))
+    {
+      // starts[i] is used as the insertion point of tile i - 1
+      _micro_draw_for_tiles(command, &tiles, tile_x, tile_y)
+        tiles.commands[tiles.starts[tile_y * tiles.columns + tile_x]++] = offset;
+    }
+    offset += command->size;
+  }
+  for (int i = tiles_count; i > 0; --i)
+    tiles.starts[i] = tiles.starts[i - 1];
+  tiles.starts[0] = 0;
+
+  MICRO_DRAW_PARALLEL_FOR(tiles_count, 1, _micro_draw_tiles_draw, &tiles);
+  
+  MICRO_DRAW_FREE(tiles.commands);
+  MICRO_DRAW_FREE(tiles.starts);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_command_list_clear(MicroDrawCommandList *list)
+{
+  list->size = 0;
+  list->count = 0;
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_command_list_free(MicroDrawCommandList *list)
+{
+  MICRO_DRAW_FREE(list->bytes);
+  list->bytes = NULL;
+  list->size = 0;
+  list->capacity = 0;
+  list->count = 0;
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_damage_init(MicroDrawDamage *damage, int width, int height)
+{
+  *damage = (MicroDrawDamage) {
+    .width = width,
+    .height = height,
+    .columns = (width + MICRO_DRAW_DAMAGE_TILE_SIZE - 1) / MICRO_DRAW_DAMAGE_TILE_SIZE,
+    .rows = (height + MICRO_DRAW_DAMAGE_TILE_SIZE - 1) / MICRO_DRAW_DAMAGE_TILE_SIZE,
+  };
+  if (width <= 0 || height <= 0) return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  
+  damage->tiles = MICRO_DRAW_MALLOC(damage->columns * damage->rows);
+  if (damage->tiles == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  for (int i = 0; i < damage->columns * damage->rows; ++i)
+    damage->tiles[i] = 0;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_damage_add(MicroDrawDamage *damage, MicroDrawRect rect)
+{
+  int x_start = _micro_draw_max(rect.x, 0);
+  int y_start = _micro_draw_max(rect.y, 0);
+  int x_end = _micro_draw_min(rect.x + rect.w, damage->width);
+  int y_end = _micro_draw_min(rect.y + rect.h, damage->height);
+  if (x_start >= x_end || y_start >= y_end) return;
+
+  for (int row = y_start / MICRO_DRAW_DAMAGE_TILE_SIZE;
+       row <= (y_end - 1) / MICRO_DRAW_DAMAGE_TILE_SIZE; ++row)
+  {
+    unsigned char *tiles = damage->tiles + row * damage->columns;
+    for (int column = x_start / MICRO_DRAW_DAMAGE_TILE_SIZE;
+         column <= (x_end - 1) / MICRO_DRAW_DAMAGE_TILE_SIZE; ++column)
+    {
+      damage->count += !tiles[column];
+      tiles[column] = 1;
+    }
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_damage_clear(MicroDrawDamage *damage)
+{
+  if (damage->count == 0) return;
+  for (int i = 0; i < damage->columns * damage->rows; ++i)
+    damage->tiles[i] = 0;
+  damage->count = 0;
+  return;
+}
+
+MICRO_DRAW_DEF int
+micro_draw_damage_rects(MicroDrawDamage *damage, MicroDrawRect *rects, int max)
+{
+  int count = 0;
+  for (int row = 0; row < damage->rows && damage->count > 0; ++row)
+  {
+    int current_row = count; // First rectangle of this row
+    unsigned char *tiles = damage->tiles + row * damage->columns;
+    for (int column = 0; column < damage->columns; )
+    {
+      if (!tiles[column])
+      {
+        column++;
+        continue;
+      }
+      int run = column;
+      while (column < damage->columns && tiles[column]) column++;
+      
+      MicroDrawRect rect = {
+        .x = run * MICRO_DRAW_DAMAGE_TILE_SIZE,
+        .y = row * MICRO_DRAW_DAMAGE_TILE_SIZE,
+      };
+      rect.w = _micro_draw_min(column * MICRO_DRAW_DAMAGE_TILE_SIZE,
+                               damage->width) - rect.x;
+      rect.h = _micro_draw_min(MICRO_DRAW_DAMAGE_TILE_SIZE,
+                               damage->height - rect.y);
+
+      // Extend the same run of the row above, if any
+      int merged = 0;
+      for (int i = 0; i < current_row && !merged; ++i)
+      {
+        if (rects[i].x != rect.x || rects[i].w != rect.w
+            || rects[i].y + rects[i].h != rect.y) continue;
+        rects[i].h += rect.h;
+        merged = 1;
+      }
+      if (merged) continue;
+
+      if (count < max)
+      {
+        rects[count++] = rect;
+        continue;
+      }
+      if (max <= 0) continue;
+      // No space left, grow the last rectangle
+      MicroDrawRect *last = &rects[max - 1];
+      int x_end = _micro_draw_max(last->x + last->w, rect.x + rect.w);
+      int y_end = _micro_draw_max(last->y + last->h, rect.y + rect.h);
+      last->x = _micro_draw_min(last->x, rect.x);
+      last->y = _micro_draw_min(last->y, rect.y);
+      last->w = x_end - last->x;
+      last->h = y_end - last->y;
+    }
+  }
+  return count;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_damage_free(MicroDrawDamage *damage)
+{
+  MICRO_DRAW_FREE(damage->tiles);
+  damage->tiles = NULL;
+  damage->count = 0;
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_lazy_clear_init(MicroDrawLazyClear *clear, int width, int height)
+{
+  *clear = (MicroDrawLazyClear) {
+    .columns = (width + MICRO_DRAW_TILE_SIZE - 1) / MICRO_DRAW_TILE_SIZE,
+    .rows = (height + MICRO_DRAW_TILE_SIZE - 1) / MICRO_DRAW_TILE_SIZE,
+  };
+  if (width <= 0 || height <= 0) return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  
+  clear->tiles = MICRO_DRAW_MALLOC(clear->columns * clear->rows);
+  if (clear->tiles == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  for (int i = 0; i < clear->columns * clear->rows; ++i)
+    clear->tiles[i] = 0;
+  return MICRO_DRAW_OK;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "MicroDrawPixel has changed, make sure that MicroDrawLazyClear color is enough");
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_surface_clear(MicroDrawSurface *surface, unsigned char *color)
+{
+  if (!_micro_draw_surface_is_packed(surface))
+    return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  
+  MicroDrawLazyClear *clear = surface->lazy_clear;
+  MicroDrawRect screen = micro_draw_clip_rect(surface->width, surface->height);
+  if (surface->damage != NULL)
+    micro_draw_damage_add(surface->damage, screen);
+  // Tiles are cleared lazily only as a whole
+  if (clear == NULL || screen.w != surface->width || screen.h != surface->height)
+  {
+    micro_draw_lazy_clear_resolve(surface);
+    micro_draw_clear(surface->data, surface->width, surface->height,
+                     color, surface->pixel);
+    return MICRO_DRAW_OK;
+  }
+  
+  int size = micro_draw_get_channels(surface->pixel)
+    * micro_draw_get_channel_size(surface->pixel);
+  for (int i = 0; i < size; ++i)
+    clear->color[i] = color[i];
+  for (int i = 0; i < clear->columns * clear->rows; ++i)
+    clear->tiles[i] = 1;
+  return MICRO_DRAW_OK;
+}
+
+static void _micro_draw_lazy_clear_tiles(void *context, int begin, int end)
+{
+  MicroDrawSurface *surface = context;
+  for (int tile = begin; tile < end; ++tile)
+    _micro_draw_lazy_clear_tile(surface, tile % surface->lazy_clear->columns,
+                                tile / surface->lazy_clear->columns, NULL,
+                                (MicroDrawRect) {0});
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_lazy_clear_resolve(MicroDrawSurface *surface)
+{
+  MicroDrawLazyClear *clear = surface->lazy_clear;
+  if (clear == NULL || !_micro_draw_surface_is_packed(surface)) return;
+  int tile_size = MICRO_DRAW_TILE_SIZE * micro_draw_get_channels(surface->pixel)
+    * micro_draw_get_channel_size(surface->pixel);
+  MICRO_DRAW_PARALLEL_FOR(clear->columns * clear->rows,
+                          _micro_draw_rows_grain(tile_size * MICRO_DRAW_TILE_SIZE),
+                          _micro_draw_lazy_clear_tiles, surface);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_lazy_clear_free(MicroDrawLazyClear *clear)
+{
+  MICRO_DRAW_FREE(clear->tiles);
+  clear->tiles = NULL;
+  return;
+}
+
+_Static_assert(_MICRO_DRAW_DEPTH_MAX == 2,
+               "MicroDrawDepthFormat has changed, update the depth functions");
+
+static inline unsigned int _micro_draw_depth_far(MicroDrawDepthFormat format)
+{
+  return (format == MICRO_DRAW_DEPTH16) ? 0xFFFF : 0xFFFFFFFF;
+}
+
+static inline unsigned int _micro_draw_depth_get(MicroDrawDepth *depth, int index)
+{
+  if (depth->format == MICRO_DRAW_DEPTH16)
+    return ((unsigned short*)depth->data)[index];
+  return ((unsigned int*)depth->data)[index];
+}
+
+static inline void _micro_draw_depth_set(MicroDrawDepth *depth, int index,
+                                         unsigned int z)
+{
+  if (depth->format == MICRO_DRAW_DEPTH16)
+    ((unsigned short*)depth->data)[index] = z;
+  else
+    ((unsigned int*)depth->data)[index] = z;
+  return;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_depth_init(MicroDrawDepth *depth, int width, int height,
+                      MicroDrawDepthFormat format)
+{
+  *depth = (MicroDrawDepth) {
+    .width = width,
+    .height = height,
+    .format = format,
+    .columns = (width + MICRO_DRAW_DEPTH_TILE_SIZE - 1) / MICRO_DRAW_DEPTH_TILE_SIZE,
+    .rows = (height + MICRO_DRAW_DEPTH_TILE_SIZE - 1) / MICRO_DRAW_DEPTH_TILE_SIZE,
+  };
+  if (width <= 0 || height <= 0) return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  if (format >= _MICRO_DRAW_DEPTH_MAX) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  
+  size_t value_size = (format == MICRO_DRAW_DEPTH16)
+    ? sizeof(unsigned short) : sizeof(unsigned int);
+  size_t tiles_size = depth->columns * depth->rows * sizeof(unsigned int);
+  depth->data = MICRO_DRAW_MALLOC((size_t)width * height * value_size);
+  depth->tile_min = MICRO_DRAW_MALLOC(tiles_size);
+  depth->tile_max = MICRO_DRAW_MALLOC(tiles_size);
+  if (depth->data == NULL || depth->tile_min == NULL || depth->tile_max == NULL)
+  {
+    micro_draw_depth_free(depth);
+    return MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  micro_draw_depth_clear(depth, 1);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_depth_clear(MicroDrawDepth *depth, float z)
+{
+  unsigned int far = _micro_draw_depth_far(depth->format);
+  unsigned int value = (z <= 0) ? 0 : (z >= 1) ? far : (unsigned int)(z * (double)far + 0.5);
+  for (int i = 0; i < depth->width * depth->height; ++i)
+    _micro_draw_depth_set(depth, i, value);
+  for (int i = 0; i < depth->columns * depth->rows; ++i)
+  {
+    depth->tile_min[i] = value;
+    depth->tile_max[i] = value;
+  }
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_depth_free(MicroDrawDepth *depth)
+{
+  MICRO_DRAW_FREE(depth->data);
+  MICRO_DRAW_FREE(depth->tile_min);
+  MICRO_DRAW_FREE(depth->tile_max);
+  depth->data = NULL;
+  depth->tile_min = NULL;
+  depth->tile_max = NULL;
+  return;
+}
+
+static inline void
+_micro_draw_depth_tile_update(MicroDrawDepth *depth, int tile_x, int tile_y)
+{
+  int x_end = _micro_draw_min((tile_x + 1) * MICRO_DRAW_DEPTH_TILE_SIZE, depth->width);
+  int y_end = _micro_draw_min((tile_y + 1) * MICRO_DRAW_DEPTH_TILE_SIZE, depth->height);
+  unsigned int min = 0xFFFFFFFF;
+  unsigned int max = 0;
+  for (int y = tile_y * MICRO_DRAW_DEPTH_TILE_SIZE; y < y_end; ++y)
+    for (int x = tile_x * MICRO_DRAW_DEPTH_TILE_SIZE; x < x_end; ++x)
+    {
+      unsigned int z = _micro_draw_depth_get(depth, y * depth->width + x);
+      min = _micro_draw_min(min, z);
+      max = _micro_draw_max(max, z);
+    }
+  depth->tile_min[tile_y * depth->columns + tile_x] = min;
+  depth->tile_max[tile_y * depth->columns + tile_x] = max;
+  return;
+}
+
+// Rasterize the triangle inside [rect], a part of the tile at
+// [tile_x, tile_y]
+static inline void
+_micro_draw_triangle_z_tile(unsigned char *data, int data_width, int data_height,
+                            MicroDrawDepth *depth, _MicroDrawTriangleSetup *setup,
+                            _MicroDrawTrianglePlane *plane,
+                            MicroDrawRect rect, int tile_x, int tile_y,
+                            unsigned char *color, MicroDrawPixel pixel)
+{
+  int last_x = rect.w - 1;
+  int last_y = rect.h - 1;
+  // Skip the tile if it is outside of an edge: the edge functions are
+  // the largest at one of the corners
+  int w[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    w[i] = setup->w[i] + (rect.x - setup->x) * setup->step_x[i]
+      + (rect.y - setup->y) * setup->step_y[i];
+    if (w[i] + _micro_draw_max(0, last_x * setup->step_x[i])
+        + _micro_draw_max(0, last_y * setup->step_y[i]) < 0)
+      return;
+  }
+
+  // The range of the depth of the triangle inside the tile is exact,
+  // the pixels use the same fixed point values
+  long long far = _micro_draw_depth_far(depth->format);
+  long long z = plane->value + (rect.x - setup->x) * plane->step_x
+    + (rect.y - setup->y) * plane->step_y;
+  long long z_min = (z + _micro_draw_min(0, last_x * plane->step_x)
+                     + _micro_draw_min(0, last_y * plane->step_y))
+    >> _MICRO_DRAW_FIXED_FRACTION;
+  long long z_max = (z + _micro_draw_max(0, last_x * plane->step_x)
+                     + _micro_draw_max(0, last_y * plane->step_y))
+    >> _MICRO_DRAW_FIXED_FRACTION;
+  int tile = tile_y * depth->columns + tile_x;
+  if (z_min >= (long long)depth->tile_max[tile]) return;
+  // Nearer than all the tile, no need to read the depths
+  int nearer = _micro_draw_max(z_max, 0) < (long long)depth->tile_min[tile];
+
+  int written = 0;
+  for (int y = 0; y <= last_y; ++y)
+  {
+    int w0 = w[0], w1 = w[1], w2 = w[2];
+    long long z_pixel = z;
+    int index = (rect.y + y) * depth->width + rect.x;
+    for (int x = 0; x <= last_x; ++x)
+    {
+      if ((w0 | w1 | w2) >= 0)
+      {
+        long long value = z_pixel >> _MICRO_DRAW_FIXED_FRACTION;
+        value = _micro_draw_min(_micro_draw_max(value, 0), far);
+        if (nearer || value < (long long)_micro_draw_depth_get(depth, index + x))
+        {
+          _micro_draw_depth_set(depth, index + x, (unsigned int)value);
+          micro_draw_pixel(data, data_width, data_height,
+                           rect.x + x, rect.y + y, color, pixel);
+          written = 1;
+        }
+      }
+      w0 += setup->step_x[0];
+      w1 += setup->step_x[1];
+      w2 += setup->step_x[2];
+      z_pixel += plane->step_x;
+    }
+    for (int i = 0; i < 3; ++i)
+      w[i] += setup->step_y[i];
+    z += plane->step_y;
+  }
+  if (written)
+    _micro_draw_depth_tile_update(depth, tile_x, tile_y);
+  return;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_fill_triangle_z(unsigned char *data, int data_width, int data_height,
+                           MicroDrawDepth *depth,
+                           int a_x, int a_y, float a_z,
+                           int b_x, int b_y, float b_z,
+                           int c_x, int c_y, float c_z,
+                           unsigned char *color, MicroDrawPixel pixel)
+{
+  MicroDrawRect clip = _micro_draw_rect_intersect(
+    micro_draw_clip_rect(data_width, data_height),
+    (MicroDrawRect) { 0, 0, depth->width, depth->height });
+  _MicroDrawTriangleSetup setup;
+  MicroDrawRect bounds;
+  if (!_micro_draw_triangle_setup(&setup, &bounds, clip,
+                                  a_x, a_y, b_x, b_y, c_x, c_y))
+    return;
+
+  double far = (double)_micro_draw_depth_far(depth->format)
+    * (1 << _MICRO_DRAW_FIXED_FRACTION);
+  _MicroDrawTrianglePlane z =
+    _micro_draw_triangle_plane(&setup,
+                               _micro_draw_min(_micro_draw_max(a_z, 0), 1) * far,
+                               _micro_draw_min(_micro_draw_max(b_z, 0), 1) * far,
+                               _micro_draw_min(_micro_draw_max(c_z, 0), 1) * far);
+
+  int tile_size = MICRO_DRAW_DEPTH_TILE_SIZE;
+  for (int tile_y = bounds.y / tile_size;
+       tile_y <= (bounds.y + bounds.h - 1) / tile_size; ++tile_y)
+    for (int tile_x = bounds.x / tile_size;
+         tile_x <= (bounds.x + bounds.w - 1) / tile_size; ++tile_x)
+    {
+      MicroDrawRect rect = _micro_draw_rect_intersect(
+        (MicroDrawRect) { tile_x * tile_size, tile_y * tile_size, tile_size, tile_size },
+        bounds);
+      _micro_draw_triangle_z_tile(data, data_width, data_height, depth, &setup, &z,
+                                  rect, tile_x, tile_y, color, pixel);
+    }
+  return;
+}
+
+// Parse a non-negative decimal integer at [*str], skipping leading
+// whitespace. Advances [*str] past the number. Returns -1 if there
+// is no number.
+static inline int _micro_draw_parse_int(const unsigned char **str,
+                                        const unsigned char *end)
+{
+  const unsigned char *p = *str;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    p++;
+  if (p == end || *p < '0' || *p > '9')
+  {
+    *str = p;
+    return -1;
+  }
+  int value = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
+  *str = p;
+  return value;
+}
+
+#ifdef MICRO_DRAW_BITMAP_FONTS
+
+#include <stdio.h>  // fopen
+#include <stdlib.h> // qsort
+
+MICRO_DRAW_DEF void
+micro_draw_font_free(MicroDrawFont *font)
+{
+  MICRO_DRAW_FREE(font->atlas);
+  MICRO_DRAW_FREE(font->glyphs);
+  MICRO_DRAW_FREE(font->ranges);
+  font->atlas = NULL;
+  font->glyphs = NULL;
+  font->ranges = NULL;
+  font->atlas_size = 0;
+  font->glyphs_count = 0;
+  font->ranges_count = 0;
+  return;
+}
+
+static int _micro_draw_font_range_compare(const void *a, const void *b)
+{
+  const MicroDrawFontRange *range_a = a;
+  const MicroDrawFontRange *range_b = b;
+  if (range_a->codepoint != range_b->codepoint)
+    return (range_a->codepoint < range_b->codepoint) ? -1 : 1;
+  return (range_a->glyph > range_b->glyph) - (range_a->glyph < range_b->glyph);
+}
+
+// Build the codepoint index of [font] from [count] single codepoint
+// ranges, which are sorted and merged in place. Takes ownership of
+// [ranges].
+static inline void
+_micro_draw_font_index(MicroDrawFont *font, MicroDrawFontRange *ranges, int count)
+{
+  qsort(ranges, count, sizeof(MicroDrawFontRange), _micro_draw_font_range_compare);
+  int ranges_count = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    if (ranges_count > 0)
+    {
+      MicroDrawFontRange *last = &ranges[ranges_count - 1];
+      if (ranges[i].codepoint < last->codepoint + last->count)
+        continue; // Mapped twice, the lowest glyph wins
+      if (ranges[i].codepoint == last->codepoint + last->count
+          && ranges[i].glyph == last->glyph + last->count)
+      {
+        last->count++;
+        continue;
+      }
+    }
+    ranges[ranges_count++] = ranges[i];
+  }
+  font->ranges = ranges;
+  font->ranges_count = ranges_count;
+  return;
+}
+
+static inline MicroDrawError
+_micro_draw_font_alloc(MicroDrawFont *font, int glyphs_count, int atlas_size)
+{
+  font->atlas = MICRO_DRAW_MALLOC(atlas_size > 0 ? atlas_size : 1);
+  font->glyphs = MICRO_DRAW_MALLOC(glyphs_count * sizeof(MicroDrawFontGlyph));
+  font->ranges = NULL;
+  font->atlas_size = atlas_size;
+  font->glyphs_count = glyphs_count;
+  font->ranges_count = 0;
+  if (font->atlas == NULL || font->glyphs == NULL)
+  {
+    micro_draw_font_free(font);
+    return MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  return MICRO_DRAW_OK;
+}
+
+static inline unsigned int _micro_draw_read_u32le(const unsigned char *b)
+{
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+}
+
+// PSF2 layout:
+//  - a 32 bytes header of little endian u32: magic (0x864ab572),
+//    version, header size, flags, number of glyphs, bytes per glyph,
+//    height, width
+//  - the glyphs, rows padded to a byte, which is already the layout
+//    of the atlas
+//  - if flags & 1, a unicode table: for each glyph, UTF-8 codepoints
+//    terminated by 0xFF. Sequences of codepoints start with 0xFE.
+//
+// More info: https://www.win.tue.nl/~aeb/linux/kbd/font-formats-1.html
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_from_psf2(MicroDrawFont *font, const unsigned char *buffer,
+                          int buffer_size)
+{
+  if (buffer_size < 32 || _micro_draw_read_u32le(buffer) != 0x864ab572)
+    return MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER;
+
+  unsigned int header_size = _micro_draw_read_u32le(buffer + 8);
+  unsigned int flags       = _micro_draw_read_u32le(buffer + 12);
+  unsigned int length      = _micro_draw_read_u32le(buffer + 16);
+  unsigned int char_size   = _micro_draw_read_u32le(buffer + 20);
+  unsigned int height      = _micro_draw_read_u32le(buffer + 24);
+  unsigned int width       = _micro_draw_read_u32le(buffer + 28);
+
+  // The sizes are bounded first so that they fit the glyphs and the
+  // products below do not wrap
+  if (length == 0 || width == 0 || height == 0 || char_size == 0
+      || width > 0xFFFF || height > 0xFFFF
+      || char_size != height * ((width + 7) / 8)
+      || header_size > (unsigned int)buffer_size
+      || length > ((unsigned int)buffer_size - header_size) / char_size)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+
+  MicroDrawError error =
+    _micro_draw_font_alloc(font, length, length * char_size);
+  if (error != MICRO_DRAW_OK) return error;
+
+  _micro_draw_memcpy(font->atlas, buffer + header_size, length * char_size);
+  font->line_height = height;
+  for (unsigned int i = 0; i < length; ++i)
+  {
+    MicroDrawFontGlyph *glyph = &font->glyphs[i];
+    glyph->codepoint = i;
+    glyph->offset = i * char_size;
+    glyph->x = 0;
+    glyph->y = 0;
+    glyph->width = width;
+    glyph->height = height;
+    glyph->advance = width;
+  }
+
+  const unsigned char *table = buffer + header_size + length * char_size;
+  const unsigned char *end = buffer + buffer_size;
+  // Each codepoint takes at least one byte of the table
+  int ranges_capacity = (flags & 1) ? end - table : 1;
+  MicroDrawFontRange *ranges =
+    MICRO_DRAW_MALLOC((ranges_capacity > 0 ? ranges_capacity : 1)
+                      * sizeof(MicroDrawFontRange));
+  if (ranges == NULL)
+  {
+    micro_draw_font_free(font);
+    return MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  
+  if (!(flags & 1))
+  {
+    // Glyphs are indexed by codepoint
+    ranges[0] = (MicroDrawFontRange) { .codepoint = 0, .count = length, .glyph = 0 };
+    _micro_draw_font_index(font, ranges, 1);
+    return MICRO_DRAW_OK;
+  }
+
+  int ranges_count = 0;
+  for (unsigned int i = 0; i < length && table < end; ++i)
+  {
+    int first = 1;
+    while (table < end && *table != 0xFF)
+    {
+      if (*table == 0xFE)
+      {
+        // Skip the sequence
+        while (table < end && *table != 0xFF) table++;
+        break;
+      }
+      int len;
+      int codepoint = _micro_draw_utf8_decode(table, end - table, &len);
+      table += len;
+      if (codepoint < 0) continue;
+      if (first) font->glyphs[i].codepoint = codepoint;
+      first = 0;
+      ranges[ranges_count++] =
+        (MicroDrawFontRange) { .codepoint = codepoint, .count = 1, .glyph = i };
+    }
+    table++;
+  }
+  _micro_draw_font_index(font, ranges, ranges_count);
+  return MICRO_DRAW_OK;
+}
+
+// Returns the start of the next line after [line] and sets [line_end]
+static inline const unsigned char *
+_micro_draw_next_line(const unsigned char *line, const unsigned char *end,
+                      const unsigned char **line_end)
+{
+  const unsigned char *p = line;
+  while (p < end && *p != '\n') p++;
+  *line_end = p;
+  return (p < end) ? p + 1 : end;
+}
+
+static inline int
+_micro_draw_starts_with(const unsigned char *line, const unsigned char *line_end,
+                        const char *keyword)
+{
+  while (*keyword != '\0')
+  {
+    if (line == line_end || *line != *keyword) return 0;
+    line++;
+    keyword++;
+  }
+  return (line == line_end || *line == ' ' || *line == '\t' || *line == '\r');
+}
+
+// Parse a possibly negative integer
+static inline int _micro_draw_parse_signed_int(const unsigned char **str,
+                                               const unsigned char *end)
+{
+  while (*str < end && (**str == ' ' || **str == '\t')) (*str)++;
+  int sign = 1;
+  if (*str < end && **str == '-')
+  {
+    sign = -1;
+    (*str)++;
+  }
+  return sign * _micro_draw_parse_int(str, end);
+}
+
+static inline int _micro_draw_hex_digit(unsigned char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// BDF is a text format: the font has a FONT_ASCENT and FONT_DESCENT,
+// each glyph between STARTCHAR and ENDCHAR has an ENCODING, a DWIDTH
+// (advance), a BBX (width, height, x offset and y offset of the
+// bitmap from the baseline) and a BITMAP with one hex line per row.
+//
+// The font is parsed twice: the first pass computes the size of the
+// atlas, the second one fills it. Both take the glyphs with an
+// ENCODING, a single BBX and a BITMAP.
+//
+// More info: https://adobe-type-tools.github.io/font-tech-notes/pdfs/5005.BDF_Spec.pdf
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_from_bdf(MicroDrawFont *font, const unsigned char *buffer,
+                         int buffer_size)
+{
+  const unsigned char *end = buffer + buffer_size;
+  const unsigned char *line_end;
+  const unsigned char *next;
+  const unsigned char *p;
+
+  if (buffer_size < 9
+      || !_micro_draw_starts_with(buffer, end, "STARTFONT"))
+    return MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER;
+
+  // First pass
+  int glyphs_count = 0;
+  int atlas_size = 0;
+  int ascent = 0;
+  int descent = 0;
+  int encoding = -1;
+  int bbx = 0;
+  for (const unsigned char *line = buffer; line < end; line = next)
+  {
+    next = _micro_draw_next_line(line, end, &line_end);
+    p = line;
+    if (_micro_draw_starts_with(line, line_end, "FONT_ASCENT"))
+    {
+      p += 11;
+      ascent = _micro_draw_parse_signed_int(&p, line_end);
+    }
+    else if (_micro_draw_starts_with(line, line_end, "FONT_DESCENT"))
+    {
+      p += 12;
+      descent = _micro_draw_parse_signed_int(&p, line_end);
+    }
+    else if (_micro_draw_starts_with(line, line_end, "STARTCHAR"))
+    {
+      encoding = -1;
+      bbx = 0;
+    }
+    else if (_micro_draw_starts_with(line, line_end, "ENCODING"))
+    {
+      p += 8;
+      encoding = _micro_draw_parse_signed_int(&p, line_end);
+      bbx = 0;
+    }
+    else if (_micro_draw_starts_with(line, line_end, "BBX") && encoding >= 0)
+    {
+      p += 3;
+      int width = _micro_draw_parse_signed_int(&p, line_end);
+      int height = _micro_draw_parse_signed_int(&p, line_end);
+      if (bbx || width < 0 || height < 0 || width > 0xFFFF || height > 0xFFFF
+          || atlas_size > 0x7FFFFFFF - height * ((width + 7) / 8))
+        return MICRO_DRAW_ERROR_INVALID_FORMAT;
+      atlas_size += height * ((width + 7) / 8);
+      bbx = 1;
+    }
+    else if (_micro_draw_starts_with(line, line_end, "BITMAP") && encoding >= 0)
+    {
+      if (!bbx)
+        return MICRO_DRAW_ERROR_INVALID_FORMAT;
+      glyphs_count++;
+      encoding = -1;
+    }
+  }
+  if (glyphs_count == 0)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+
+  MicroDrawError error = _micro_draw_font_alloc(font, glyphs_count, atlas_size);
+  if (error != MICRO_DRAW_OK) return error;
+  font->line_height = ascent + descent;
+  MicroDrawFontRange *ranges =
+    MICRO_DRAW_MALLOC(glyphs_count * sizeof(MicroDrawFontRange));
+  if (ranges == NULL)
+  {
+    micro_draw_font_free(font);
+    return MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  font->ranges = ranges; // Freed with the font on error
+
+  // Second pass
+  MicroDrawFontGlyph glyph = {0};
+  int glyph_id = 0;
+  int offset = 0;
+  encoding = -1;
+  for (const unsigned char *line = buffer;
+       line < end && glyph_id < glyphs_count; line = next)
+  {
+    next = _micro_draw_next_line(line, end, &line_end);
+    p = line;
+    if (_micro_draw_starts_with(line, line_end, "STARTCHAR"))
+    {
+      encoding = -1;
+      glyph = (MicroDrawFontGlyph) {0};
+    }
+    else if (_micro_draw_starts_with(line, line_end, "ENCODING"))
+    {
+      p += 8;
+      encoding = _micro_draw_parse_signed_int(&p, line_end);
+      glyph = (MicroDrawFontGlyph) {0};
+    }
+    else if (_micro_draw_starts_with(line, line_end, "DWIDTH"))
+    {
+      p += 6;
+      glyph.advance = _micro_draw_parse_signed_int(&p, line_end);
+    }
+    else if (_micro_draw_starts_with(line, line_end, "BBX") && encoding >= 0)
+    {
+      p += 3;
+      glyph.width = _micro_draw_parse_signed_int(&p, line_end);
+      glyph.height = _micro_draw_parse_signed_int(&p, line_end);
+      glyph.x = _micro_draw_parse_signed_int(&p, line_end);
+      // From baseline-relative to top-of-line-relative
+      glyph.y = ascent - glyph.height
+        - _micro_draw_parse_signed_int(&p, line_end);
+    }
+    else if (_micro_draw_starts_with(line, line_end, "BITMAP") && encoding >= 0)
+    {
+      int stride = (glyph.width + 7) / 8;
+      glyph.codepoint = encoding;
+      glyph.offset = offset;
+      if (glyph.advance == 0) glyph.advance = glyph.width;
+
+      // Bitmap rows
+      for (int row = 0; row < glyph.height; ++row)
+      {
+        line = next;
+        next = _micro_draw_next_line(line, end, &line_end);
+        if (offset + stride > atlas_size)
+        {
+          micro_draw_font_free(font);
+          return MICRO_DRAW_ERROR_INVALID_FORMAT;
+        }
+        for (int b = 0; b < stride; ++b)
+        {
+          int hi = (line + 2*b < line_end) ? _micro_draw_hex_digit(line[2*b]) : 0;
+          int lo = (line + 2*b + 1 < line_end) ? _micro_draw_hex_digit(line[2*b+1]) : 0;
+          if (hi < 0 || lo < 0)
+          {
+            micro_draw_font_free(font);
+            return MICRO_DRAW_ERROR_INVALID_FORMAT;
+          }
+          font->atlas[offset++] = (hi << 4) | lo;
+        }
+      }
+
+      ranges[glyph_id] =
+        (MicroDrawFontRange) { .codepoint = encoding, .count = 1, .glyph = glyph_id };
+      font->glyphs[glyph_id++] = glyph;
+      encoding = -1;
+    }
+  }
+  
+  if (glyph_id != glyphs_count)
+  {
+    micro_draw_font_free(font);
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+  }
+  _micro_draw_font_index(font, ranges, glyphs_count);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_font_load(MicroDrawFont *font, const char *filename)
+{
+  MicroDrawError error = MICRO_DRAW_OK;
+  unsigned char *buffer = NULL;
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0)
+  {
+    error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+    goto done;
+  }
+  
+  buffer = MICRO_DRAW_MALLOC(size);
+  if (buffer == NULL)
+  {
+    error = MICRO_DRAW_ERROR_ALLOCATION;
+    goto done;
+  }
+  if (fread(buffer, 1, size, file) != (size_t)size)
+  {
+    error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+  }
+  else if (buffer[0] == 0x72)
+  {
+    error = micro_draw_font_from_psf2(font, buffer, size);
+  }
+  else
+  {
+    error = micro_draw_font_from_bdf(font, buffer, size);
+  }
+  MICRO_DRAW_FREE(buffer);
+  
+ done:
+  fclose(file);
+  return error;
+}
+
+#endif // MICRO_DRAW_BITMAP_FONTS
+  
+#ifdef MICRO_DRAW_PPM
+
+#include <stdio.h>  // fread
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <errno.h>  // EINTR
+  #include <unistd.h> // read, write
+#endif
+
+// The PPM header starts with 4 values speareted by either space or
+// newline: ID, WIDTH, HEIGHT, MAX_COLOR_VALUE.
+// Where ID is either:
+//  - P1: ASCII Bitmap   (.pbm)
+//  - P2: ASCII Graymap  (.pgm)
+//  - P3: ASCII PixMap   (.ppm)
+//  - P4: Binary Bitmap  (.pbm)
+//  - P5: Binary Graymap (.pgm)
+//  - P6: Binary PixMap  (.ppm)
+//
+// The rest of the file contains WIDHT*HEIGHT color values less then
+// MAX_COLOR_VALUE. Bitmaps (P1 and P4) have no MAX_COLOR_VALUE.
+//
+// PAM files (P7, .pam) instead have a header of KEY VALUE lines:
+//
+//   P7
+//   WIDTH 640
+//   HEIGHT 480
+//   DEPTH 4
+//   MAXVAL 255
+//   TUPLTYPE RGB_ALPHA
+//   ENDHDR
+//
+// followed by a binary raster of DEPTH samples per pixel. Supported
+// tuple types are RGB_ALPHA, RGB, GRAYSCALE_ALPHA, GRAYSCALE and
+// BLACKANDWHITE, where 1 is white.
+
+// Shrink [pixels] RGBA8 pixels to RGB8, dropping the alpha
+static inline void
+_micro_draw_rgba8_to_rgb8(const unsigned char *src, unsigned char *dest,
+                          int pixels)
+{
+  int i = 0;
+#if defined(__SSSE3__) && !defined(MICRO_DRAW_NO_SIMD)
+  const __m128i shuffle =
+    _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  // Each store writes 4 bytes past the pixels, overwritten by the
+  // next: stop early enough to not write past [dest]
+  for (; i + 6 <= pixels; i += 4)
+  {
+    __m128i rgba = _mm_loadu_si128((const __m128i*)(src + i * 4));
+    _mm_storeu_si128((__m128i*)(dest + i * 3), _mm_shuffle_epi8(rgba, shuffle));
+  }
+#endif
+  for (; i < pixels; ++i)
+  {
+    dest[i * 3 + 0] = src[i * 4 + 0];
+    dest[i * 3 + 1] = src[i * 4 + 1];
+    dest[i * 3 + 2] = src[i * 4 + 2];
+  }
+  return;
+}
+
+// Size in bytes of a row of the raster written for [pixel]
+static inline int
+_micro_draw_ppm_row_size(MicroDrawPixel pixel, int data_width)
+{
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+  case MICRO_DRAW_RGB8:
+    return data_width * 3;
+  case MICRO_DRAW_GRAY8:
+    return data_width;
+  case MICRO_DRAW_BLACK_WHITE:
+    return (data_width + 7) / 8;
+  default:
+    break;
+  }
+  return 0;
+}
+
+// Where an image is written: a FILE, a file descriptor or a buffer
+typedef struct {
+  FILE *file;
+  int fd;                // -1 if not used
+  unsigned char *buffer;
+  size_t capacity;
+  size_t size;           // Bytes written in [buffer]
+} _MicroDrawPPMOutput;
+
+static inline MicroDrawError
+_micro_draw_ppm_write(_MicroDrawPPMOutput *output, const unsigned char *bytes,
+                      size_t size)
+{
+  if (output->file != NULL)
+  {
+    if (fwrite(bytes, 1, size, output->file) != size)
+      return MICRO_DRAW_ERROR_WRITE_FILE;
+    return MICRO_DRAW_OK;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  if (output->fd >= 0)
+  {
+    // Pipes and sockets may take less than the whole write
+    while (size > 0)
+    {
+      ssize_t written = write(output->fd, bytes, size);
+      if (written < 0 && errno == EINTR) continue;
+      if (written <= 0) return MICRO_DRAW_ERROR_WRITE_FILE;
+      bytes += written;
+      size -= written;
+    }
+    return MICRO_DRAW_OK;
+  }
+#endif
+  if (output->buffer == NULL || output->capacity - output->size < size)
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  _micro_draw_memcpy(output->buffer + output->size, bytes, size);
+  output->size += size;
+  return MICRO_DRAW_OK;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update _micro_draw_ppm_format_header");
+// Enough for the longest header that is written
+#define _MICRO_DRAW_PPM_HEADER_SIZE 128
+
+// Write the header in [header], returns its length or -1 if [pixel]
+// is not supported
+static inline int
+_micro_draw_ppm_format_header(char *header, int data_width, int data_height,
+                              MicroDrawPixel pixel)
+{
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+  case MICRO_DRAW_RGB8:
+    return snprintf(header, _MICRO_DRAW_PPM_HEADER_SIZE, "P6\n%d %d\n%d\n",
+                    data_width, data_height, 255);
+  case MICRO_DRAW_GRAY8:
+    return snprintf(header, _MICRO_DRAW_PPM_HEADER_SIZE, "P5\n%d %d\n%d\n",
+                    data_width, data_height, 255);
+  case MICRO_DRAW_BLACK_WHITE:
+    return snprintf(header, _MICRO_DRAW_PPM_HEADER_SIZE, "P4\n%d %d\n",
+                    data_width, data_height);
+  default:
+    break;
+  }
+  return -1;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update _micro_draw_pam_format_header");
+// Same of _micro_draw_ppm_format_header for a PAM header
+static inline int
+_micro_draw_pam_format_header(char *header, int data_width, int data_height,
+                              MicroDrawPixel pixel)
+{
+  const char *tuple_type;
+  int color_max = 255;
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+    tuple_type = "RGB_ALPHA";
+    break;
+  case MICRO_DRAW_RGB8:
+    tuple_type = "RGB";
+    break;
+  case MICRO_DRAW_GRAY8:
+    tuple_type = "GRAYSCALE";
+    break;
+  case MICRO_DRAW_BLACK_WHITE:
+    tuple_type = "BLACKANDWHITE";
+    color_max = 1;
+    break;
+  default:
+    return -1;
+  }
+  return snprintf(header, _MICRO_DRAW_PPM_HEADER_SIZE,
+                  "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL %d\n"
+                  "TUPLTYPE %s\nENDHDR\n", data_width, data_height,
+                  micro_draw_get_channels(pixel), color_max, tuple_type);
+}
+
+static inline MicroDrawError
+_micro_draw_ppm_write_header(_MicroDrawPPMOutput *output, int data_width,
+                             int data_height, MicroDrawPixel pixel)
+{
+  char header[_MICRO_DRAW_PPM_HEADER_SIZE];
+  int length =
+    _micro_draw_ppm_format_header(header, data_width, data_height, pixel);
+  if (length < 0) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  return _micro_draw_ppm_write(output, (const unsigned char*)header, length);
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update _micro_draw_ppm_encode_rows");
+// Convert [rows] rows of [data] to the raster of the file in [dest],
+// which is PAM if [pam] is set
+static inline void
+_micro_draw_ppm_encode_rows(const unsigned char *data, int data_width,
+                            int rows, MicroDrawPixel pixel, int pam,
+                            unsigned char *dest)
+{
+  if (pam)
+  {
+    // Only Black&White differs, which must be either 0 or 1
+    if (pixel == MICRO_DRAW_BLACK_WHITE)
+      for (int i = 0; i < data_width * rows; ++i)
+        dest[i] = (data[i] != 0);
+    return;
+  }
+  
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+    _micro_draw_rgba8_to_rgb8(data, dest, data_width * rows);
+    break;
+  case MICRO_DRAW_BLACK_WHITE:
+  {
+    // Rows are padded to a byte, in PBM 1 is black
+    int stride = (data_width + 7) / 8;
+    for (int row = 0; row < rows; ++row)
+    {
+      const unsigned char *src = data + row * data_width;
+      unsigned char *bits = dest + row * stride;
+      for (int b = 0; b < stride; ++b)
+        bits[b] = 0;
+      for (int col = 0; col < data_width; ++col)
+        if (!src[col])
+          bits[col >> 3] |= 0x80 >> (col & 7);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  return;
+}
+
+// Size of the staging buffer used to convert the rows
+#define _MICRO_DRAW_PPM_STAGING_SIZE (1 << 20)
+
+// Write a whole image to [output], as PAM if [pam] is set
+static inline MicroDrawError
+_micro_draw_to_ppm_output(_MicroDrawPPMOutput *output, int pam,
+                          unsigned char *data, int data_width, int data_height,
+                          MicroDrawPixel pixel)
+{
+  if (data_width <= 0 || data_height <= 0)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  char header[_MICRO_DRAW_PPM_HEADER_SIZE];
+  int length = pam
+    ? _micro_draw_pam_format_header(header, data_width, data_height, pixel)
+    : _micro_draw_ppm_format_header(header, data_width, data_height, pixel);
+  if (length < 0) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  MicroDrawError error =
+    _micro_draw_ppm_write(output, (const unsigned char*)header, length);
+  if (error != MICRO_DRAW_OK) return error;
+
+  int pixel_size = micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+  int row_size = pam ? data_width * pixel_size
+    : _micro_draw_ppm_row_size(pixel, data_width);
+  if ((pam && pixel != MICRO_DRAW_BLACK_WHITE)
+      || pixel == MICRO_DRAW_RGB8 || pixel == MICRO_DRAW_GRAY8)
+  {
+    // Already in the layout of the file
+    return _micro_draw_ppm_write(output, data, (size_t)row_size * data_height);
+  }
+
+  if (output->file == NULL && output->fd < 0)
+  {
+    // Encode directly in the buffer, without staging
+    if (output->buffer == NULL
+        || output->capacity - output->size < (size_t)row_size * data_height)
+      return MICRO_DRAW_ERROR_WRITE_FILE;
+    _micro_draw_ppm_encode_rows(data, data_width, data_height, pixel, pam,
+                                output->buffer + output->size);
+    output->size += (size_t)row_size * data_height;
+    return MICRO_DRAW_OK;
+  }
+
+  int chunk_rows = _micro_draw_max(1, _MICRO_DRAW_PPM_STAGING_SIZE / row_size);
+  chunk_rows = _micro_draw_min(chunk_rows, data_height);
+  unsigned char *staging = MICRO_DRAW_MALLOC((size_t)chunk_rows * row_size);
+  if (staging == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+
+  for (int row = 0; row < data_height && error == MICRO_DRAW_OK; row += chunk_rows)
+  {
+    int rows = _micro_draw_min(chunk_rows, data_height - row);
+    _micro_draw_ppm_encode_rows(data + (size_t)row * data_width * pixel_size,
+                                data_width, rows, pixel, pam, staging);
+    error = _micro_draw_ppm_write(output, staging, (size_t)row_size * rows);
+  }
+  MICRO_DRAW_FREE(staging);
+  return error;
+}
+
+// Size of a whole image written by _micro_draw_to_ppm_output
+static inline size_t
+_micro_draw_ppm_size(int pam, int data_width, int data_height,
+                     MicroDrawPixel pixel)
+{
+  char header[_MICRO_DRAW_PPM_HEADER_SIZE];
+  int length = pam
+    ? _micro_draw_pam_format_header(header, data_width, data_height, pixel)
+    : _micro_draw_ppm_format_header(header, data_width, data_height, pixel);
+  if (length < 0 || data_width <= 0 || data_height <= 0) return 0;
+  int pixel_size = micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+  int row_size = pam ? data_width * pixel_size
+    : _micro_draw_ppm_row_size(pixel, data_width);
+  return length + (size_t)row_size * data_height;
+}
+
+// Open [filename] and write a whole image to it
+static inline MicroDrawError
+_micro_draw_to_ppm_filename(const char *filename, int pam, unsigned char *data,
+                            int data_width, int data_height, MicroDrawPixel pixel)
+{
+  FILE* file = fopen(filename, "wb");
+  if (file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+
+  _MicroDrawPPMOutput output = { .file = file, .fd = -1 };
+  MicroDrawError error =
+    _micro_draw_to_ppm_output(&output, pam, data, data_width, data_height, pixel);
+  
+  if (fclose(file) != 0 && error == MICRO_DRAW_OK)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
+  return error;
+}
+
+// Encode a whole image in [buffer]
+static inline MicroDrawError
+_micro_draw_to_ppm_buffer(unsigned char *buffer, size_t capacity, size_t *size,
+                          int pam, unsigned char *data, int data_width,
+                          int data_height, MicroDrawPixel pixel)
+{
+  _MicroDrawPPMOutput output = {
+    .fd = -1,
+    .buffer = buffer,
+    .capacity = capacity,
+  };
+  MicroDrawError error =
+    _micro_draw_to_ppm_output(&output, pam, data, data_width, data_height, pixel);
+  *size = output.size;
+  return error;
+}
+
+// Images are written as:
+//  - RGBA8, RGB8: P6
+//  - GRAY8: P5
+//  - Black&White: P4
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel)
+{
+  return _micro_draw_to_ppm_filename(filename, 0, data, data_width,
+                                     data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_file(FILE *file, unsigned char *data,
+                       int data_width, int data_height, MicroDrawPixel pixel)
+{
+  _MicroDrawPPMOutput output = { .file = file, .fd = -1 };
+  return _micro_draw_to_ppm_output(&output, 0, data, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF size_t
+micro_draw_ppm_size(int data_width, int data_height, MicroDrawPixel pixel)
+{
+  return _micro_draw_ppm_size(0, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel)
+{
+  return _micro_draw_to_ppm_buffer(buffer, capacity, size, 0, data,
+                                   data_width, data_height, pixel);
+}
+
+// Images are written as:
+//  - RGBA8: RGB_ALPHA
+//  - RGB8: RGB
+//  - GRAY8: GRAYSCALE
+//  - Black&White: BLACKANDWHITE
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel)
+{
+  return _micro_draw_to_ppm_filename(filename, 1, data, data_width,
+                                     data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_file(FILE *file, unsigned char *data,
+                       int data_width, int data_height, MicroDrawPixel pixel)
+{
+  _MicroDrawPPMOutput output = { .file = file, .fd = -1 };
+  return _micro_draw_to_ppm_output(&output, 1, data, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF size_t
+micro_draw_pam_size(int data_width, int data_height, MicroDrawPixel pixel)
+{
+  return _micro_draw_ppm_size(1, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel)
+{
+  return _micro_draw_to_ppm_buffer(buffer, capacity, size, 1, data,
+                                   data_width, data_height, pixel);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_ppm_fd(int fd, unsigned char *data,
+                     int data_width, int data_height, MicroDrawPixel pixel)
+{
+  _MicroDrawPPMOutput output = { .fd = fd };
+  return _micro_draw_to_ppm_output(&output, 0, data, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_pam_fd(int fd, unsigned char *data,
+                     int data_width, int data_height, MicroDrawPixel pixel)
+{
+  _MicroDrawPPMOutput output = { .fd = fd };
+  return _micro_draw_to_ppm_output(&output, 1, data, data_width, data_height, pixel);
+}
+
+#endif // __unix__ || __APPLE__
+
+static inline int _micro_draw_is_whitespace(int c)
+{
+  return (c == ' ' || c == '\t' || c == '\n' || c == '\r'
+          || c == '\v' || c == '\f');
+}
+
+typedef enum {
+  _MICRO_DRAW_P1 = 0,
+  _MICRO_DRAW_P2,
+  _MICRO_DRAW_P3,
+  _MICRO_DRAW_P4,
+  _MICRO_DRAW_P5,
+  _MICRO_DRAW_P6,
+  _MICRO_DRAW_P7,
+} _MicroDrawPPMType;
+
+typedef struct {
+  _MicroDrawPPMType type;
+  int width;
+  int height;
+  int color_max;
+  int depth;            // Samples per pixel
+  MicroDrawPixel pixel; // Pixel format it is decoded to
+} _MicroDrawPPMHeader;
+
+// Where an image is read from: a FILE, a file descriptor or a buffer
+typedef struct {
+  FILE *file;
+  int fd;                      // -1 if not used
+  const unsigned char *buffer;
+  size_t size;
+  size_t position;             // Bytes read from [buffer]
+} _MicroDrawPPMInput;
+
+// Read up to [size] bytes, returns the number of bytes read which
+// is 0 at the end of the input
+static inline size_t
+_micro_draw_ppm_read_some(_MicroDrawPPMInput *input, unsigned char *dest,
+                          size_t size)
+{
+  if (input->file != NULL)
+    return fread(dest, 1, size, input->file);
+#if defined(__unix__) || defined(__APPLE__)
+  if (input->fd >= 0)
+  {
+    for (;;)
+    {
+      ssize_t bytes = read(input->fd, dest, size);
+      if (bytes < 0 && errno == EINTR) continue;
+      return (bytes < 0) ? 0 : (size_t)bytes;
+    }
+  }
+#endif
+  if (input->buffer == NULL) return 0;
+  size_t bytes = input->size - input->position;
+  if (bytes > size) bytes = size;
+  _micro_draw_memcpy(dest, input->buffer + input->position, bytes);
+  input->position += bytes;
+  return bytes;
+}
+
+// Read exactly [size] bytes, returns 0 if the input ends first
+static inline int
+_micro_draw_ppm_read(_MicroDrawPPMInput *input, unsigned char *dest, size_t size)
+{
+  if (input->file != NULL)
+    return fread(dest, 1, size, input->file) == size;
+  while (size > 0)
+  {
+    size_t bytes = _micro_draw_ppm_read_some(input, dest, size);
+    if (bytes == 0) return 0;
+    dest += bytes;
+    size -= bytes;
+  }
+  return 1;
+}
+
+// Read a single byte, returns EOF at the end of the input. File
+// descriptors are read one byte at a time, so that nothing past the
+// header is consumed.
+static inline int
+_micro_draw_ppm_getc(_MicroDrawPPMInput *input)
+{
+  if (input->file != NULL)
+    return getc(input->file);
+  unsigned char c;
+  return (_micro_draw_ppm_read_some(input, &c, 1) == 1) ? c : EOF;
+}
+
+// Read a header value, skipping whitespace and comments. The single
+// whitespace after the value is consumed. Returns -1 on error.
+static inline int _micro_draw_ppm_header_int(_MicroDrawPPMInput *input)
+{
+  int c = _micro_draw_ppm_getc(input);
+  while (c == '#' || _micro_draw_is_whitespace(c))
+  {
+    if (c == '#')
+      while (c != '\n' && c != EOF) c = _micro_draw_ppm_getc(input);
+    c = _micro_draw_ppm_getc(input);
+  }
+  if (c < '0' || c > '9') return -1;
+
+  int value = 0;
+  while (c >= '0' && c <= '9')
+  {
+    if (value > (0x7FFFFFFF - 9) / 10) return -1;
+    value = value * 10 + (c - '0');
+    c = _micro_draw_ppm_getc(input);
+  }
+  if (!_micro_draw_is_whitespace(c)) return -1;
+  return value;
+}
+
+// Read a header word, skipping whitespace and comments. The single
+// whitespace after the word is consumed. Returns 0 if the word
+// does not fit in [size] bytes.
+static inline int
+_micro_draw_ppm_header_word(_MicroDrawPPMInput *input, char *word, int size)
+{
+  int c = _micro_draw_ppm_getc(input);
+  while (c == '#' || _micro_draw_is_whitespace(c))
+  {
+    if (c == '#')
+      while (c != '\n' && c != EOF) c = _micro_draw_ppm_getc(input);
+    c = _micro_draw_ppm_getc(input);
+  }
+  
+  int length = 0;
+  while (c != EOF && !_micro_draw_is_whitespace(c))
+  {
+    if (length + 1 >= size) return 0;
+    word[length++] = c;
+    c = _micro_draw_ppm_getc(input);
+  }
+  word[length] = '\0';
+  return length > 0;
+}
+
+static inline int
+_micro_draw_ppm_word_equals(const char *word, const char *other)
+{
+  while (*word != '\0' && *word == *other)
+  {
+    word++;
+    other++;
+  }
+  return *word == *other;
+}
+
+// Parse the KEY VALUE lines of a PAM header, up to ENDHDR
+static inline MicroDrawError
+_micro_draw_pam_read_header(_MicroDrawPPMInput *input, _MicroDrawPPMHeader *header)
+{
+  char word[32];
+  char tuple_type[32] = "";
+  header->width = -1;
+  header->height = -1;
+  header->depth = -1;
+  header->color_max = -1;
+  for (;;)
+  {
+    if (!_micro_draw_ppm_header_word(input, word, sizeof(word)))
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    if (_micro_draw_ppm_word_equals(word, "ENDHDR"))
+      break;
+    else if (_micro_draw_ppm_word_equals(word, "WIDTH"))
+      header->width = _micro_draw_ppm_header_int(input);
+    else if (_micro_draw_ppm_word_equals(word, "HEIGHT"))
+      header->height = _micro_draw_ppm_header_int(input);
+    else if (_micro_draw_ppm_word_equals(word, "DEPTH"))
+      header->depth = _micro_draw_ppm_header_int(input);
+    else if (_micro_draw_ppm_word_equals(word, "MAXVAL"))
+      header->color_max = _micro_draw_ppm_header_int(input);
+    else if (_micro_draw_ppm_word_equals(word, "TUPLTYPE"))
+    {
+      if (!_micro_draw_ppm_header_word(input, tuple_type, sizeof(tuple_type)))
+        return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    }
+    else
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+  }
+  
+  if (header->width <= 0 || header->height <= 0
+      || header->width > 0x7FFFFFFF / 4 / header->height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  if (header->depth < 1 || header->depth > 4
+      || header->color_max <= 0 || header->color_max > 65535)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+
+  header->pixel = MICRO_DRAW_RGBA8;
+  if (_micro_draw_ppm_word_equals(tuple_type, "BLACKANDWHITE"))
+  {
+    if (header->depth != 1 || header->color_max != 1)
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    header->pixel = MICRO_DRAW_BLACK_WHITE;
+  }
+  return MICRO_DRAW_OK;
+}
+
+// Parse the header, leaving [input] at the start of the raster.
+// Bitmaps are read as Black&White, everything else as RGBA8.
+static inline MicroDrawError
+_micro_draw_ppm_read_header(_MicroDrawPPMInput *input, _MicroDrawPPMHeader *header)
+{
+  int magic[2] = { _micro_draw_ppm_getc(input), _micro_draw_ppm_getc(input) };
+  if (magic[0] != 'P' || magic[1] < '1' || magic[1] > '7')
+    return MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER;
+  header->type = _MICRO_DRAW_P1 + (magic[1] - '1');
+  if (header->type == _MICRO_DRAW_P7)
+    return _micro_draw_pam_read_header(input, header);
+  
+  header->width = _micro_draw_ppm_header_int(input);
+  header->height = _micro_draw_ppm_header_int(input);
+  if (header->width <= 0 || header->height <= 0
+      || header->width > 0x7FFFFFFF / 4 / header->height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+
+  header->depth = (header->type == _MICRO_DRAW_P3
+                   || header->type == _MICRO_DRAW_P6) ? 3 : 1;
+  header->pixel = MICRO_DRAW_RGBA8;
+  header->color_max = 1;
+  if (header->type == _MICRO_DRAW_P1 || header->type == _MICRO_DRAW_P4)
+  {
+    header->pixel = MICRO_DRAW_BLACK_WHITE;
+  }
+  else
+  {
+    header->color_max = _micro_draw_ppm_header_int(input);
+    if (header->color_max <= 0 || header->color_max > 65535)
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+  }
+  return MICRO_DRAW_OK;
+}
+
+// Read all the remaining bytes of [input]
+static inline MicroDrawError
+_micro_draw_read_all(_MicroDrawPPMInput *input, unsigned char **buffer, long *size)
+{
+  long capacity = 1 << 16;
+  *size = 0;
+  *buffer = MICRO_DRAW_MALLOC(capacity);
+  if (*buffer == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  
+  for (;;)
+  {
+    size_t bytes =
+      _micro_draw_ppm_read_some(input, *buffer + *size, capacity - *size);
+    if (bytes == 0) break;
+    *size += bytes;
+    if (*size < capacity) continue;
+    unsigned char *bigger = MICRO_DRAW_REALLOC(*buffer, capacity * 2);
+    if (bigger == NULL)
+    {
+      MICRO_DRAW_FREE(*buffer);
+      *buffer = NULL;
+      return MICRO_DRAW_ERROR_ALLOCATION;
+    }
+    *buffer = bigger;
+    capacity *= 2;
+  }
+  return MICRO_DRAW_OK;
+}
+
+// Parse an ASCII raster value, skipping whitespace and comments.
+// Returns -1 if there are no more values.
+static inline int
+_micro_draw_ppm_scan_int(const unsigned char **str, const unsigned char *end)
+{
+  const unsigned char *p = *str;
+  while (p < end && (*p < '0' || *p > '9'))
+  {
+    if (*p == '#')
+      while (p < end && *p != '\n') p++;
+    else if (!_micro_draw_is_whitespace(*p))
+      break;
+    else
+      p++;
+  }
+  
+  int value = -1;
+  if (p < end && *p >= '0' && *p <= '9')
+  {
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9' && value <= 65535)
+      value = value * 10 + (*p++ - '0');
+  }
+  *str = p;
+  return value;
+}
+
+// Scale [value] in [0, color_max] to [0, 255]
+#define _micro_draw_ppm_scale(value, color_max) \
+  (((value) * 255 + (color_max) / 2) / (color_max))
+
+// Decode up to [pixels] of an ASCII raster into [dest], moving
+// [*raster] after the last decoded pixel. Returns the number of
+// decoded pixels, which is less than [pixels] if the raster ends
+// first, or -1 if the raster is invalid.
+static inline int
+_micro_draw_ppm_decode_ascii(const _MicroDrawPPMHeader *header,
+                             const unsigned char **raster,
+                             const unsigned char *end,
+                             unsigned char *dest, int pixels)
+{
+  const unsigned char *p = *raster;
+  int samples = header->depth;
+  int color_max = header->color_max;
+  int i = 0;
+  
+  for (; i < pixels; ++i)
+  {
+    if (header->type == _MICRO_DRAW_P1)
+    {
+      // Bits do not need to be separated by whitespace
+      while (p < end && *p != '0' && *p != '1')
+      {
+        if (*p == '#')
+          while (p < end && *p != '\n') p++;
+        else if (!_micro_draw_is_whitespace(*p))
+          return -1;
+        else
+          p++;
+      }
+      if (p == end) break;
+      // In PBM 1 is black
+      dest[i] = (*p++ == '0');
+      *raster = p;
+      continue;
+    }
+
+    int value[3];
+    for (int s = 0; s < samples; ++s)
+    {
+      value[s] = _micro_draw_ppm_scan_int(&p, end);
+      if (value[s] < 0 && p == end) goto done;
+      if (value[s] < 0 || value[s] > color_max) return -1;
+      value[s] = _micro_draw_ppm_scale(value[s], color_max);
+    }
+    dest[i * 4 + 0] = value[0];
+    dest[i * 4 + 1] = value[samples == 3 ? 1 : 0];
+    dest[i * 4 + 2] = value[samples == 3 ? 2 : 0];
+    dest[i * 4 + 3] = 255;
+    *raster = p;
+  }
+ done:
+  return i;
+}
+
+#ifdef MICRO_DRAW_THREADS
+
+// ASCII rasters are split in chunks of at least this size, one for
+// each thread
+#define _MICRO_DRAW_PPM_CHUNK_MIN (64 * 1024)
+
+typedef struct {
+  const _MicroDrawPPMHeader *header;
+  const unsigned char *begin;
+  const unsigned char *end;
+  long first;                // Index of the first value in the raster
+  long count;                // Values in the chunk
+  int invalid;               // An invalid byte follows the values
+  unsigned char *dest;
+  const unsigned char *stop; // After the last decoded value
+  int error;
+} _MicroDrawPPMChunk;
+
+static inline int _micro_draw_popcount16(unsigned int x)
+{
+  x = x - ((x >> 1) & 0x5555);
+  x = (x & 0x3333) + ((x >> 2) & 0x3333);
+  x = (x + (x >> 4)) & 0x0F0F;
+  return (x + (x >> 8)) & 0x1F;
+}
+
+// Count the values in a chunk, stopping at the first invalid byte.
+// Bits of a bitmap are values even when they are not separated. The
+// SIMD code looks at 16 bytes at a time while they are only digits
+// and whitespace: a value starts at every digit after a non digit.
+static inline void _micro_draw_ppm_count_chunk(_MicroDrawPPMChunk *chunk)
+{
+  const unsigned char *p = chunk->begin;
+  const unsigned char *end = chunk->end;
+  int bits = (chunk->header->type == _MICRO_DRAW_P1);
+  unsigned char last_digit = bits ? '1' : '9';
+  long count = 0;
+  int in_value = 0;
+  
+#if defined(__SSSE3__) && !defined(MICRO_DRAW_NO_SIMD)
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i digits = _mm_set1_epi8(last_digit - '0');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i controls = _mm_set1_epi8('\r' - '\t');
+  const __m128i space = _mm_set1_epi8(' ');
+  for (; p + 16 <= end; p += 16)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    // Unsigned range checks: x - low <= high - low
+    __m128i offset = _mm_sub_epi8(bytes, zero);
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(offset, digits), offset);
+    offset = _mm_sub_epi8(bytes, tab);
+    __m128i white = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(offset, controls), offset),
+                                 _mm_cmpeq_epi8(bytes, space));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, white)) != 0xFFFF) break;
+    
+    unsigned int mask = _mm_movemask_epi8(digit);
+    unsigned int starts = bits ? mask : mask & ~((mask << 1) | in_value);
+    count += _micro_draw_popcount16(starts);
+    in_value = (mask >> 15) & 1;
+  }
+#endif
+  
+  for (; p < end; ++p)
+  {
+    if (*p == '#')
+    {
+      while (p + 1 < end && p[1] != '\n') p++;
+      in_value = 0;
+    }
+    else if (*p >= '0' && *p <= last_digit)
+    {
+      if (bits || !in_value) count++;
+      in_value = 1;
+    }
+    else if (_micro_draw_is_whitespace(*p))
+    {
+      in_value = 0;
+    }
+    else
+    {
+      chunk->invalid = 1;
+      break;
+    }
+  }
+  chunk->count = count;
+  return;
+}
+
+// Decode [chunk->count] values of a chunk, starting from value
+// [chunk->first] of the raster. Values of a pixel can be split
+// between two chunks.
+static inline void _micro_draw_ppm_decode_chunk(_MicroDrawPPMChunk *chunk)
+{
+  const _MicroDrawPPMHeader *header = chunk->header;
+  const unsigned char *p = chunk->begin;
+  const unsigned char *end = chunk->end;
+  int color_max = header->color_max;
+  
+  for (long i = chunk->first; i < chunk->first + chunk->count; ++i)
+  {
+    if (header->type == _MICRO_DRAW_P1)
+    {
+      while (p < end && *p != '0' && *p != '1')
+      {
+        if (*p == '#')
+          while (p < end && *p != '\n') p++;
+        else
+          p++;
+      }
+      if (p == end) goto error;
+      // In PBM 1 is black
+      chunk->dest[i] = (*p++ == '0');
+      continue;
+    }
+
+    int value = _micro_draw_ppm_scan_int(&p, end);
+    if (value < 0 || value > color_max) goto error;
+    value = _micro_draw_ppm_scale(value, color_max);
+    if (header->depth == 1)
+    {
+      unsigned char *px = chunk->dest + i * 4;
+      px[0] = px[1] = px[2] = value;
+      px[3] = 255;
+    }
+    else
+    {
+      unsigned char *px = chunk->dest + i / 3 * 4;
+      px[i % 3] = value;
+      if (i % 3 == 0) px[3] = 255;
+    }
+  }
+  chunk->stop = p;
+  return;
+
+ error:
+  chunk->error = 1;
+  return;
+}
+
+static void _micro_draw_ppm_count_chunks(void *context, int begin, int end)
+{
+  for (int i = begin; i < end; ++i)
+    _micro_draw_ppm_count_chunk((_MicroDrawPPMChunk*)context + i);
+  return;
+}
+
+static void _micro_draw_ppm_decode_chunks(void *context, int begin, int end)
+{
+  for (int i = begin; i < end; ++i)
+    _micro_draw_ppm_decode_chunk((_MicroDrawPPMChunk*)context + i);
+  return;
+}
+
+// Find where a chunk can start near [target]: at a newline, or at a
+// whitespace outside of comments when lines are too long. A comment
+// around [target] moves it to the end of the line, up to [end].
+// Returns [prev] if there is none before [limit].
+static inline const unsigned char *
+_micro_draw_ppm_chunk_boundary(int bits, const unsigned char *prev,
+                               const unsigned char *target,
+                               const unsigned char *limit,
+                               const unsigned char *end)
+{
+  for (const unsigned char *p = target; p < limit; ++p)
+    if (*p == '\n') return p;
+  
+  for (const unsigned char *p = target; p > prev && p[-1] != '\n'; --p)
+    if (p[-1] == '#')
+    {
+      while (target < end && *target != '\n') target++;
+      return target;
+    }
+  if (bits) return target;
+  for (const unsigned char *p = target; p < limit; ++p)
+  {
+    // A comment ends the value before it, like a whitespace
+    if (*p == '#' || _micro_draw_is_whitespace(*p)) return p;
+  }
+  return prev;
+}
+
+// Decode an ASCII raster on many threads. Every chunk counts its
+// values, the prefix sum of the counts gives the first value of each
+// chunk, then the chunks are decoded. Same results as
+// _micro_draw_ppm_decode_ascii.
+static inline int
+_micro_draw_ppm_decode_ascii_parallel(const _MicroDrawPPMHeader *header,
+                                      const unsigned char **raster,
+                                      const unsigned char *end,
+                                      unsigned char *dest, int pixels)
+{
+  long size = end - *raster;
+  int count = _micro_draw_min(size / _MICRO_DRAW_PPM_CHUNK_MIN, MICRO_DRAW_THREADS);
+  if (count < 2)
+    return _micro_draw_ppm_decode_ascii(header, raster, end, dest, pixels);
+  
+  int bits = (header->type == _MICRO_DRAW_P1);
+  _MicroDrawPPMChunk chunks[MICRO_DRAW_THREADS];
+  const unsigned char *begin = *raster;
+  const unsigned char *start = begin;
+  for (int i = 0; i < count; ++i)
+  {
+    const unsigned char *stop = end;
+    if (i + 1 < count)
+    {
+      // The previous chunk can end past the target of this one
+      const unsigned char *target = begin + size / count * (i + 1);
+      const unsigned char *limit = begin + size / count * (i + 2);
+      target = (target < start) ? start : target;
+      limit = (limit < target) ? target : limit;
+      stop = _micro_draw_ppm_chunk_boundary(bits, start, target, limit, end);
+    }
+    chunks[i] = (_MicroDrawPPMChunk) { .header = header, .begin = start,
+                                       .end = stop, .dest = dest };
+    start = stop;
+  }
+  MICRO_DRAW_PARALLEL_FOR(count, 1, _micro_draw_ppm_count_chunks, chunks);
+
+  // Prefix sum, up to the chunk with the last value of the image
+  long values = (long)pixels * (bits ? 1 : header->depth);
+  long first = 0;
+  int last = 0;
+  for (; last < count; ++last)
+  {
+    chunks[last].first = first;
+    if (first + chunks[last].count >= values) break;
+    if (chunks[last].invalid) return -1;
+    first += chunks[last].count;
+  }
+  if (last == count) return first / (values / pixels);
+  chunks[last].count = values - chunks[last].first;
+
+  MICRO_DRAW_PARALLEL_FOR(last + 1, 1, _micro_draw_ppm_decode_chunks, chunks);
+  for (int i = 0; i <= last; ++i)
+    if (chunks[i].error) return -1;
+  *raster = chunks[last].stop;
+  return pixels;
+}
+
+#endif // MICRO_DRAW_THREADS
+
+// Decode all the [pixels] of an ASCII raster
+static inline int
+_micro_draw_ppm_decode_ascii_all(const _MicroDrawPPMHeader *header,
+                                 const unsigned char **raster,
+                                 const unsigned char *end,
+                                 unsigned char *dest, int pixels)
+{
+#ifdef MICRO_DRAW_THREADS
+  return _micro_draw_ppm_decode_ascii_parallel(header, raster, end, dest, pixels);
+#else
+  return _micro_draw_ppm_decode_ascii(header, raster, end, dest, pixels);
+#endif
+}
+
+// Expand [pixels] RGB8 pixels to opaque RGBA8. The conversion can be
+// done in place if [src] is [dest] + [pixels].
+static inline void
+_micro_draw_rgb8_to_rgba8(const unsigned char *src, unsigned char *dest,
+                          int pixels)
+{
+  int i = 0;
+#if defined(__SSSE3__) && !defined(MICRO_DRAW_NO_SIMD)
+  const __m128i shuffle =
+    _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+  // 16 bytes are loaded for 4 pixels: stop early enough to neither
+  // read past the source nor overwrite source pixels not loaded yet
+  for (; i + 6 <= pixels; i += 4)
+  {
+    __m128i rgb = _mm_loadu_si128((const __m128i*)(src + i * 3));
+    __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha);
+    _mm_storeu_si128((__m128i*)(dest + i * 4), rgba);
+  }
+#endif
+  for (; i < pixels; ++i)
+  {
+    unsigned char r = src[i * 3 + 0];
+    unsigned char g = src[i * 3 + 1];
+    unsigned char b = src[i * 3 + 2];
+    dest[i * 4 + 0] = r;
+    dest[i * 4 + 1] = g;
+    dest[i * 4 + 2] = b;
+    dest[i * 4 + 3] = 255;
+  }
+  return;
+}
+
+// Decode the binary raster of [header] from [input] into [dest], sized
+// for the pixel format of the header. Samples of 8 bits are read
+// with a single read directly in [dest] and expanded in place, PAM
+// RGBA with a max value of 255 needs no expansion at all.
+static inline MicroDrawError
+_micro_draw_ppm_read_binary(_MicroDrawPPMInput *input,
+                            const _MicroDrawPPMHeader *header,
+                            unsigned char *dest)
+{
+  int pixels = header->width * header->height;
+  int samples = header->depth;
+  int color_max = header->color_max;
+  // Samples 2 and 4 are alpha
+  int has_alpha = (samples == 2 || samples == 4);
+
+  if (header->pixel == MICRO_DRAW_BLACK_WHITE && header->type == _MICRO_DRAW_P7)
+  {
+    // One byte per pixel, 1 is white
+    if (!_micro_draw_ppm_read(input, dest, (size_t)pixels))
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    for (int i = 0; i < pixels; ++i)
+      dest[i] = (dest[i] != 0);
+    return MICRO_DRAW_OK;
+  }
+
+  if (header->type == _MICRO_DRAW_P4)
+  {
+    // Rows are padded to a byte, expanded backwards from the start
+    int stride = (header->width + 7) / 8;
+    if (!_micro_draw_ppm_read(input, dest, (size_t)stride * header->height))
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    for (int row = header->height - 1; row >= 0; --row)
+    {
+      for (int col = header->width - 1; col >= 0; --col)
+      {
+        unsigned char bits = dest[row * stride + col / 8];
+        // In PBM 1 is black
+        dest[row * header->width + col] = !(bits & (0x80 >> (col & 7)));
+      }
+    }
+    return MICRO_DRAW_OK;
+  }
+
+  if (color_max > 255)
+  {
+    // Two big endian bytes per sample, which do not fit in [dest]
+    unsigned char *wide = MICRO_DRAW_MALLOC((size_t)pixels * samples * 2);
+    if (wide == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+    if (!_micro_draw_ppm_read(input, wide, (size_t)pixels * samples * 2))
+    {
+      MICRO_DRAW_FREE(wide);
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    }
+    for (int i = 0; i < pixels; ++i)
+    {
+      for (int c = 0; c < 4; ++c)
+      {
+        int s = (samples >= 3) ? c : 0;
+        if (c == 3)
+        {
+          if (!has_alpha)
+          {
+            dest[i * 4 + 3] = 255;
+            break;
+          }
+          s = samples - 1;
+        }
+        unsigned int value = (wide[(i * samples + s) * 2] << 8)
+          | wide[(i * samples + s) * 2 + 1];
+        if (value > (unsigned int)color_max) value = color_max;
+        dest[i * 4 + c] = _micro_draw_ppm_scale(value, (unsigned int)color_max);
+      }
+    }
+    MICRO_DRAW_FREE(wide);
+    return MICRO_DRAW_OK;
+  }
+
+  // Read at the end of the data, then expand forward
+  unsigned char *raster = dest + (size_t)pixels * (4 - samples);
+  if (!_micro_draw_ppm_read(input, raster, (size_t)pixels * samples))
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+  if (samples == 3)
+  {
+    _micro_draw_rgb8_to_rgba8(raster, dest, pixels);
+  }
+  else if (samples == 2)
+  {
+    for (int i = 0; i < pixels; ++i)
+    {
+      unsigned char gray = raster[i * 2];
+      unsigned char alpha = raster[i * 2 + 1];
+      dest[i * 4 + 0] = gray;
+      dest[i * 4 + 1] = gray;
+      dest[i * 4 + 2] = gray;
+      dest[i * 4 + 3] = alpha;
+    }
+  }
+  else if (samples == 1)
+  {
+    for (int i = 0; i < pixels; ++i)
+    {
+      unsigned char gray = raster[i];
+      dest[i * 4 + 0] = gray;
+      dest[i * 4 + 1] = gray;
+      dest[i * 4 + 2] = gray;
+      dest[i * 4 + 3] = 255;
+    }
+  }
+
+  if (color_max != 255)
+  {
+    unsigned char scale[256];
+    for (int v = 0; v < 256; ++v)
+      scale[v] = _micro_draw_ppm_scale(_micro_draw_min(v, color_max), color_max);
+    for (int i = 0; i < pixels; ++i)
+    {
+      dest[i * 4 + 0] = scale[dest[i * 4 + 0]];
+      dest[i * 4 + 1] = scale[dest[i * 4 + 1]];
+      dest[i * 4 + 2] = scale[dest[i * 4 + 2]];
+      if (has_alpha)
+        dest[i * 4 + 3] = scale[dest[i * 4 + 3]];
+    }
+  }
+  return MICRO_DRAW_OK;
+}
+
+// Decode a whole image from [input]
+static inline MicroDrawError
+_micro_draw_from_ppm_input(_MicroDrawPPMInput *input, unsigned char **data,
+                           int *data_width, int *data_height,
+                           MicroDrawPixel *pixel)
+{
+  _MicroDrawPPMHeader header;
+  MicroDrawError error = _micro_draw_ppm_read_header(input, &header);
+  if (error != MICRO_DRAW_OK) return error;
+
+  *pixel = header.pixel;
+  *data_width = header.width;
+  *data_height = header.height;
+  int pixels = header.width * header.height;
+  *data = MICRO_DRAW_MALLOC((size_t)pixels * micro_draw_get_channels(*pixel)
+                            * micro_draw_get_channel_size(*pixel));
+  if (*data == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+
+  if (header.type >= _MICRO_DRAW_P4)
+  {
+    error = _micro_draw_ppm_read_binary(input, &header, *data);
+  }
+  else if (input->file == NULL && input->fd < 0)
+  {
+    // Parse the buffer without copying it
+    const unsigned char *p = input->buffer + input->position;
+    const unsigned char *end = input->buffer + input->size;
+    if (_micro_draw_ppm_decode_ascii_all(&header, &p, end, *data, pixels) != pixels)
+      error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+    input->position = p - input->buffer;
+  }
+  else
+  {
+    unsigned char *raster;
+    long raster_size;
+    error = _micro_draw_read_all(input, &raster, &raster_size);
+    if (error == MICRO_DRAW_OK)
+    {
+      const unsigned char *p = raster;
+      if (_micro_draw_ppm_decode_ascii_all(&header, &p, raster + raster_size,
+                                           *data, pixels) != pixels)
+        error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+      MICRO_DRAW_FREE(raster);
+    }
+  }
+
+  if (error != MICRO_DRAW_OK)
+  {
+    MICRO_DRAW_FREE(*data);
+    *data = NULL;
+  }
+  return error;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_from_to_ppm");
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm(const char* filename, unsigned char **data,
+                    int *data_width, int *data_height, MicroDrawPixel *pixel)
+{
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+
+  MicroDrawError error =
+    micro_draw_from_ppm_file(file, data, data_width, data_height, pixel);
+  
+  fclose(file);
+  return error;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_file(FILE *file, unsigned char **data,
+                         int *data_width, int *data_height, MicroDrawPixel *pixel)
+{
+  _MicroDrawPPMInput input = { .file = file, .fd = -1 };
+  return _micro_draw_from_ppm_input(&input, data, data_width, data_height, pixel);
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_memory(const unsigned char *buffer, size_t size,
+                           unsigned char **data, int *data_width,
+                           int *data_height, MicroDrawPixel *pixel)
+{
+  _MicroDrawPPMInput input = { .fd = -1, .buffer = buffer, .size = size };
+  return _micro_draw_from_ppm_input(&input, data, data_width, data_height, pixel);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_ppm_fd(int fd, unsigned char **data,
+                       int *data_width, int *data_height, MicroDrawPixel *pixel)
+{
+  _MicroDrawPPMInput input = { .fd = fd };
+  return _micro_draw_from_ppm_input(&input, data, data_width, data_height, pixel);
+}
+
+#endif // __unix__ || __APPLE__
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_begin(MicroDrawPPMWriter *writer, const char *filename,
+                            int data_width, int data_height, MicroDrawPixel pixel)
+{
+  writer->width = data_width;
+  writer->height = data_height;
+  writer->pixel = pixel;
+  writer->rows_written = 0;
+  writer->_staging = NULL;
+  writer->_staging_rows = 0;
+  
+  int row_size = _micro_draw_ppm_row_size(pixel, data_width);
+  if (data_width <= 0 || data_height <= 0 || row_size <= 0)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  
+  writer->file = fopen(filename, "wb");
+  if (writer->file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+  _MicroDrawPPMOutput output = { .file = writer->file, .fd = -1 };
+  MicroDrawError error =
+    _micro_draw_ppm_write_header(&output, data_width, data_height, pixel);
+
+  if (error == MICRO_DRAW_OK
+      && pixel != MICRO_DRAW_RGB8 && pixel != MICRO_DRAW_GRAY8)
+  {
+    writer->_staging_rows =
+      _micro_draw_max(1, _MICRO_DRAW_PPM_STAGING_SIZE / row_size);
+    writer->_staging =
+      MICRO_DRAW_MALLOC((size_t)writer->_staging_rows * row_size);
+    if (writer->_staging == NULL)
+      error = MICRO_DRAW_ERROR_ALLOCATION;
+  }
+  
+  if (error != MICRO_DRAW_OK)
+  {
+    fclose(writer->file);
+    writer->file = NULL;
+  }
+  return error;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_write_rows(MicroDrawPPMWriter *writer, unsigned char *rows,
+                                 int rows_count)
+{
+  if (writer->rows_written + rows_count > writer->height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  
+  int row_size = _micro_draw_ppm_row_size(writer->pixel, writer->width);
+  if (writer->_staging == NULL)
+  {
+    // Already in the layout of the file
+    if (fwrite(rows, row_size, rows_count, writer->file) != (size_t)rows_count)
+      return MICRO_DRAW_ERROR_WRITE_FILE;
+    writer->rows_written += rows_count;
+    return MICRO_DRAW_OK;
+  }
+
+  int pixel_size = micro_draw_get_channels(writer->pixel)
+    * micro_draw_get_channel_size(writer->pixel);
+  for (int row = 0; row < rows_count; row += writer->_staging_rows)
+  {
+    int chunk = _micro_draw_min(writer->_staging_rows, rows_count - row);
+    _micro_draw_ppm_encode_rows(rows + (size_t)row * writer->width * pixel_size,
+                                writer->width, chunk, writer->pixel, 0,
+                                writer->_staging);
+    if (fwrite(writer->_staging, row_size, chunk, writer->file) != (size_t)chunk)
+      return MICRO_DRAW_ERROR_WRITE_FILE;
+    writer->rows_written += chunk;
+  }
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_writer_end(MicroDrawPPMWriter *writer)
+{
+  MicroDrawError error = MICRO_DRAW_OK;
+  if (writer->rows_written != writer->height)
+    error = MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  if (writer->file != NULL && fclose(writer->file) != 0 && error == MICRO_DRAW_OK)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
+  MICRO_DRAW_FREE(writer->_staging);
+  writer->_staging = NULL;
+  writer->file = NULL;
+  return error;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_reader_begin(MicroDrawPPMReader *reader, const char *filename)
+{
+  reader->rows_read = 0;
+  reader->_buffer = NULL;
+  reader->_buffer_start = 0;
+  reader->_buffer_end = 0;
+  reader->_buffer_complete = 0;
+  reader->_buffer_capacity = 0;
+  
+  reader->file = fopen(filename, "rb");
+  if (reader->file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+  
+  _MicroDrawPPMInput input = { .file = reader->file, .fd = -1 };
+  _MicroDrawPPMHeader header;
+  MicroDrawError error = _micro_draw_ppm_read_header(&input, &header);
+  if (error != MICRO_DRAW_OK)
+  {
+    fclose(reader->file);
+    reader->file = NULL;
+    return error;
+  }
+  reader->width = header.width;
+  reader->height = header.height;
+  reader->pixel = header.pixel;
+  reader->_type = header.type;
+  reader->_color_max = header.color_max;
+  reader->_depth = header.depth;
+  return MICRO_DRAW_OK;
+}
+
+// Read more of the ASCII raster in the reader buffer, keeping the
+// unparsed bytes. The complete values end at the last newline or
+// whitespace, unless the file has ended.
+static inline MicroDrawError
+_micro_draw_ppm_reader_fill(MicroDrawPPMReader *reader)
+{
+  int pending = reader->_buffer_end - reader->_buffer_start;
+  for (int i = 0; i < pending; ++i)
+    reader->_buffer[i] = reader->_buffer[reader->_buffer_start + i];
+  reader->_buffer_start = 0;
+  reader->_buffer_end = pending;
+
+  if (reader->_buffer_capacity - pending < (1 << 15))
+  {
+    int capacity = (reader->_buffer_capacity == 0) ? (1 << 16)
+      : reader->_buffer_capacity * 2;
+    unsigned char *buffer = MICRO_DRAW_REALLOC(reader->_buffer, capacity);
+    if (buffer == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+    reader->_buffer = buffer;
+    reader->_buffer_capacity = capacity;
+  }
+
+  reader->_buffer_end += fread(reader->_buffer + pending, 1,
+                               reader->_buffer_capacity - pending, reader->file);
+  if (feof(reader->file) || ferror(reader->file))
+  {
+    reader->_buffer_complete = reader->_buffer_end;
+    return MICRO_DRAW_OK;
+  }
+
+  // Values and comments do not continue past a newline
+  int end = reader->_buffer_end;
+  while (end > 0 && reader->_buffer[end - 1] != '\n') end--;
+  if (end == 0)
+  {
+    end = reader->_buffer_end;
+    while (end > 0 && !_micro_draw_is_whitespace(reader->_buffer[end - 1])) end--;
+  }
+  reader->_buffer_complete = end;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_reader_read_rows(MicroDrawPPMReader *reader, unsigned char *rows,
+                                int rows_count)
+{
+  if (reader->file == NULL) return MICRO_DRAW_ERROR_OPEN_FILE;
+  if (reader->rows_read + rows_count > reader->height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+
+  _MicroDrawPPMHeader header = {
+    .type = reader->_type,
+    .width = reader->width,
+    .height = rows_count,
+    .color_max = reader->_color_max,
+    .depth = reader->_depth,
+    .pixel = reader->pixel,
+  };
+  
+  if (header.type >= _MICRO_DRAW_P4)
+  {
+    _MicroDrawPPMInput input = { .file = reader->file, .fd = -1 };
+    MicroDrawError error = _micro_draw_ppm_read_binary(&input, &header, rows);
+    if (error == MICRO_DRAW_OK)
+      reader->rows_read += rows_count;
+    return error;
+  }
+
+  int pixel_size = micro_draw_get_channels(reader->pixel)
+    * micro_draw_get_channel_size(reader->pixel);
+  int pixels = reader->width * rows_count;
+  int decoded = 0;
+  while (decoded < pixels)
+  {
+    const unsigned char *start = reader->_buffer + reader->_buffer_start;
+    const unsigned char *p = start;
+    int count = 0;
+    if (reader->_buffer != NULL)
+      count = _micro_draw_ppm_decode_ascii(&header, &p,
+                                           reader->_buffer + reader->_buffer_complete,
+                                           rows + (size_t)decoded * pixel_size,
+                                           pixels - decoded);
+    if (count < 0) return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    decoded += count;
+    reader->_buffer_start += p - start;
+    if (decoded == pixels) break;
+
+    if (reader->_buffer != NULL
+        && reader->_buffer_complete == reader->_buffer_end
+        && (feof(reader->file) || ferror(reader->file)))
+      return MICRO_DRAW_ERROR_INVALID_FORMAT;
+    MicroDrawError error = _micro_draw_ppm_reader_fill(reader);
+    if (error != MICRO_DRAW_OK) return error;
+  }
+  reader->rows_read += rows_count;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_ppm_reader_end(MicroDrawPPMReader *reader)
+{
+  if (reader->file != NULL)
+    fclose(reader->file);
+  MICRO_DRAW_FREE(reader->_buffer);
+  reader->file = NULL;
+  reader->_buffer = NULL;
+  return;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_ppm_map(const char *filename, MicroDrawSurface *surface)
+{
+  // Parse the header with the stdio reader, to know where the
+  // raster starts
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+  _MicroDrawPPMInput input = { .file = file, .fd = -1 };
+  _MicroDrawPPMHeader header;
+  MicroDrawError error = _micro_draw_ppm_read_header(&input, &header);
+  long offset = ftell(file);
+  fclose(file);
+  if (error != MICRO_DRAW_OK) return error;
+
+  MicroDrawPixel pixel;
+  if (header.type == _MICRO_DRAW_P6 && header.color_max == 255)
+    pixel = MICRO_DRAW_RGB8;
+  else if (header.type == _MICRO_DRAW_P5 && header.color_max == 255)
+    pixel = MICRO_DRAW_GRAY8;
+  else if (header.type == _MICRO_DRAW_P5 && header.color_max == 1)
+    pixel = MICRO_DRAW_BLACK_WHITE;
+  else if (header.type == _MICRO_DRAW_P7
+           && (header.color_max == 255 || header.pixel == MICRO_DRAW_BLACK_WHITE))
+  {
+    switch(header.depth)
+    {
+    case 4: pixel = MICRO_DRAW_RGBA8; break;
+    case 3: pixel = MICRO_DRAW_RGB8; break;
+    case 1:
+      pixel = (header.pixel == MICRO_DRAW_BLACK_WHITE)
+        ? MICRO_DRAW_BLACK_WHITE : MICRO_DRAW_GRAY8;
+      break;
+    default: return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+    }
+  }
+  else
+    return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+
+  int stride = header.width * micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+  
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || offset < 0
+      || (size_t)file_stat.st_size < (size_t)offset + (size_t)stride * header.height)
+  {
+    close(fd);
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+  }
+  
+  // The whole file is mapped since the offset of a mapping must be
+  // page aligned
+  void *mapping = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    perror("Error mapping file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
+
+  surface->data = (unsigned char*)mapping + offset;
+  surface->width = header.width;
+  surface->height = header.height;
+  surface->stride = stride;
+  surface->pixel = pixel;
+  surface->damage = NULL;
+  surface->lazy_clear = NULL;
+  surface->_mapping = mapping;
+  surface->_mapping_size = file_stat.st_size;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF void
+micro_draw_ppm_unmap(MicroDrawSurface *surface)
+{
+  if (surface->_mapping != NULL)
+    munmap(surface->_mapping, surface->_mapping_size);
+  surface->_mapping = NULL;
+  surface->_mapping_size = 0;
+  surface->data = NULL;
+  return;
+}
+
+#endif // __unix__ || __APPLE__
+
+#endif // MICRO_DRAW_PPM
+
+#ifdef MICRO_DRAW_QOI
+
+#include <stdio.h> // fopen
+
+// A QOI file has a 14 bytes header:
+//   magic "qoif", width and height as big endian 32 bit integers,
+//   channels (3 or 4) and colorspace (0 sRGB, 1 linear)
+// followed by a stream of chunks and 7 zero bytes and a one. Each
+// pixel is encoded as either a run of the previous pixel, an index
+// in a table of 64 recently seen pixels, a small difference from the
+// previous pixel or the full value.
+//
+// More info: https://qoiformat.org/qoi-specification.pdf
+
+#define _MICRO_DRAW_QOI_HEADER_SIZE 14
+#define _MICRO_DRAW_QOI_PADDING_SIZE 8
+
+#define _MICRO_DRAW_QOI_OP_INDEX 0x00 // 00xxxxxx
+#define _MICRO_DRAW_QOI_OP_DIFF  0x40 // 01xxxxxx
+#define _MICRO_DRAW_QOI_OP_LUMA  0x80 // 10xxxxxx
+#define _MICRO_DRAW_QOI_OP_RUN   0xc0 // 11xxxxxx
+#define _MICRO_DRAW_QOI_OP_RGB   0xfe
+#define _MICRO_DRAW_QOI_OP_RGBA  0xff
+#define _MICRO_DRAW_QOI_MASK     0xc0
+
+// Pixels are packed as r | g << 8 | b << 16 | a << 24
+#define _micro_draw_qoi_pack(r, g, b, a)                                \
+  ((unsigned int)(r) | (unsigned int)(g) << 8                           \
+   | (unsigned int)(b) << 16 | (unsigned int)(a) << 24)
+
+static inline int _micro_draw_qoi_hash(unsigned int px)
+{
+  unsigned int r = px & 0xFF, g = (px >> 8) & 0xFF;
+  unsigned int b = (px >> 16) & 0xFF, a = px >> 24;
+  return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+}
+
+static inline void
+_micro_draw_qoi_write_u32(unsigned char *dest, unsigned int value)
+{
+  dest[0] = value >> 24;
+  dest[1] = value >> 16;
+  dest[2] = value >> 8;
+  dest[3] = value;
+  return;
+}
+
+static inline unsigned int
+_micro_draw_qoi_read_u32(const unsigned char *src)
+{
+  return (unsigned int)src[0] << 24 | (unsigned int)src[1] << 16
+    | (unsigned int)src[2] << 8 | src[3];
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update _micro_draw_qoi_load");
+// Pixel [i] of [data] as RGBA
+static inline unsigned int
+_micro_draw_qoi_load(const unsigned char *data, int i, MicroDrawPixel pixel)
+{
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:
+    return _micro_draw_qoi_pack(data[i * 4], data[i * 4 + 1],
+                                data[i * 4 + 2], data[i * 4 + 3]);
+  case MICRO_DRAW_RGB8:
+    return _micro_draw_qoi_pack(data[i * 3], data[i * 3 + 1],
+                                data[i * 3 + 2], 255);
+  case MICRO_DRAW_GRAY8:
+    return _micro_draw_qoi_pack(data[i], data[i], data[i], 255);
+  case MICRO_DRAW_BLACK_WHITE:
+    return data[i] ? 0xFFFFFFFF : _micro_draw_qoi_pack(0, 0, 0, 255);
+  default:
+    break;
+  }
+  return 0;
+}
+
+MICRO_DRAW_DEF size_t
+micro_draw_qoi_max_size(int data_width, int data_height, MicroDrawPixel pixel)
+{
+  if (data_width <= 0 || data_height <= 0
+      || (int)pixel < 0 || pixel >= _MICRO_DRAW_PIXEL_MAX)
+    return 0;
+  // The worst case is a full RGB or RGBA chunk for every pixel
+  int channels = (pixel == MICRO_DRAW_RGBA8) ? 4 : 3;
+  return (size_t)data_width * data_height * (channels + 1)
+    + _MICRO_DRAW_QOI_HEADER_SIZE + _MICRO_DRAW_QOI_PADDING_SIZE;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_qoi_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel)
+{
+  *size = 0;
+  size_t max_size = micro_draw_qoi_max_size(data_width, data_height, pixel);
+  if (max_size == 0) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  int channels = (pixel == MICRO_DRAW_RGBA8) ? 4 : 3;
+  if (capacity < _MICRO_DRAW_QOI_HEADER_SIZE + _MICRO_DRAW_QOI_PADDING_SIZE)
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  size_t end = capacity - _MICRO_DRAW_QOI_PADDING_SIZE;
+  
+  unsigned char *p = buffer;
+  p[0] = 'q';
+  p[1] = 'o';
+  p[2] = 'i';
+  p[3] = 'f';
+  _micro_draw_qoi_write_u32(p + 4, data_width);
+  _micro_draw_qoi_write_u32(p + 8, data_height);
+  p[12] = channels;
+  p[13] = 0;
+  p += _MICRO_DRAW_QOI_HEADER_SIZE;
+
+  unsigned int index[64] = {0};
+  unsigned int prev = _micro_draw_qoi_pack(0, 0, 0, 255);
+  int run = 0;
+  int pixels = data_width * data_height;
+  for (int i = 0; i < pixels; ++i)
+  {
+    // Each pixel writes at most [channels] + 1 bytes, and the run
+    // before it
+    if ((size_t)(p - buffer) + channels + 1 + (run > 0) > end)
+      return MICRO_DRAW_ERROR_WRITE_FILE;
+    
+    unsigned int px = _micro_draw_qoi_load(data, i, pixel);
+    if (px == prev)
+    {
+      run++;
+      if (run == 62)
+      {
+        *p++ = _MICRO_DRAW_QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+      continue;
+    }
+    if (run > 0)
+    {
+      *p++ = _MICRO_DRAW_QOI_OP_RUN | (run - 1);
+      run = 0;
+    }
+
+    int hash = _micro_draw_qoi_hash(px);
+    if (index[hash] == px)
+    {
+      *p++ = _MICRO_DRAW_QOI_OP_INDEX | hash;
+      prev = px;
+      continue;
+    }
+    index[hash] = px;
+
+    if ((px >> 24) == (prev >> 24))
+    {
+      // Differences wrap around, as the decoder
+      signed char vr = (signed char)((px & 0xFF) - (prev & 0xFF));
+      signed char vg = (signed char)(((px >> 8) & 0xFF) - ((prev >> 8) & 0xFF));
+      signed char vb = (signed char)(((px >> 16) & 0xFF) - ((prev >> 16) & 0xFF));
+      int vg_r = vr - vg;
+      int vg_b = vb - vg;
+      if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+      {
+        *p++ = _MICRO_DRAW_QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+      }
+      else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32
+               && vg_b > -9 && vg_b < 8)
+      {
+        *p++ = _MICRO_DRAW_QOI_OP_LUMA | (vg + 32);
+        *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+      }
+      else
+      {
+        *p++ = _MICRO_DRAW_QOI_OP_RGB;
+        *p++ = px;
+        *p++ = px >> 8;
+        *p++ = px >> 16;
+      }
+    }
+    else
+    {
+      *p++ = _MICRO_DRAW_QOI_OP_RGBA;
+      *p++ = px;
+      *p++ = px >> 8;
+      *p++ = px >> 16;
+      *p++ = px >> 24;
+    }
+    prev = px;
+  }
+
+  if ((size_t)(p - buffer) + (run > 0) + _MICRO_DRAW_QOI_PADDING_SIZE > capacity)
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  if (run > 0)
+    *p++ = _MICRO_DRAW_QOI_OP_RUN | (run - 1);
+  for (int i = 0; i < _MICRO_DRAW_QOI_PADDING_SIZE - 1; ++i)
+    *p++ = 0;
+  *p++ = 1;
+  *size = p - buffer;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_qoi_memory(const unsigned char *buffer, size_t size,
+                           unsigned char **data, int *data_width,
+                           int *data_height, MicroDrawPixel *pixel)
+{
+  *data = NULL;
+  if (size < 4 || buffer[0] != 'q' || buffer[1] != 'o' || buffer[2] != 'i'
+      || buffer[3] != 'f')
+    return MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER;
+  if (size < _MICRO_DRAW_QOI_HEADER_SIZE + _MICRO_DRAW_QOI_PADDING_SIZE)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+
+  unsigned int width = _micro_draw_qoi_read_u32(buffer + 4);
+  unsigned int height = _micro_draw_qoi_read_u32(buffer + 8);
+  int channels = buffer[12];
+  if (width == 0 || height == 0 || width > 0x7FFFFFFF / 4 / height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  if (channels != 3 && channels != 4)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
+
+  int pixels = width * height;
+  *data = MICRO_DRAW_MALLOC((size_t)pixels * channels);
+  if (*data == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  *data_width = width;
+  *data_height = height;
+  *pixel = (channels == 4) ? MICRO_DRAW_RGBA8 : MICRO_DRAW_RGB8;
+
+  const unsigned char *p = buffer + _MICRO_DRAW_QOI_HEADER_SIZE;
+  const unsigned char *end = buffer + size - _MICRO_DRAW_QOI_PADDING_SIZE;
+  unsigned char *dest = *data;
+  unsigned int index[64] = {0};
+  unsigned char r = 0, g = 0, b = 0, a = 255;
+  int run = 0;
+  for (int i = 0; i < pixels; ++i)
   {
-    // Iterate by columns
-    for (int p_x = start; p_x < end; ++p_x)
+    if (run > 0)
     {
-      int p_y = m * p_x + q;
-      // Retranspose the image
-      micro_draw_pixel(data, data_width, data_height,
-                       p_y, p_x, color, pixel);
+      run--;
     }
-  }
-  else
-  {
-    // Transposed
-    for (int p_x = start; p_x < end; ++p_x)
+    else
     {
-      int p_y = m * p_x + q;
-      micro_draw_pixel(data, data_width, data_height,
-                       p_x, p_y, color, pixel);
+      if (p >= end) goto invalid;
+      int op = *p++;
+      // Bytes that follow the op
+      int follow = (op == _MICRO_DRAW_QOI_OP_RGB) ? 3
+        : (op == _MICRO_DRAW_QOI_OP_RGBA) ? 4
+        : ((op & _MICRO_DRAW_QOI_MASK) == _MICRO_DRAW_QOI_OP_LUMA) ? 1 : 0;
+      if (end - p < follow) goto invalid;
+      if (op == _MICRO_DRAW_QOI_OP_RGB)
+      {
+        r = p[0];
+        g = p[1];
+        b = p[2];
+        p += 3;
+      }
+      else if (op == _MICRO_DRAW_QOI_OP_RGBA)
+      {
+        r = p[0];
+        g = p[1];
+        b = p[2];
+        a = p[3];
+        p += 4;
+      }
+      else if ((op & _MICRO_DRAW_QOI_MASK) == _MICRO_DRAW_QOI_OP_INDEX)
+      {
+        unsigned int px = index[op];
+        r = px;
+        g = px >> 8;
+        b = px >> 16;
+        a = px >> 24;
+      }
+      else if ((op & _MICRO_DRAW_QOI_MASK) == _MICRO_DRAW_QOI_OP_DIFF)
+      {
+        r += ((op >> 4) & 0x03) - 2;
+        g += ((op >> 2) & 0x03) - 2;
+        b += (op & 0x03) - 2;
+      }
+      else if ((op & _MICRO_DRAW_QOI_MASK) == _MICRO_DRAW_QOI_OP_LUMA)
+      {
+        int vg = (op & 0x3f) - 32;
+        int next = *p++;
+        r += vg - 8 + ((next >> 4) & 0x0f);
+        g += vg;
+        b += vg - 8 + (next & 0x0f);
+      }
+      else
+      {
+        run = op & 0x3f;
+      }
+      unsigned int px = _micro_draw_qoi_pack(r, g, b, a);
+      index[_micro_draw_qoi_hash(px)] = px;
     }
+
+    dest[0] = r;
+    dest[1] = g;
+    dest[2] = b;
+    if (channels == 4) dest[3] = a;
+    dest += channels;
   }
-  
-  return;
+  return MICRO_DRAW_OK;
+
+ invalid:
+  MICRO_DRAW_FREE(*data);
+  *data = NULL;
+  return MICRO_DRAW_ERROR_INVALID_FORMAT;
 }
 
-MICRO_DRAW_DEF void
-micro_draw_clear(unsigned char* data, int data_width, int data_height,
-                 unsigned char *color, MicroDrawPixel pixel)
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_qoi(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel)
 {
-  for (int row = 0; row < data_height; ++row)
-    for (int col = 0; col < data_width; ++col)
-      micro_draw_pixel(data, data_width, data_height,
-                       col, row, color, pixel);
+  size_t capacity = micro_draw_qoi_max_size(data_width, data_height, pixel);
+  if (capacity == 0) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  unsigned char *buffer = MICRO_DRAW_MALLOC(capacity);
+  if (buffer == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+
+  size_t size;
+  MicroDrawError error = micro_draw_to_qoi_memory(buffer, capacity, &size, data,
+                                                  data_width, data_height, pixel);
+  if (error != MICRO_DRAW_OK) goto done;
+
+  FILE* file = fopen(filename, "wb");
+  if (file == NULL)
+  {
+    perror("Error opening file");
+    error = MICRO_DRAW_ERROR_OPEN_FILE;
+    goto done;
+  }
+  if (fwrite(buffer, 1, size, file) != size)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
+  if (fclose(file) != 0 && error == MICRO_DRAW_OK)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
+  
+ done:
+  MICRO_DRAW_FREE(buffer);
+  return error;
 }
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "MicroDrawPixel has changed, make sure that color_dest in micro_draw_overlap is enough");
-MICRO_DRAW_DEF void
-micro_draw_overlap(unsigned char* src_data, int src_data_width,
-                   int src_data_height, MicroDrawPixel src_pixel,
-                   unsigned char* dest_data, int dest_data_width,
-                   int dest_data_height, MicroDrawPixel dest_pixel,
-                   int x_offset, int y_offset)
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_from_qoi(const char *filename, unsigned char **data,
+                    int *data_width, int *data_height, MicroDrawPixel *pixel)
 {
-  int channel_size = micro_draw_get_channel_size(src_pixel); // bytes
-  unsigned int channels = micro_draw_get_channels(src_pixel);
-
-  for (int row = 0; row < src_data_height; ++row)
+  MicroDrawError error = MICRO_DRAW_OK;
+  unsigned char *buffer = NULL;
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
   {
-    for (int col = 0; col < src_data_width; ++col)
-    {
-      if (row < 0 || col < 0) continue;
+    perror("Error opening file");
+    return MICRO_DRAW_ERROR_OPEN_FILE;
+  }
 
-      int index = (row * src_data_width + col) * channels * channel_size;
-      unsigned char color_dest[4] = {0}; // 4 is enough for now
-      micro_draw_color_convert(src_data + index, src_pixel,
-                               color_dest, dest_pixel);
-      micro_draw_pixel(dest_data, dest_data_width, dest_data_height,
-                       col + x_offset, row + y_offset, color_dest, dest_pixel);
-    }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0)
+  {
+    error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+    goto done;
+  }
+  
+  buffer = MICRO_DRAW_MALLOC(size);
+  if (buffer == NULL)
+  {
+    error = MICRO_DRAW_ERROR_ALLOCATION;
+    goto done;
   }
+  if (fread(buffer, 1, size, file) != (size_t)size)
+    error = MICRO_DRAW_ERROR_INVALID_FORMAT;
+  else
+    error = micro_draw_from_qoi_memory(buffer, size, data, data_width,
+                                       data_height, pixel);
+  MICRO_DRAW_FREE(buffer);
   
+ done:
+  fclose(file);
+  return error;
+}
+
+#endif // MICRO_DRAW_QOI
+
+#ifdef MICRO_DRAW_PNG
+
+#include <stdio.h> // fopen
+
+// A PNG file is an 8 bytes signature followed by chunks of:
+//   length (4 bytes big endian), type (4), data (length), CRC32 (4)
+// The image is described by the IHDR chunk, its rows are filtered
+// and compressed as a zlib stream in IDAT chunks and IEND ends the
+// file.
+//
+// More info: https://www.w3.org/TR/png/
+
+// CRC32 tables for slicing-by-8: [0] is the usual byte table and [k]
+// is the CRC of a byte followed by k zero bytes, so that 8 bytes are
+// processed with 8 independent lookups
+typedef struct {
+  unsigned int table[8][256];
+} _MicroDrawCRC32;
+
+static inline void _micro_draw_crc32_init(_MicroDrawCRC32 *crc)
+{
+  for (unsigned int i = 0; i < 256; ++i)
+  {
+    unsigned int c = i;
+    for (int k = 0; k < 8; ++k)
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    crc->table[0][i] = c;
+  }
+  for (int t = 1; t < 8; ++t)
+    for (unsigned int i = 0; i < 256; ++i)
+      crc->table[t][i] = (crc->table[t - 1][i] >> 8)
+        ^ crc->table[0][crc->table[t - 1][i] & 0xFF];
   return;
 }
 
-MICRO_DRAW_DEF void
-micro_draw_fill_rect(unsigned char* data, int data_width, int data_height,
-                     int x, int y, int w, int h, unsigned char *color,
-                     MicroDrawPixel pixel)
+// Update a CRC32 started with 0xFFFFFFFF, the final value is inverted
+static inline unsigned int
+_micro_draw_crc32_update(const _MicroDrawCRC32 *crc, unsigned int value,
+                         const unsigned char *bytes, size_t size)
+{
+  const unsigned int (*t)[256] = crc->table;
+  for (; size >= 8; size -= 8, bytes += 8)
+  {
+    unsigned int low = value ^ ((unsigned int)bytes[0]
+                                | (unsigned int)bytes[1] << 8
+                                | (unsigned int)bytes[2] << 16
+                                | (unsigned int)bytes[3] << 24);
+    value = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF]
+      ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+      ^ t[3][bytes[4]] ^ t[2][bytes[5]] ^ t[1][bytes[6]] ^ t[0][bytes[7]];
+  }
+  for (; size > 0; --size, ++bytes)
+    value = t[0][(value ^ *bytes) & 0xFF] ^ (value >> 8);
+  return value;
+}
+
+static inline unsigned int
+_micro_draw_adler32_update(unsigned int adler, const unsigned char *bytes,
+                           size_t size)
 {
-  for (int row = y; row < h + y && row < data_height; ++row)
+  unsigned int a = adler & 0xFFFF;
+  unsigned int b = adler >> 16;
+  while (size > 0)
   {
-    for (int col = x; col < w + x && col < data_width; ++col)
+    // The most bytes that can be summed before [b] overflows
+    size_t block = (size < 5552) ? size : 5552;
+    size -= block;
+    for (; block > 0; --block)
     {
-      if (row < 0 || col < 0) continue;
-      micro_draw_pixel(data, data_width, data_height,
-                       col, row, color, pixel);
+      a += *bytes++;
+      b += a;
     }
+    a %= 65521;
+    b %= 65521;
+  }
+  return a | b << 16;
+}
+
+// Bytes of the zlib stream that can be added for [size] input bytes:
+// fixed Huffman literals take at most 9 bits, stored blocks 5 bytes
+// of header every 65535 bytes
+#define _micro_draw_deflate_bound(size) \
+  ((size) + (size) / 8 + 5 * ((size) / 65535 + 2) + 16)
+
+// Bytes written for [run] pending repeats: a match of at most 258
+// bytes takes 20 bits, the last repeats up to 2 literals
+#define _micro_draw_deflate_run_bound(run) ((run) / 258 * 3 + 4)
+
+typedef struct {
+  unsigned char *out;
+  unsigned char *end;
+  MicroDrawPNGCompression compression;
+  unsigned int adler;
+  // Stored: header of the open block, NULL if there is none
+  unsigned char *block;
+  int block_size;
+  // RLE: pending bits, last literal and its repeats not written yet
+  unsigned int bits;
+  int bits_count;
+  int last;
+  int run;
+  // Fixed Huffman codes of the literals and lengths, bit reversed
+  unsigned short codes[286];
+  unsigned char codes_size[286];
+} _MicroDrawDeflate;
+
+static const unsigned short _micro_draw_deflate_length_base[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+
+static const unsigned char _micro_draw_deflate_length_extra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+static inline void
+_micro_draw_deflate_bits(_MicroDrawDeflate *deflate, unsigned int value, int size)
+{
+  deflate->bits |= value << deflate->bits_count;
+  deflate->bits_count += size;
+  while (deflate->bits_count >= 8)
+  {
+    *deflate->out++ = deflate->bits;
+    deflate->bits >>= 8;
+    deflate->bits_count -= 8;
   }
+  return;
+}
+
+static inline void
+_micro_draw_deflate_init(_MicroDrawDeflate *deflate, unsigned char *out,
+                         unsigned char *end, MicroDrawPNGCompression compression)
+{
+  deflate->out = out;
+  deflate->end = end;
+  deflate->compression = compression;
+  deflate->adler = 1;
+  deflate->block = NULL;
+  deflate->block_size = 0;
+  deflate->bits = 0;
+  deflate->bits_count = 0;
+  deflate->last = -1;
+  deflate->run = 0;
+
+  // zlib header: deflate with a 32K window, no dictionary
+  *deflate->out++ = 0x78;
+  *deflate->out++ = 0x01;
+  if (compression != MICRO_DRAW_PNG_RLE) return;
   
+  for (int symbol = 0; symbol < 286; ++symbol)
+  {
+    unsigned int code;
+    int size;
+    if (symbol < 144)      { code = 0x30 + symbol; size = 8; }
+    else if (symbol < 256) { code = 0x190 + symbol - 144; size = 9; }
+    else if (symbol < 280) { code = symbol - 256; size = 7; }
+    else                   { code = 0xC0 + symbol - 280; size = 8; }
+    // Huffman codes are packed starting from their most significant bit
+    unsigned int reversed = 0;
+    for (int b = 0; b < size; ++b)
+      reversed |= ((code >> b) & 1) << (size - 1 - b);
+    deflate->codes[symbol] = reversed;
+    deflate->codes_size[symbol] = size;
+  }
+  // Single final block with fixed codes
+  _micro_draw_deflate_bits(deflate, 1, 1);
+  _micro_draw_deflate_bits(deflate, 1, 2);
   return;
 }
 
-#define MICRO_DRAW_ABS(x) (((x) >= 0) ? (x) : -(x))
+static inline void
+_micro_draw_deflate_literal(_MicroDrawDeflate *deflate, int symbol)
+{
+  _micro_draw_deflate_bits(deflate, deflate->codes[symbol],
+                           deflate->codes_size[symbol]);
+  return;
+}
 
-MICRO_DRAW_DEF void
-micro_draw_fill_circle(unsigned char* data, int data_width, int data_height,
-                       int center_x, int center_y, int radius,
-                       unsigned char *color, MicroDrawPixel pixel)
+// Write the repeats of the last literal, as matches at distance 1
+static inline void _micro_draw_deflate_run(_MicroDrawDeflate *deflate)
+{
+  while (deflate->run >= 3)
+  {
+    int length = _micro_draw_min(deflate->run, 258);
+    int code = 28;
+    while (_micro_draw_deflate_length_base[code] > length) code--;
+    _micro_draw_deflate_literal(deflate, 257 + code);
+    _micro_draw_deflate_bits(deflate,
+                             length - _micro_draw_deflate_length_base[code],
+                             _micro_draw_deflate_length_extra[code]);
+    // Distance 1 has code 0 and no extra bits
+    _micro_draw_deflate_bits(deflate, 0, 5);
+    deflate->run -= length;
+  }
+  for (; deflate->run > 0; --deflate->run)
+    _micro_draw_deflate_literal(deflate, deflate->last);
+  return;
+}
+
+static inline void
+_micro_draw_deflate_close_block(_MicroDrawDeflate *deflate, int final)
+{
+  unsigned char *block = deflate->block;
+  int size = deflate->block_size;
+  block[0] = final;
+  block[1] = size;
+  block[2] = size >> 8;
+  block[3] = ~size;
+  block[4] = ~size >> 8;
+  deflate->block = NULL;
+  return;
+}
+
+static inline MicroDrawError
+_micro_draw_deflate_put(_MicroDrawDeflate *deflate, const unsigned char *bytes,
+                        int size)
 {
-  for (int row = center_y - radius; row < center_y + radius && row < data_height; ++row)
+  if (deflate->end - deflate->out < (long)(_micro_draw_deflate_bound(size)
+                                           + _micro_draw_deflate_run_bound(deflate->run)))
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  deflate->adler = _micro_draw_adler32_update(deflate->adler, bytes, size);
+
+  if (deflate->compression == MICRO_DRAW_PNG_RLE)
   {
-    for (int col = center_x - radius; col < center_x + radius && col < data_width; ++col)
+    for (int i = 0; i < size; ++i)
     {
-      if (row < 0 || col < 0) continue;
-      
-      int dx = MICRO_DRAW_ABS(col - center_x);
-      int dy = MICRO_DRAW_ABS(row - center_y);
-      if (dx*dx + dy*dy > radius*radius) continue;
-      
-      micro_draw_pixel(data, data_width, data_height,
-                       col, row, color, pixel);
+      if (bytes[i] == deflate->last)
+      {
+        deflate->run++;
+        continue;
+      }
+      _micro_draw_deflate_run(deflate);
+      _micro_draw_deflate_literal(deflate, bytes[i]);
+      deflate->last = bytes[i];
+    }
+    return MICRO_DRAW_OK;
+  }
+
+  while (size > 0)
+  {
+    if (deflate->block == NULL)
+    {
+      deflate->block = deflate->out;
+      deflate->block_size = 0;
+      deflate->out += 5;
+    }
+    int count = _micro_draw_min(size, 65535 - deflate->block_size);
+    _micro_draw_memcpy(deflate->out, bytes, count);
+    deflate->out += count;
+    deflate->block_size += count;
+    bytes += count;
+    size -= count;
+    if (deflate->block_size == 65535)
+      _micro_draw_deflate_close_block(deflate, 0);
+  }
+  return MICRO_DRAW_OK;
+}
+
+// End the zlib stream
+static inline MicroDrawError
+_micro_draw_deflate_end(_MicroDrawDeflate *deflate)
+{
+  if (deflate->end - deflate->out < (long)(_micro_draw_deflate_bound(0)
+                                           + _micro_draw_deflate_run_bound(deflate->run)))
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  if (deflate->compression == MICRO_DRAW_PNG_RLE)
+  {
+    _micro_draw_deflate_run(deflate);
+    _micro_draw_deflate_literal(deflate, 256);
+    if (deflate->bits_count > 0)
+      _micro_draw_deflate_bits(deflate, 0, 8 - deflate->bits_count);
+  }
+  else
+  {
+    if (deflate->block == NULL)
+    {
+      // Empty final block
+      deflate->block = deflate->out;
+      deflate->block_size = 0;
+      deflate->out += 5;
     }
+    _micro_draw_deflate_close_block(deflate, 1);
   }
+  
+  unsigned char *out = deflate->out;
+  out[0] = deflate->adler >> 24;
+  out[1] = deflate->adler >> 16;
+  out[2] = deflate->adler >> 8;
+  out[3] = deflate->adler;
+  deflate->out += 4;
+  return MICRO_DRAW_OK;
+}
 
+static inline void
+_micro_draw_png_write_u32(unsigned char *dest, unsigned int value)
+{
+  dest[0] = value >> 24;
+  dest[1] = value >> 16;
+  dest[2] = value >> 8;
+  dest[3] = value;
   return;
 }
 
-// Get the orientation of three 2D points (a, b, c).
-//
-// This computes the determinant:
-//
-// det( [[ a_x, a_y, 1 ],
-//       [ b_x, b_y, 1 ],
-//       [ c_x, c_y, 1 ]] )
-//
-// Algebraically, this is equal to
-//
-//   (b_x - a_x) * (c_y - a_y) - (b_y - a_y) * (c_x - a_x)
-//
-// which is twice the signed area of the triangle (a, b, c).
-//
-// The sign of the result indicates the orientation:
-//   > 0 : counterclockwise
-//   < 0 : clockwise
-//   = 0 : collinear
-//
-// This orientation test is important for rasterization. Suppose we
-// want to test whether a point P lies inside the triangle (a, b, c).
-// We form the three sub-triangles (P, b, c), (a, P, c), and (a, b, P).
-// If P is inside, all of these orientations will have the same sign
-// as the orientation of the original triangle. If P is outside, at
-// least one orientation will differ.
-//
-// See also: Fabian Giesen,
-// “The barycentric conspiracies”
-// https://fgiesen.wordpress.com/2013/02/06/the-barycentric-conspirac/
-#define _micro_draw_orient2D(a_x, a_y, b_x, b_y, c_x, c_y) \
-    ( ((b_x) - (a_x)) * ((c_y) - (a_y)) - ((b_y) - (a_y)) * ((c_x) - (a_x)) )
+// Close the chunk that starts at [chunk] and ends at [end], writing
+// its length and CRC
+static inline unsigned char *
+_micro_draw_png_end_chunk(const _MicroDrawCRC32 *crc, unsigned char *chunk,
+                          unsigned char *end)
+{
+  _micro_draw_png_write_u32(chunk, end - chunk - 8);
+  unsigned int value =
+    _micro_draw_crc32_update(crc, 0xFFFFFFFF, chunk + 4, end - chunk - 4);
+  _micro_draw_png_write_u32(end, ~value);
+  return end + 4;
+}
 
-#define _micro_draw_min(a, b) ((a) < (b) ? (a) : (b))
-#define _micro_draw_max(a, b) ((a) > (b) ? (a) : (b))
-#define _micro_draw_min3(a, b, c) (_micro_draw_min(_micro_draw_min((a), (b)), (c)))
-#define _micro_draw_max3(a, b, c) (_micro_draw_max(_micro_draw_max((a), (b)), (c)))
+// Bytes of a row of the image, without the filter byte
+static inline int
+_micro_draw_png_row_size(int data_width, MicroDrawPixel pixel)
+{
+  if (pixel == MICRO_DRAW_BLACK_WHITE)
+    return (data_width + 7) / 8;
+  return data_width * micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+}
 
-// https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
-MICRO_DRAW_DEF void
-micro_draw_fill_triangle(unsigned char *data, int data_width, int data_height,
-                         int a_x, int a_y, int b_x, int b_y,
-                         int c_x, int c_y, unsigned char *color,
-                         MicroDrawPixel pixel)
+MICRO_DRAW_DEF size_t
+micro_draw_png_max_size(int data_width, int data_height, MicroDrawPixel pixel)
 {
-  // Compute triangle bounding box
-  int minX = _micro_draw_min3(a_x, b_x, c_x);
-  int minY = _micro_draw_min3(a_y, b_y, c_y);
-  int maxX = _micro_draw_max3(a_x, b_x, c_x);
-  int maxY = _micro_draw_max3(a_y, b_y, c_y);
+  if (data_width <= 0 || data_height <= 0
+      || (int)pixel < 0 || pixel >= _MICRO_DRAW_PIXEL_MAX)
+    return 0;
+  size_t raw = (size_t)data_height
+    * (1 + _micro_draw_png_row_size(data_width, pixel));
+  // Signature, IHDR, IDAT header and CRC, zlib header and Adler32, IEND
+  return _micro_draw_deflate_bound(raw) + _micro_draw_deflate_bound(0)
+    + 8 + 25 + 12 + 6 + 12;
+}
+
+// Sum of the filtered bytes as signed values, lower is better
+static inline unsigned int
+_micro_draw_png_filter_cost(const unsigned char *row, int size)
+{
+  unsigned int cost = 0;
+  for (int i = 0; i < size; ++i)
+    cost += (row[i] < 128) ? row[i] : 256 - row[i];
+  return cost;
+}
+
+_Static_assert(_MICRO_DRAW_PIXEL_MAX == 4,
+               "Updated MicroDrawPixel, should also update micro_draw_to_png_memory");
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_png_memory(unsigned char *buffer, size_t capacity, size_t *size,
+                         unsigned char *data, int data_width, int data_height,
+                         MicroDrawPixel pixel, MicroDrawPNGCompression compression)
+{
+  *size = 0;
+  if (data_width <= 0 || data_height <= 0)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  
+  int color_type, bit_depth = 8;
+  switch(pixel)
+  {
+  case MICRO_DRAW_RGBA8:       color_type = 6; break;
+  case MICRO_DRAW_RGB8:        color_type = 2; break;
+  case MICRO_DRAW_GRAY8:       color_type = 0; break;
+  case MICRO_DRAW_BLACK_WHITE: color_type = 0; bit_depth = 1; break;
+  default:
+    return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  }
+  
+  // Signature, IHDR and the start of IDAT
+  if (capacity < 8 + 25 + 8 + _micro_draw_deflate_bound(0))
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  
+  _MicroDrawCRC32 crc;
+  _micro_draw_crc32_init(&crc);
+  
+  static const unsigned char signature[8] =
+    { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  unsigned char *p = buffer;
+  _micro_draw_memcpy(p, signature, 8);
+  p += 8;
 
-  // Clip against screen bounds
-  minX = _micro_draw_max(minX, 0);
-  minY = _micro_draw_max(minY, 0);
-  maxX = _micro_draw_min(maxX, data_width - 1);
-  maxY = _micro_draw_min(maxY, data_height - 1);
+  unsigned char *chunk = p;
+  _micro_draw_memcpy(p + 4, "IHDR", 4);
+  _micro_draw_png_write_u32(p + 8, data_width);
+  _micro_draw_png_write_u32(p + 12, data_height);
+  p[16] = bit_depth;
+  p[17] = color_type;
+  p[18] = 0; // Deflate
+  p[19] = 0; // Adaptive filters
+  p[20] = 0; // No interlace
+  p = _micro_draw_png_end_chunk(&crc, chunk, p + 21);
 
-  for (int row = minY; row <= maxY; ++row)
+  // The whole image goes in a single IDAT, leaving room for its CRC
+  // and for IEND
+  chunk = p;
+  _micro_draw_memcpy(p + 4, "IDAT", 4);
+  _MicroDrawDeflate deflate;
+  _micro_draw_deflate_init(&deflate, p + 8, buffer + capacity - 16, compression);
+
+  int row_size = _micro_draw_png_row_size(data_width, pixel);
+  int pixel_size = micro_draw_get_channels(pixel)
+    * micro_draw_get_channel_size(pixel);
+  // Filtered rows with their filter byte: None, Sub and Up, and the
+  // bits of the current and previous Black&White rows
+  unsigned char *rows = MICRO_DRAW_MALLOC((size_t)(row_size + 1) * 5);
+  if (rows == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+  unsigned char *filtered[3] = {
+    rows, rows + (row_size + 1), rows + (row_size + 1) * 2,
+  };
+  unsigned char *bits[2] = { rows + (row_size + 1) * 3, rows + (row_size + 1) * 4 };
+  int bpp = _micro_draw_max(1, pixel_size * bit_depth / 8);
+  
+  MicroDrawError error = MICRO_DRAW_OK;
+  const unsigned char *prev = NULL;
+  for (int y = 0; y < data_height && error == MICRO_DRAW_OK; ++y)
   {
-    for (int col = minX; col <= maxX; ++col)
-    {  
-      // Determine barycentric coordinates
-      int w0 = _micro_draw_orient2D(b_x, b_y, c_x, c_y, col, row);
-      int w1 = _micro_draw_orient2D(c_x, c_y, a_x, a_y, col, row);
-      int w2 = _micro_draw_orient2D(a_x, a_y, b_x, b_y, col, row);
+    const unsigned char *row;
+    if (pixel == MICRO_DRAW_BLACK_WHITE)
+    {
+      // Packed starting from the most significant bit, 1 is white
+      unsigned char *packed = bits[y & 1];
+      const unsigned char *src = data + (size_t)y * data_width;
+      for (int b = 0; b < row_size; ++b)
+        packed[b] = 0;
+      for (int x = 0; x < data_width; ++x)
+        if (src[x])
+          packed[x >> 3] |= 0x80 >> (x & 7);
+      row = packed;
+    }
+    else
+    {
+      row = data + (size_t)y * row_size;
+    }
 
-      // If p is on or inside all edges, render pixel.
-      if (w0 >= 0 && w1 >= 0 && w2 >= 0)
-        micro_draw_pixel(data, data_width, data_height,
-                         col, row, color, pixel);
+    if (compression != MICRO_DRAW_PNG_RLE)
+    {
+      unsigned char none = 0;
+      error = _micro_draw_deflate_put(&deflate, &none, 1);
+      if (error == MICRO_DRAW_OK)
+        error = _micro_draw_deflate_put(&deflate, row, row_size);
+      prev = row;
+      continue;
+    }
+
+    unsigned char *none = filtered[0], *sub = filtered[1], *up = filtered[2];
+    none[0] = 0;
+    sub[0] = 1;
+    up[0] = 2;
+    _micro_draw_memcpy(none + 1, row, row_size);
+    for (int i = 0; i < row_size; ++i)
+    {
+      sub[i + 1] = row[i] - ((i >= bpp) ? row[i - bpp] : 0);
+      up[i + 1] = row[i] - ((prev != NULL) ? prev[i] : 0);
     }
+    unsigned char *best = none;
+    unsigned int best_cost = _micro_draw_png_filter_cost(none + 1, row_size);
+    unsigned int cost = _micro_draw_png_filter_cost(sub + 1, row_size);
+    if (cost < best_cost)
+    {
+      best = sub;
+      best_cost = cost;
+    }
+    if (prev != NULL && _micro_draw_png_filter_cost(up + 1, row_size) < best_cost)
+      best = up;
+    error = _micro_draw_deflate_put(&deflate, best, row_size + 1);
+    prev = row;
   }
+  MICRO_DRAW_FREE(rows);
+  if (error == MICRO_DRAW_OK)
+    error = _micro_draw_deflate_end(&deflate);
+  if (error != MICRO_DRAW_OK) return error;
+  p = _micro_draw_png_end_chunk(&crc, chunk, deflate.out);
 
-  return;
+  chunk = p;
+  _micro_draw_memcpy(p + 4, "IEND", 4);
+  p = _micro_draw_png_end_chunk(&crc, chunk, p + 8);
+  *size = p - buffer;
+  return MICRO_DRAW_OK;
 }
-  
-MICRO_DRAW_DEF void
-micro_draw_grid(unsigned char* data, int data_width, int data_height,
-                int columns, int rows, unsigned char* color, MicroDrawPixel pixel)
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_to_png(const char *filename, unsigned char *data,
+                  int data_width, int data_height, MicroDrawPixel pixel,
+                  MicroDrawPNGCompression compression)
 {
-  // Draw columns
-  for (int x = 0; x < data_width; x += data_width / columns)
+  size_t capacity = micro_draw_png_max_size(data_width, data_height, pixel);
+  if (capacity == 0) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  unsigned char *buffer = MICRO_DRAW_MALLOC(capacity);
+  if (buffer == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
+
+  size_t size;
+  MicroDrawError error =
+    micro_draw_to_png_memory(buffer, capacity, &size, data, data_width,
+                             data_height, pixel, compression);
+  if (error != MICRO_DRAW_OK) goto done;
+
+  FILE* file = fopen(filename, "wb");
+  if (file == NULL)
   {
-    micro_draw_line(data, data_width, data_height,
-                     x, 0, x, data_height,
-                     color, pixel);
+    perror("Error opening file");
+    error = MICRO_DRAW_ERROR_OPEN_FILE;
+    goto done;
   }
+  if (fwrite(buffer, 1, size, file) != size)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
+  if (fclose(file) != 0 && error == MICRO_DRAW_OK)
+    error = MICRO_DRAW_ERROR_WRITE_FILE;
   
-  // Draw rows
-  for (int y = 0; y < data_height; y += data_height / rows)
-  {
-    micro_draw_line(data, data_width, data_height,
-                     0, y, data_width, y,
-                     color, pixel);
-  }
-  return;
+ done:
+  MICRO_DRAW_FREE(buffer);
+  return error;
 }
 
-MICRO_DRAW_DEF void
-micro_draw_get_color(unsigned char* data, int data_width, int data_height,
-                     int x, int y, unsigned char** color, MicroDrawPixel pixel)
-{
-  if (x >= data_width || x < 0 || y >= data_height || y < 0) return;
+#endif // MICRO_DRAW_PNG
 
-  int channel_size = micro_draw_get_channel_size(pixel); // bytes
-  unsigned int channels = micro_draw_get_channels(pixel);
-  int index = (y * data_width + x) * channels * channel_size;
+#ifdef MICRO_DRAW_Y4M
 
-  *color = data + index;
-  return;
+#include <stdio.h> // fopen
+
+// A YUV4MPEG2 stream is a text header line, for example:
+//   YUV4MPEG2 W640 H480 F30:1 Ip A1:1 C420jpeg
+// followed by frames, each one a "FRAME" line and the Y, U and V
+// planes one after the other.
+//
+// The conversion uses the BT.601 coefficients with 7 bits, so that
+// they fit the signed bytes of _mm_maddubs_epi16:
+//   Y = (( 33 R + 64 G + 13 B + 64) >> 7) + 16
+//   U = ((-19 R - 37 G + 56 B) >> 7) + 128
+//   V = (( 56 R - 47 G -  9 B) >> 7) + 128
+// U and V are computed on the vertical average of two rows, summed
+// for two columns.
+
+static inline unsigned char
+_micro_draw_i420_y(const unsigned char *px)
+{
+  return ((33 * px[0] + 64 * px[1] + 13 * px[2] + 64) >> 7) + 16;
 }
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "MicroDrawPixel has changed, make sure that color_dest in micro_draw_scaled is enough");
-MICRO_DRAW_DEF void
-micro_draw_scaled(unsigned char* src_data, int src_data_width, int src_data_height,
-                  MicroDrawPixel src_pixel, unsigned char* dest_data,
-                  int dest_data_width, int dest_data_height,
-                  MicroDrawPixel dest_pixel)
+// Chroma of a 2x2 block from the average of the rows [a] and [b],
+// where [a2] and [b2] are the pixels of the second column
+static inline void
+_micro_draw_i420_uv(const unsigned char *a, const unsigned char *b,
+                    const unsigned char *a2, const unsigned char *b2,
+                    unsigned char *u, unsigned char *v)
 {
-  for (int y = 0; y < dest_data_height; ++y)
+  int sum_u = 0, sum_v = 0;
+  for (int col = 0; col < 2; ++col)
   {
-    for (int x = 0; x < dest_data_width; ++x)
-    {
-      int x_frame = (x * src_data_width) / (double)dest_data_width;
-      int y_frame = (y * src_data_height) / (double)dest_data_height;
-      unsigned char *color;
-      micro_draw_get_color(src_data, src_data_width, src_data_height,
-                           x_frame, y_frame, &color, src_pixel);
-
-      unsigned char color_dest[4] = {0}; // 4 is enough for now
-      micro_draw_color_convert(color, src_pixel, color_dest, dest_pixel);
-      micro_draw_pixel(dest_data, dest_data_width, dest_data_height,
-                       x, y, color_dest, dest_pixel);
-    }
+    const unsigned char *top = col ? a2 : a;
+    const unsigned char *bottom = col ? b2 : b;
+    int r = (top[0] + bottom[0] + 1) >> 1;
+    int g = (top[1] + bottom[1] + 1) >> 1;
+    int bl = (top[2] + bottom[2] + 1) >> 1;
+    sum_u += -19 * r - 37 * g + 56 * bl;
+    sum_v += 56 * r - 47 * g - 9 * bl;
   }
+  // Biased to stay positive, so that the shift rounds down
+  *u = (sum_u + 128 + (128 << 8)) >> 8;
+  *v = (sum_v + 128 + (128 << 8)) >> 8;
   return;
 }
 
-static inline int _micro_draw_get_horizontal_characters(char* str)
+// Convert the rows [row0] and [row1] and their chroma. For the last
+// row of an odd image [row1] is [row0] and [y1] is NULL.
+static inline void
+_micro_draw_i420_rows(const unsigned char *row0, const unsigned char *row1,
+                      int width, unsigned char *y0, unsigned char *y1,
+                      unsigned char *u, unsigned char *v)
 {
-  int max_num = 0;
-  int num = 0;
-  while (*str != '\0')
+  int x = 0;
+#if defined(__SSSE3__) && !defined(MICRO_DRAW_NO_SIMD)
+  const __m128i y_coeffs = _mm_setr_epi8(33, 64, 13, 0, 33, 64, 13, 0,
+                                         33, 64, 13, 0, 33, 64, 13, 0);
+  const __m128i u_coeffs = _mm_setr_epi8(-19, -37, 56, 0, -19, -37, 56, 0,
+                                         -19, -37, 56, 0, -19, -37, 56, 0);
+  const __m128i v_coeffs = _mm_setr_epi8(56, -47, -9, 0, 56, -47, -9, 0,
+                                         56, -47, -9, 0, 56, -47, -9, 0);
+  const __m128i y_round = _mm_set1_epi16(64);
+  const __m128i y_offset = _mm_set1_epi16(16);
+  const __m128i uv_round = _mm_set1_epi16(128);
+  // 8 pixels of both rows at a time
+  for (; x + 8 <= width; x += 8)
   {
-    if (*str == '\n')
+    __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 4));
+    __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 4 + 16));
+    __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 4));
+    __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 4 + 16));
+
+    __m128i ya = _mm_hadd_epi16(_mm_maddubs_epi16(a0, y_coeffs),
+                                _mm_maddubs_epi16(a1, y_coeffs));
+    ya = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(ya, y_round), 7), y_offset);
+    _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(ya, ya));
+    if (y1 != NULL)
     {
-      max_num = (num > max_num) ? num : max_num;
-      num = 0;
+      __m128i yb = _mm_hadd_epi16(_mm_maddubs_epi16(b0, y_coeffs),
+                                  _mm_maddubs_epi16(b1, y_coeffs));
+      yb = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(yb, y_round), 7), y_offset);
+      _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(yb, yb));
     }
-    else
+
+    // Chroma is linear: the sum of two columns is twice the chroma
+    // of their average
+    __m128i avg0 = _mm_avg_epu8(a0, b0);
+    __m128i avg1 = _mm_avg_epu8(a1, b1);
+    __m128i cu = _mm_hadd_epi16(_mm_maddubs_epi16(avg0, u_coeffs),
+                                _mm_maddubs_epi16(avg1, u_coeffs));
+    __m128i cv = _mm_hadd_epi16(_mm_maddubs_epi16(avg0, v_coeffs),
+                                _mm_maddubs_epi16(avg1, v_coeffs));
+    // Columns summed in pairs: U in the low half, V in the high half
+    __m128i uv = _mm_hadd_epi16(cu, cv);
+    uv = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(uv, uv_round), 8), uv_round);
+    __m128i packed = _mm_packus_epi16(uv, uv);
+    int u4 = _mm_cvtsi128_si32(packed);
+    int v4 = _mm_cvtsi128_si32(_mm_srli_si128(packed, 4));
+    _micro_draw_memcpy(u + x / 2, &u4, 4);
+    _micro_draw_memcpy(v + x / 2, &v4, 4);
+  }
+#endif
+  for (; x < width; x += 2)
+  {
+    // The last column of an odd image is used twice
+    int x2 = (x + 1 < width) ? x + 1 : x;
+    y0[x] = _micro_draw_i420_y(row0 + x * 4);
+    if (x2 != x) y0[x2] = _micro_draw_i420_y(row0 + x2 * 4);
+    if (y1 != NULL)
     {
-      num++;
+      y1[x] = _micro_draw_i420_y(row1 + x * 4);
+      if (x2 != x) y1[x2] = _micro_draw_i420_y(row1 + x2 * 4);
     }
-    str++;
+    _micro_draw_i420_uv(row0 + x * 4, row1 + x * 4, row0 + x2 * 4, row1 + x2 * 4,
+                        u + x / 2, v + x / 2);
   }
-  return (num > max_num) ? num : max_num;
+  return;
 }
 
-static inline int _micro_draw_get_vertical_characters(char* str)
+typedef struct {
+  const unsigned char *data;
+  int width;
+  int height;
+  unsigned char *y_plane;
+  unsigned char *u_plane;
+  unsigned char *v_plane;
+} _MicroDrawI420Job;
+
+static void _micro_draw_i420_chroma_rows(void *context, int begin, int end)
 {
-  int num = 1;
-  while (*str != '\0')
+  _MicroDrawI420Job *job = context;
+  int width = job->width;
+  int chroma_width = (width + 1) / 2;
+  for (int y = begin * 2; y < end * 2 && y < job->height; y += 2)
   {
-    if (*str == '\n') num++;
-    str++;
+    const unsigned char *row0 = job->data + (size_t)y * width * 4;
+    int last = (y + 1 == job->height);
+    _micro_draw_i420_rows(row0, last ? row0 : row0 + (size_t)width * 4,
+                          width, job->y_plane + (size_t)y * width,
+                          last ? NULL : job->y_plane + (size_t)(y + 1) * width,
+                          job->u_plane + (size_t)(y / 2) * chroma_width,
+                          job->v_plane + (size_t)(y / 2) * chroma_width);
   }
-  return num;
+  return;
 }
 
-static inline int _micro_draw_strlen(char* str)
+MICRO_DRAW_DEF void
+micro_draw_rgba8_to_i420(const unsigned char *data, int data_width,
+                         int data_height, unsigned char *y_plane,
+                         unsigned char *u_plane, unsigned char *v_plane)
 {
-  int len = 0;
-  while (str[len] != '\0') len++;
-  return len;
+  _MicroDrawI420Job job = {
+    data, data_width, data_height, y_plane, u_plane, v_plane,
+  };
+  // Two rows for every chroma row
+  MICRO_DRAW_PARALLEL_FOR((data_height + 1) / 2,
+                          _micro_draw_rows_grain(data_width * 4 * 2),
+                          _micro_draw_i420_chroma_rows, &job);
+  return;
 }
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "MicroDrawPixel has changed, make sure that color_dest in micro_draw_text is enough");
-MICRO_DRAW_DEF void
-micro_draw_text(unsigned char* data, int data_width, int data_height,
-                MicroDrawPixel pixel_data, char* text, int text_x,
-                int text_y, float text_scale, unsigned char* text_color)
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_begin_file(MicroDrawY4MWriter *writer, FILE *file,
+                                 int width, int height, int fps_num, int fps_den)
 {
-  int channel_size = micro_draw_get_channel_size(pixel_data); // bytes
-  unsigned int channels = micro_draw_get_channels(pixel_data);
-  int char_x = MICRO_DRAW_CHARACTER_PIXELS_X * text_scale;
-  int char_y = MICRO_DRAW_CHARACTER_PIXELS_Y * text_scale;
-  int text_row = 0;
-  int text_col = 0;
-  int text_len = _micro_draw_strlen(text);
-  
-  for (int c = 0; c < text_len; ++c)
-  {
-    if (text[c] == '\n')
-    {
-      text_row++;
-      text_col = 0;
-      continue;
-    }
-    for (int y = 0; y < char_y; ++y)
-    {
-      for (int x = 0; x < char_x; ++x)
-      {
-        // Rescale the pixel
-        int font_x = (x * MICRO_DRAW_FONT_WIDTH) / (double)char_x;
-        int font_y = (y * MICRO_DRAW_FONT_HEIGHT) / (double)char_y;
+  writer->file = file;
+  writer->width = width;
+  writer->height = height;
+  writer->frames_written = 0;
+  writer->_frame = NULL;
+  writer->_owns_file = 0;
+  if (width <= 0 || height <= 0 || width > 0x7FFFFFFF / 4 / height)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
+  if (fps_num <= 0 || fps_den <= 0)
+    return MICRO_DRAW_ERROR_INVALID_FORMAT;
 
-        // Calculate color
-        unsigned char color_dest[4] = {0};
-        for (unsigned int i = 0; i < channels * channel_size; ++i)
-          color_dest[i] = text_color[i] * micro_draw_font[(int)text[c]][font_y][font_x];
+  size_t chroma_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+  writer->_frame = MICRO_DRAW_MALLOC((size_t)width * height + chroma_size * 2);
+  if (writer->_frame == NULL) return MICRO_DRAW_ERROR_ALLOCATION;
 
-        // Draw with translation
-        micro_draw_pixel(data, data_width, data_height,
-                         x + text_x + text_col * char_x,
-                         y + text_y + text_row * char_y, color_dest, pixel_data);
-      }
-    }
-    text_col++;
+  // C420jpeg: the chroma is sited in the center of each 2x2 block
+  if (fprintf(file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n",
+              width, height, fps_num, fps_den) < 0)
+  {
+    MICRO_DRAW_FREE(writer->_frame);
+    writer->_frame = NULL;
+    return MICRO_DRAW_ERROR_WRITE_FILE;
   }
-  return;
+  return MICRO_DRAW_OK;
 }
-  
-#ifdef MICRO_DRAW_PPM
-
-#include <stdio.h>  // fread
-#include <stdlib.h> // atoi
 
-// The PPM header starts with 4 values speareted by either space or
-// newline: ID, WIDTH, HEIGHT, MAX_COLOR_VALUE.
-// Where ID is either:
-//  - P1: ASCII Bitmap   (.pbm)
-//  - P2: ASCII Graymap  (.pgm)
-//  - P3: ASCII PixMap   (.ppm)
-//  - P4: Binary Bitmap  (.pbm)
-//  - P5: Binary Graymap (.pgm)
-//  - P6: Binary PixMap  (.ppm)
-//
-// The rest of the file contains WIDHT*HEIGHT color values less then
-// MAX_COLOR_VALUE.
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_draw_to_ppm");
 MICRO_DRAW_DEF MicroDrawError
-micro_draw_to_ppm(const char *filename, unsigned char *data,
-                  int data_width, int data_height, MicroDrawPixel pixel)
+micro_draw_y4m_writer_begin(MicroDrawY4MWriter *writer, const char *filename,
+                            int width, int height, int fps_num, int fps_den)
 {
-  MicroDrawError error = MICRO_DRAW_OK;
-  
-  FILE* file = fopen(filename, "w+");
+  FILE *file = fopen(filename, "wb");
   if (file == NULL)
   {
+    writer->file = NULL;
+    writer->_frame = NULL;
     perror("Error opening file");
     return MICRO_DRAW_ERROR_OPEN_FILE;
   }
+  MicroDrawError error =
+    micro_draw_y4m_writer_begin_file(writer, file, width, height, fps_num, fps_den);
+  if (error != MICRO_DRAW_OK)
+  {
+    fclose(file);
+    writer->file = NULL;
+    return error;
+  }
+  writer->_owns_file = 1;
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_write_frame(MicroDrawY4MWriter *writer, unsigned char *data,
+                                  MicroDrawPixel pixel)
+{
+  if (writer->_frame == NULL) return MICRO_DRAW_ERROR_WRITE_FILE;
+  if (pixel != MICRO_DRAW_RGBA8) return MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT;
+  
+  size_t luma_size = (size_t)writer->width * writer->height;
+  size_t chroma_size =
+    (size_t)((writer->width + 1) / 2) * ((writer->height + 1) / 2);
+  unsigned char *y_plane = writer->_frame;
+  micro_draw_rgba8_to_i420(data, writer->width, writer->height, y_plane,
+                           y_plane + luma_size, y_plane + luma_size + chroma_size);
 
-  int channels = micro_draw_get_channels(pixel);
-  int channel_size = micro_draw_get_channel_size(pixel);
-  int data_size = data_width * data_height * channels * channel_size;
+  size_t frame_size = luma_size + chroma_size * 2;
+  if (fwrite("FRAME\n", 1, 6, writer->file) != 6
+      || fwrite(writer->_frame, 1, frame_size, writer->file) != frame_size)
+    return MICRO_DRAW_ERROR_WRITE_FILE;
+  writer->frames_written++;
+  return MICRO_DRAW_OK;
+}
 
-  switch(pixel)
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_y4m_writer_end(MicroDrawY4MWriter *writer)
+{
+  MicroDrawError error = MICRO_DRAW_OK;
+  if (writer->file != NULL)
   {
-  case MICRO_DRAW_RGBA8:
-    
-    fprintf(file, "P6\n%d %d\n%d\n", data_width,
-            data_height, (1 << (channel_size * 8)) - 1);
-    for (int i = 0; i < data_size; i += channels * channel_size)
+    if (writer->_owns_file)
     {
-      fwrite(data + i, channel_size, (channels - 1), file);
+      if (fclose(writer->file) != 0)
+        error = MICRO_DRAW_ERROR_WRITE_FILE;
     }
-    break;
-    
-  case MICRO_DRAW_BLACK_WHITE:
-    
-    fprintf(file, "P1\n%d %d\n%d\n", data_width, data_height, 1);
-    for (int i = 0; i < data_size; i += channels * channel_size)
+    else if (fflush(writer->file) != 0)
     {
-      fwrite(data + i, channel_size, (channels - 1), file);
+      error = MICRO_DRAW_ERROR_WRITE_FILE;
     }
-    break;
-    
-  default:
-    goto done;
   }
-
- done:
-  fclose(file);
+  MICRO_DRAW_FREE(writer->_frame);
+  writer->_frame = NULL;
+  writer->file = NULL;
   return error;
 }
 
-static inline int _micro_draw_strcmp(const char *s1, const char *s2)
+#endif // MICRO_DRAW_Y4M
+
+#ifdef MICRO_DRAW_ASYNC_WRITER
+
+static void *_micro_draw_async_writer_thread(void *arg)
 {
-  while (*s1 == *s2) {
-    s1++;
-    s2++;
+  MicroDrawAsyncWriter *writer = arg;
+  pthread_mutex_lock(&writer->_mutex);
+  for (;;)
+  {
+    while (writer->_queue_count == 0 && !writer->_ending)
+      pthread_cond_wait(&writer->_queued, &writer->_mutex);
+    if (writer->_queue_count == 0) break;
+    
+    unsigned char *buffer = writer->_queue[writer->_queue_start];
+    int frame = writer->_queue_frames[writer->_queue_start];
+    writer->_queue_start = (writer->_queue_start + 1) % writer->_queue_capacity;
+    writer->_queue_count--;
+    pthread_mutex_unlock(&writer->_mutex);
+
+    MicroDrawError error = writer->write(writer->context, frame, buffer,
+                                         writer->width, writer->height,
+                                         writer->pixel);
+
+    pthread_mutex_lock(&writer->_mutex);
+    if (error != MICRO_DRAW_OK && writer->error == MICRO_DRAW_OK)
+      writer->error = error;
+    writer->frames_written++;
+    writer->_free[writer->_free_count++] = buffer;
+    pthread_cond_signal(&writer->_released);
   }
-  if (*s2 == '\0')
-    return 0;
-  return 1;
+  pthread_mutex_unlock(&writer->_mutex);
+  return NULL;
 }
 
-static inline int _micro_draw_is_whitespace(char c)
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_begin(MicroDrawAsyncWriter *writer, int data_width,
+                              int data_height, MicroDrawPixel pixel,
+                              int queue_capacity, MicroDrawAsyncPolicy policy,
+                              MicroDrawFrameWriteFn write, void *context)
 {
-  return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
-}
+  writer->width = data_width;
+  writer->height = data_height;
+  writer->pixel = pixel;
+  writer->policy = policy;
+  writer->write = write;
+  writer->context = context;
+  writer->frames_submitted = 0;
+  writer->frames_written = 0;
+  writer->frames_dropped = 0;
+  writer->error = MICRO_DRAW_OK;
+  writer->_queue_start = 0;
+  writer->_queue_count = 0;
+  writer->_ending = 0;
+  writer->_pool = NULL;
+  if (data_width <= 0 || data_height <= 0 || queue_capacity <= 0)
+    return MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
 
-typedef enum {
-  _MICRO_DRAW_P1 = 0,
-  _MICRO_DRAW_P2,
-  _MICRO_DRAW_P3,
-  _MICRO_DRAW_P4,
-  _MICRO_DRAW_P5,
-  _MICRO_DRAW_P6,
-} _MicroDrawPPMType;
+  // One more buffer than the queue, for the frame being written
+  int buffers = queue_capacity + 1;
+  // Before the thread starts, every buffer can be queued
+  writer->_queue_capacity = buffers;
+  size_t frame_size = (size_t)data_width * data_height
+    * micro_draw_get_channels(pixel) * micro_draw_get_channel_size(pixel);
+  writer->_pool = MICRO_DRAW_MALLOC(frame_size * buffers);
+  writer->_free = MICRO_DRAW_MALLOC(sizeof(unsigned char*) * buffers);
+  writer->_queue = MICRO_DRAW_MALLOC(sizeof(unsigned char*) * buffers);
+  writer->_queue_frames = MICRO_DRAW_MALLOC(sizeof(int) * buffers);
+  if (writer->_pool == NULL || writer->_free == NULL
+      || writer->_queue == NULL || writer->_queue_frames == NULL)
+    goto error;
+  for (int i = 0; i < buffers; ++i)
+    writer->_free[i] = writer->_pool + frame_size * i;
+  writer->_free_count = buffers;
 
-_Static_assert(_MICRO_DRAW_PIXEL_MAX == 2,
-               "Updated MicroDrawPixel, should also update micro_from_to_ppm");
-MICRO_DRAW_DEF MicroDrawError
-micro_draw_from_ppm(const char* filename, unsigned char **data,
-                    int *data_width, int *data_height, MicroDrawPixel *pixel)
-{
-  _MicroDrawPPMType file_type = 0;
-  int color_max = 0;
-  MicroDrawError error = MICRO_DRAW_OK;
-  FILE *file = fopen(filename, "r");
-  if (file == NULL)
+  pthread_mutex_init(&writer->_mutex, NULL);
+  pthread_cond_init(&writer->_queued, NULL);
+  pthread_cond_init(&writer->_released, NULL);
+  if (pthread_create(&writer->_thread, NULL,
+                     _micro_draw_async_writer_thread, writer) != 0)
   {
-    perror("Error opening file");
-    return MICRO_DRAW_ERROR_OPEN_FILE;
+    pthread_cond_destroy(&writer->_released);
+    pthread_cond_destroy(&writer->_queued);
+    pthread_mutex_destroy(&writer->_mutex);
+    goto error;
   }
+  return MICRO_DRAW_OK;
+
+ error:
+  MICRO_DRAW_FREE(writer->_pool);
+  MICRO_DRAW_FREE(writer->_free);
+  MICRO_DRAW_FREE(writer->_queue);
+  MICRO_DRAW_FREE(writer->_queue_frames);
+  writer->_pool = NULL;
+  return MICRO_DRAW_ERROR_ALLOCATION;
+}
 
-  // Parse header ----------------------------------------------------
+MICRO_DRAW_DEF unsigned char *
+micro_draw_async_writer_acquire(MicroDrawAsyncWriter *writer)
+{
+  unsigned char *buffer = NULL;
+  pthread_mutex_lock(&writer->_mutex);
+  if (writer->policy == MICRO_DRAW_ASYNC_BLOCK)
+    while (writer->_free_count == 0)
+      pthread_cond_wait(&writer->_released, &writer->_mutex);
   
-  char magic[3];
-  fread(magic, 1, 3, file);
-  if (_micro_draw_strcmp(magic, "P1") == 0)
-  {
-    file_type = _MICRO_DRAW_P1;
-  } else if (_micro_draw_strcmp(magic, "P2") == 0)
-  {
-    file_type = _MICRO_DRAW_P2;
-  } else if (_micro_draw_strcmp(magic, "P3") == 0)
+  if (writer->_free_count > 0)
   {
-    file_type = _MICRO_DRAW_P3;
-  } else if (_micro_draw_strcmp(magic, "P4") == 0)
-  {
-    file_type = _MICRO_DRAW_P4;
-  } else if (_micro_draw_strcmp(magic, "P5") == 0)
-  {
-    file_type = _MICRO_DRAW_P5;
-  } else if (_micro_draw_strcmp(magic, "P6") == 0)
-  {
-    file_type = _MICRO_DRAW_P6;
-  }
-  else {
-    error = MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER;
-    goto done;
+    buffer = writer->_free[--writer->_free_count];
   }
-
-  // Data width
+  else if (writer->policy == MICRO_DRAW_ASYNC_DROP_OLDEST
+           && writer->_queue_count > 0)
   {
-    char num_buff[30] = {0};
-    int position = 0;
-    do
-    {
-      fread(num_buff + position, 1, 1, file);
-      position++;
-    } while (!_micro_draw_is_whitespace(num_buff[position-1]) && position < 30);
-    *data_width = atoi(num_buff);
-    if (*data_width == 0)
-    {
-      error = MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
-      goto done;
-    }
+    // Reuse the buffer of the oldest queued frame
+    buffer = writer->_queue[writer->_queue_start];
+    writer->_queue_start = (writer->_queue_start + 1) % writer->_queue_capacity;
+    writer->_queue_count--;
+    writer->frames_dropped++;
   }
-
-  // Data height
+  else
   {
-    char num_buff[30] = {0};
-    int position = 0;
-    do
-    {
-      fread(num_buff + position, 1, 1, file);
-      position++;
-    } while (!_micro_draw_is_whitespace(num_buff[position-1]) && position < 30);
-    *data_height = atoi(num_buff);
-    if (*data_width == 0)
-    {
-      error = MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
-      goto done;
-    }
+    // The only buffer is being written
+    writer->frames_dropped++;
+    writer->frames_submitted++;
   }
+  pthread_mutex_unlock(&writer->_mutex);
+  return buffer;
+}
 
-  // Color max
-  if (file_type != _MICRO_DRAW_P1 && file_type != _MICRO_DRAW_P4)
-  {
-    char num_buff[30] = {0};
-    int position = 0;
-    do
-    {
-      fread(num_buff + position, 1, 1, file);
-      position++;
-    } while (!_micro_draw_is_whitespace(num_buff[position-1]) && position < 30);
-    color_max = atoi(num_buff);
-    if (*data_width == 0)
-    {
-      error = MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE;
-      goto done;
-    }
-  }
+MICRO_DRAW_DEF void
+micro_draw_async_writer_commit(MicroDrawAsyncWriter *writer, unsigned char *buffer)
+{
+  pthread_mutex_lock(&writer->_mutex);
+  int end = (writer->_queue_start + writer->_queue_count) % writer->_queue_capacity;
+  writer->_queue[end] = buffer;
+  writer->_queue_frames[end] = writer->frames_submitted++;
+  writer->_queue_count++;
+  pthread_cond_signal(&writer->_queued);
+  pthread_mutex_unlock(&writer->_mutex);
+  return;
+}
 
-  // Parse raster ----------------------------------------------------
-  
-  // TODO
-  (void) data;
-  (void) data_width;
-  (void) data_height;
-  (void) pixel;
-  (void) color_max;
-  (void) file_type;
-  
-  assert(0 && "Not implemented");
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_submit(MicroDrawAsyncWriter *writer, unsigned char *data)
+{
+  unsigned char *buffer = micro_draw_async_writer_acquire(writer);
+  if (buffer == NULL) return MICRO_DRAW_OK;
+  size_t frame_size = (size_t)writer->width * writer->height
+    * micro_draw_get_channels(writer->pixel)
+    * micro_draw_get_channel_size(writer->pixel);
+  _micro_draw_memcpy(buffer, data, frame_size);
+  micro_draw_async_writer_commit(writer, buffer);
+  return MICRO_DRAW_OK;
+}
+
+MICRO_DRAW_DEF MicroDrawError
+micro_draw_async_writer_end(MicroDrawAsyncWriter *writer)
+{
+  if (writer->_pool == NULL) return MICRO_DRAW_ERROR_WRITE_FILE;
   
- done:
-  fclose(file);
-  return error;
+  pthread_mutex_lock(&writer->_mutex);
+  writer->_ending = 1;
+  pthread_cond_signal(&writer->_queued);
+  pthread_mutex_unlock(&writer->_mutex);
+  pthread_join(writer->_thread, NULL);
+
+  pthread_cond_destroy(&writer->_released);
+  pthread_cond_destroy(&writer->_queued);
+  pthread_mutex_destroy(&writer->_mutex);
+  MICRO_DRAW_FREE(writer->_pool);
+  MICRO_DRAW_FREE(writer->_free);
+  MICRO_DRAW_FREE(writer->_queue);
+  MICRO_DRAW_FREE(writer->_queue_frames);
+  writer->_pool = NULL;
+  return writer->error;
 }
 
-#endif // MICRO_DRAW_PPM
+#endif // MICRO_DRAW_ASYNC_WRITER
 
 unsigned char
 micro_draw_font[128][MICRO_DRAW_FONT_HEIGHT][MICRO_DRAW_FONT_WIDTH] = {
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#define MICRO_DRAW_ASYNC_WRITER
+#include "../micro-draw.h"
+
+#define WIDTH    40
+#define HEIGHT   30
+#define FRAMES   20
+#define CAPACITY 3
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+// Records the written frames. The first frame is held until the test
+// releases it, so that the queue fills up.
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int hold;
+  int holding;
+  int frames[FRAMES];
+  unsigned char colors[FRAMES];
+  int count;
+} Recorder;
+
+static MicroDrawError record(void *context, int frame, unsigned char *data,
+                             int data_width, int data_height, MicroDrawPixel pixel)
+{
+  Recorder *recorder = context;
+  assert(data_width == WIDTH && data_height == HEIGHT && pixel == MICRO_DRAW_RGBA8);
+  // Every pixel of the frame has the same color
+  for (int i = 0; i < WIDTH * HEIGHT * 4; ++i)
+    assert(data[i] == data[0]);
+
+  pthread_mutex_lock(&recorder->mutex);
+  recorder->holding = 1;
+  pthread_cond_broadcast(&recorder->cond);
+  while (recorder->hold)
+    pthread_cond_wait(&recorder->cond, &recorder->mutex);
+  recorder->frames[recorder->count] = frame;
+  recorder->colors[recorder->count] = data[0];
+  recorder->count++;
+  pthread_mutex_unlock(&recorder->mutex);
+  return MICRO_DRAW_OK;
+}
+
+static void recorder_init(Recorder *recorder, int hold)
+{
+  pthread_mutex_init(&recorder->mutex, NULL);
+  pthread_cond_init(&recorder->cond, NULL);
+  recorder->hold = hold;
+  recorder->holding = 0;
+  recorder->count = 0;
+  return;
+}
+
+static void recorder_wait_holding(Recorder *recorder)
+{
+  pthread_mutex_lock(&recorder->mutex);
+  while (!recorder->holding)
+    pthread_cond_wait(&recorder->cond, &recorder->mutex);
+  pthread_mutex_unlock(&recorder->mutex);
+  return;
+}
+
+static void recorder_release(Recorder *recorder)
+{
+  pthread_mutex_lock(&recorder->mutex);
+  recorder->hold = 0;
+  pthread_cond_broadcast(&recorder->cond);
+  pthread_mutex_unlock(&recorder->mutex);
+  return;
+}
+
+static void recorder_destroy(Recorder *recorder)
+{
+  pthread_cond_destroy(&recorder->cond);
+  pthread_mutex_destroy(&recorder->mutex);
+  return;
+}
+
+// Submit frames of color 0, 1, 2...
+static void submit(MicroDrawAsyncWriter *writer, unsigned char *image, int frame)
+{
+  memset(image, frame, WIDTH * HEIGHT * 4);
+  assert(micro_draw_async_writer_submit(writer, image) == MICRO_DRAW_OK);
+  return;
+}
+
+static MicroDrawError write_ppm(void *context, int frame, unsigned char *data,
+                                int data_width, int data_height, MicroDrawPixel pixel)
+{
+  char filename[64];
+  snprintf(filename, sizeof(filename), "%s-%d.ppm", (const char*)context, frame);
+  return micro_draw_to_ppm(filename, data, data_width, data_height, pixel);
+}
+
+int main(void)
+{
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  MicroDrawAsyncWriter writer;
+  Recorder recorder;
+
+  // Blocking keeps every frame, in order
+  recorder_init(&recorder, 0);
+  assert(micro_draw_async_writer_begin(&writer, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_BLOCK,
+                                       record, &recorder) == MICRO_DRAW_OK);
+  for (int frame = 0; frame < FRAMES; ++frame)
+    submit(&writer, image, frame);
+  assert(micro_draw_async_writer_end(&writer) == MICRO_DRAW_OK);
+  assert(writer.frames_submitted == FRAMES && writer.frames_written == FRAMES);
+  assert(writer.frames_dropped == 0 && recorder.count == FRAMES);
+  for (int i = 0; i < FRAMES; ++i)
+    assert(recorder.frames[i] == i && recorder.colors[i] == i);
+  recorder_destroy(&recorder);
+
+  // While the first frame is being written the queue fills up, then
+  // the new frames are dropped
+  recorder_init(&recorder, 1);
+  assert(micro_draw_async_writer_begin(&writer, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_DROP_NEWEST,
+                                       record, &recorder) == MICRO_DRAW_OK);
+  submit(&writer, image, 0);
+  recorder_wait_holding(&recorder);
+  for (int frame = 1; frame < 10; ++frame)
+    submit(&writer, image, frame);
+  recorder_release(&recorder);
+  assert(micro_draw_async_writer_end(&writer) == MICRO_DRAW_OK);
+  assert(writer.frames_submitted == 10 && writer.frames_dropped == 10 - 1 - CAPACITY);
+  assert(recorder.count == 1 + CAPACITY);
+  for (int i = 0; i < recorder.count; ++i)
+    assert(recorder.frames[i] == i && recorder.colors[i] == i);
+  recorder_destroy(&recorder);
+
+  // Same, but the newest frames replace the oldest queued ones
+  recorder_init(&recorder, 1);
+  assert(micro_draw_async_writer_begin(&writer, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_DROP_OLDEST,
+                                       record, &recorder) == MICRO_DRAW_OK);
+  submit(&writer, image, 0);
+  recorder_wait_holding(&recorder);
+  for (int frame = 1; frame < 10; ++frame)
+    submit(&writer, image, frame);
+  recorder_release(&recorder);
+  assert(micro_draw_async_writer_end(&writer) == MICRO_DRAW_OK);
+  assert(writer.frames_submitted == 10 && writer.frames_dropped == 10 - 1 - CAPACITY);
+  assert(recorder.count == 1 + CAPACITY);
+  assert(recorder.frames[0] == 0 && recorder.colors[0] == 0);
+  for (int i = 1; i < recorder.count; ++i)
+    assert(recorder.frames[i] == 10 - CAPACITY + i - 1
+           && recorder.colors[i] == 10 - CAPACITY + i - 1);
+  recorder_destroy(&recorder);
+
+  // Render directly in the buffers and save them as PPM files
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char white[4] = {255, 255, 255, 255};
+  assert(micro_draw_async_writer_begin(&writer, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_BLOCK,
+                                       write_ppm, "/tmp/test-async")
+         == MICRO_DRAW_OK);
+  for (int frame = 0; frame < 4; ++frame)
+  {
+    unsigned char *buffer = micro_draw_async_writer_acquire(&writer);
+    assert(buffer != NULL);
+    micro_draw_clear(buffer, WIDTH, HEIGHT, white, MICRO_DRAW_RGBA8);
+    micro_draw_fill_rect(buffer, WIDTH, HEIGHT, frame * 10, 0, 10, HEIGHT,
+                         red, MICRO_DRAW_RGBA8);
+    micro_draw_async_writer_commit(&writer, buffer);
+  }
+  assert(micro_draw_async_writer_end(&writer) == MICRO_DRAW_OK);
+  for (int frame = 0; frame < 4; ++frame)
+  {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/test-async-%d.ppm", frame);
+    unsigned char *read;
+    int width, height;
+    MicroDrawPixel pixel;
+    assert(micro_draw_from_ppm(filename, &read, &width, &height, &pixel)
+           == MICRO_DRAW_OK);
+    assert(width == WIDTH && height == HEIGHT);
+    for (int x = 0; x < WIDTH; ++x)
+      assert(read[x * 4 + 1] == ((x / 10 == frame) ? 0 : 255));
+    free(read);
+  }
+
+  // Errors of the thread are returned at the end
+  assert(micro_draw_async_writer_begin(&writer, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_BLOCK,
+                                       write_ppm, "/nonexistent/dir")
+         == MICRO_DRAW_OK);
+  submit(&writer, image, 0);
+  assert(micro_draw_async_writer_end(&writer) == MICRO_DRAW_ERROR_OPEN_FILE);
+
+  assert(micro_draw_async_writer_begin(&writer, 0, HEIGHT, MICRO_DRAW_RGBA8,
+                                       CAPACITY, MICRO_DRAW_ASYNC_BLOCK,
+                                       record, NULL)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+
+  free(image);
+  return 0;
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_BITMAP_FONTS
+#include "../micro-draw.h"
+
+#define WIDTH  64
+#define HEIGHT 32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Two 8x4 glyphs: an empty one and a box mapped to 'a'
+static const unsigned char psf2[] = {
+  0x72, 0xb5, 0x4a, 0x86, 0, 0, 0, 0, 32, 0, 0, 0, 1, 0, 0, 0,
+  2, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 8, 0, 0, 0,
+  0x00, 0x00, 0x00, 0x00,
+  0xFF, 0x81, 0x81, 0xFF,
+  '?', 0xFF,
+  'a', 0xFE, 'a', 'b', 0xFF,
+};
+
+// Sizes that wrap in 32 bits: a zero char size with a huge width,
+// and a huge height with a small char size
+static const unsigned char bad_psf2s[][48] = {
+  {
+    0x72, 0xb5, 0x4a, 0x86, 0, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF,
+  },
+  {
+    0x72, 0xb5, 0x4a, 0x86, 0, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 8, 0, 0, 0, 1, 0, 0, 0x20, 64, 0, 0, 0,
+  },
+};
+
+static const char bdf[] =
+  "STARTFONT 2.1\n"
+  "FONT test\n"
+  "FONTBOUNDINGBOX 3 3 0 -1\n"
+  "STARTPROPERTIES 2\n"
+  "FONT_ASCENT 3\n"
+  "FONT_DESCENT 1\n"
+  "ENDPROPERTIES\n"
+  "CHARS 2\n"
+  "STARTCHAR space\n"
+  "ENCODING 32\n"
+  "DWIDTH 4 0\n"
+  "BBX 0 0 0 0\n"
+  "BITMAP\n"
+  "ENDCHAR\n"
+  "STARTCHAR x\n"
+  "ENCODING 120\n"
+  "DWIDTH 4 0\n"
+  "BBX 3 3 0 -1\n"
+  "BITMAP\n"
+  "A0\n"
+  "40\n"
+  "A0\n"
+  "ENDCHAR\n"
+  "ENDFONT\n";
+
+// Malformed glyphs, each one must be rejected
+#define BDF_HEADER "STARTFONT 2.1\nFONT_ASCENT 3\nFONT_DESCENT 1\n"
+static const char *bad_bdfs[] = {
+  // Two BBX of different sizes
+  BDF_HEADER "STARTCHAR A\nENCODING 65\nBBX 8 1 0 0\nBBX 8 200 0 0\nBITMAP\n"
+  "FF\nENDCHAR\nENDFONT\n",
+  // No BBX
+  BDF_HEADER "STARTCHAR A\nENCODING 65\nBITMAP\nFF\nENDCHAR\nENDFONT\n",
+  // No BBX, after a glyph with one
+  BDF_HEADER "STARTCHAR A\nENCODING 65\nBBX 8 1 0 0\nBITMAP\nFF\nENDCHAR\n"
+  "STARTCHAR B\nENCODING 66\nBITMAP\nFF\nFF\nENDCHAR\nENDFONT\n",
+  // No BBX, after an unencoded glyph with one
+  BDF_HEADER "STARTCHAR A\nENCODING -1\nBBX 8 1 0 0\nENDCHAR\n"
+  "STARTCHAR B\nENCODING 66\nBITMAP\nFF\nENDCHAR\nENDFONT\n",
+  // Too large
+  BDF_HEADER "STARTCHAR A\nENCODING 65\nBBX 100000 1 0 0\nBITMAP\nFF\nENDCHAR\n"
+  "ENDFONT\n",
+  // Not hexadecimal
+  BDF_HEADER "STARTCHAR A\nENCODING 65\nBBX 8 1 0 0\nBITMAP\nZZ\nENDCHAR\n"
+  "ENDFONT\n",
+};
+
+static int is_set(unsigned char *data, int x, int y)
+{
+  return data[(y * WIDTH + x) * 4] == 255;
+}
+
+int main(void)
+{
+  unsigned char* data = malloc(WIDTH * HEIGHT * 4);
+  unsigned char black[4] = {0, 0, 0, 255};
+  unsigned char white[4] = {255, 255, 255, 255};
+  MicroDrawFont font;
+
+  // PSF2
+  assert(micro_draw_font_from_psf2(&font, psf2, sizeof(psf2)) == MICRO_DRAW_OK);
+  assert(font.glyphs_count == 2 && font.atlas_size == 8);
+  assert(font.line_height == 4);
+  assert(micro_draw_font_glyph(&font, 'a') == 1);
+  assert(micro_draw_font_glyph(&font, '?') == 0);
+  assert(micro_draw_font_glyph(&font, 'b') == 0);
+
+  micro_draw_clear(data, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  micro_draw_text_font(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, &font,
+                       "?a\na", 2, 2, white);
+  assert(!is_set(data, 2, 2));
+  assert(is_set(data, 10, 2) && is_set(data, 17, 5) && !is_set(data, 11, 3));
+  assert(is_set(data, 2, 6) && is_set(data, 9, 9) && !is_set(data, 3, 7));
+  micro_draw_font_free(&font);
+
+  // Load from file
+  FILE *file = fopen("/tmp/test-font.psf", "wb");
+  assert(file != NULL);
+  fwrite(psf2, 1, sizeof(psf2), file);
+  fclose(file);
+  assert(micro_draw_font_load(&font, "/tmp/test-font.psf") == MICRO_DRAW_OK);
+  assert(font.glyphs_count == 2);
+  micro_draw_font_free(&font);
+
+  for (size_t i = 0; i < sizeof(bad_psf2s) / sizeof(bad_psf2s[0]); ++i)
+    assert(micro_draw_font_from_psf2(&font, bad_psf2s[i], sizeof(bad_psf2s[i]))
+           == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  
+  // BDF
+  assert(micro_draw_font_from_bdf(&font, (const unsigned char*)bdf,
+                                  strlen(bdf)) == MICRO_DRAW_OK);
+  assert(font.glyphs_count == 2 && font.atlas_size == 3);
+  assert(font.line_height == 4);
+  assert(micro_draw_font_glyph(&font, 'x') == 1);
+  assert(font.glyphs[1].y == 1 && font.glyphs[1].advance == 4);
+
+  micro_draw_clear(data, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  micro_draw_text_font(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, &font,
+                       "x x", 0, 0, white);
+  assert(is_set(data, 0, 1) && is_set(data, 2, 1) && !is_set(data, 1, 1));
+  assert(is_set(data, 1, 2) && is_set(data, 0, 3) && !is_set(data, 0, 0));
+  assert(is_set(data, 8, 1) && is_set(data, 9, 2));
+
+  // Clipped at the borders
+  micro_draw_text_font(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, &font,
+                       "xxxxxxxxxxxxxxxxxxxx", -2, HEIGHT - 2, white);
+  micro_draw_font_free(&font);
+
+  for (size_t i = 0; i < sizeof(bad_bdfs) / sizeof(bad_bdfs[0]); ++i)
+    assert(micro_draw_font_from_bdf(&font, (const unsigned char*)bad_bdfs[i],
+                                    strlen(bad_bdfs[i]))
+           == MICRO_DRAW_ERROR_INVALID_FORMAT);
+
+  free(data);
+  return 0;
+}
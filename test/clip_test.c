@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_THREADS 4
+#include "../micro-draw.h"
+
+#define WIDTH  300
+#define HEIGHT 200
+#define SIZE   (WIDTH * HEIGHT * 4)
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned char *sprite;
+static unsigned char *scaled;
+static MicroDrawCommandList list;
+
+static void draw(unsigned char *image, int primitive)
+{
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char blue[4] = {0, 0, 255, 255};
+  char text[] = "Clipped\ntext";
+  MicroDrawTextItem items[2] = {
+    { text, 20, 60, red },
+    { text, 100, 90, blue },
+  };
+  MicroDrawSurface surface = {
+    .data = image,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .stride = WIDTH * 4,
+    .pixel = MICRO_DRAW_RGBA8,
+  };
+  switch (primitive)
+  {
+  case 0:
+    micro_draw_clear(image, WIDTH, HEIGHT, red, MICRO_DRAW_RGBA8);
+    break;
+  case 1:
+    micro_draw_line(image, WIDTH, HEIGHT, -10, 195, 290, 5, red, MICRO_DRAW_RGBA8);
+    break;
+  case 2:
+    micro_draw_fill_rect(image, WIDTH, HEIGHT, 20, 30, 250, 100, red, MICRO_DRAW_RGBA8);
+    break;
+  case 3:
+    micro_draw_fill_circle(image, WIDTH, HEIGHT, 120, 90, 70, red, MICRO_DRAW_RGBA8);
+    break;
+  case 4:
+    micro_draw_fill_triangle(image, WIDTH, HEIGHT, 0, 0, 290, 60, 60, 199,
+                             red, MICRO_DRAW_RGBA8);
+    break;
+  case 5:
+    micro_draw_text(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, text, 10, 40, 1.5, red);
+    break;
+  case 6:
+    assert(micro_draw_text_batch(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, NULL, 1,
+                                 items, 2) == MICRO_DRAW_OK);
+    break;
+  case 7:
+    micro_draw_overlap(sprite, 120, 80, MICRO_DRAW_RGBA8, image, WIDTH, HEIGHT,
+                       MICRO_DRAW_RGBA8, 50, 40);
+    break;
+  case 8:
+    micro_draw_scaled(scaled, 60, 40, MICRO_DRAW_RGBA8, image, WIDTH, HEIGHT,
+                      MICRO_DRAW_RGBA8);
+    break;
+  case 9:
+    micro_draw_execute(&list, &surface);
+    break;
+  default:
+    assert(micro_draw_execute_tiled(&list, &surface) == MICRO_DRAW_OK);
+    break;
+  }
+  return;
+}
+
+int main(void)
+{
+  // Nested clips are intersected
+  MicroDrawRect rect = micro_draw_clip_rect(WIDTH, HEIGHT);
+  assert(rect.x == 0 && rect.y == 0 && rect.w == WIDTH && rect.h == HEIGHT);
+  assert(micro_draw_clip_push((MicroDrawRect) { 10, 10, 100, 100 }) == MICRO_DRAW_OK);
+  assert(micro_draw_clip_push((MicroDrawRect) { 50, -5, 200, 30 }) == MICRO_DRAW_OK);
+  rect = micro_draw_clip_rect(WIDTH, HEIGHT);
+  assert(rect.x == 50 && rect.y == 10 && rect.w == 60 && rect.h == 15);
+  assert(micro_draw_clip_push((MicroDrawRect) { 500, 0, 10, 10 }) == MICRO_DRAW_OK);
+  rect = micro_draw_clip_rect(WIDTH, HEIGHT);
+  assert(rect.w == 0 && rect.h == 0);
+  micro_draw_clip_pop();
+  micro_draw_clip_pop();
+  rect = micro_draw_clip_rect(50, 50);
+  assert(rect.x == 10 && rect.y == 10 && rect.w == 40 && rect.h == 40);
+  micro_draw_clip_pop();
+  micro_draw_clip_pop();
+  rect = micro_draw_clip_rect(WIDTH, HEIGHT);
+  assert(rect.w == WIDTH && rect.h == HEIGHT);
+
+  for (int i = 0; i < MICRO_DRAW_CLIP_STACK_SIZE; ++i)
+    assert(micro_draw_clip_push((MicroDrawRect) { 0, 0, WIDTH, HEIGHT }) == MICRO_DRAW_OK);
+  assert(micro_draw_clip_push((MicroDrawRect) { 0, 0, 1, 1 })
+         == MICRO_DRAW_ERROR_CLIP_STACK_FULL);
+  for (int i = 0; i < MICRO_DRAW_CLIP_STACK_SIZE; ++i)
+    micro_draw_clip_pop();
+
+  sprite = malloc(120 * 80 * 4);
+  scaled = malloc(60 * 40 * 4);
+  for (int i = 0; i < 120 * 80 * 4; ++i)
+    sprite[i] = i * 7;
+  for (int i = 0; i < 60 * 40 * 4; ++i)
+    scaled[i] = i * 3;
+  unsigned char green[4] = {0, 255, 0, 255};
+  assert(micro_draw_record_fill_rect(&list, 0, 0, WIDTH, HEIGHT, green,
+                                     MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  assert(micro_draw_record_fill_circle(&list, 100, 100, 80, green, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_text(&list, "list", 30, 50, 2, green, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_overlap(&list, sprite, 120, 80, MICRO_DRAW_RGBA8, 70, 70)
+         == MICRO_DRAW_OK);
+
+  // Every primitive draws the same as without a clip inside of it, and
+  // nothing outside
+  unsigned char *background = malloc(SIZE);
+  unsigned char *expected = malloc(SIZE);
+  unsigned char *image = malloc(SIZE);
+  for (int i = 0; i < SIZE; ++i)
+    background[i] = i * 5;
+  MicroDrawRect clips[3] = {
+    { 37, 25, 150, 101 },
+    { -20, 70, 100, 500 },
+    // Mostly outside, few primitives reach it
+    { 290, 190, 30, 30 },
+  };
+  for (int c = 0; c < 3; ++c)
+    for (int primitive = 0; primitive < 11; ++primitive)
+    {
+      memcpy(expected, background, SIZE);
+      draw(expected, primitive);
+      memcpy(image, background, SIZE);
+      assert(micro_draw_clip_push(clips[c]) == MICRO_DRAW_OK);
+      rect = micro_draw_clip_rect(WIDTH, HEIGHT);
+      draw(image, primitive);
+      micro_draw_clip_pop();
+      int changed = 0;
+      for (int y = 0; y < HEIGHT; ++y)
+        for (int x = 0; x < WIDTH; ++x)
+        {
+          int index = (y * WIDTH + x) * 4;
+          int inside = x >= rect.x && x < rect.x + rect.w
+            && y >= rect.y && y < rect.y + rect.h;
+          unsigned char *source = inside ? expected : background;
+          assert(memcmp(image + index, source + index, 4) == 0);
+          changed += memcmp(image + index, background + index, 4) != 0;
+        }
+      assert(changed > 0 || c == 2);
+    }
+
+  // A clipped clear of a lazily cleared surface writes only the clip
+  MicroDrawLazyClear clear;
+  assert(micro_draw_lazy_clear_init(&clear, WIDTH, HEIGHT) == MICRO_DRAW_OK);
+  MicroDrawSurface surface = {
+    .data = image,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .stride = WIDTH * 4,
+    .pixel = MICRO_DRAW_RGBA8,
+    .lazy_clear = &clear,
+  };
+  unsigned char gray[4] = {90, 90, 90, 255};
+  micro_draw_surface_clear(&surface, gray);
+  assert(micro_draw_clip_push(clips[0]) == MICRO_DRAW_OK);
+  micro_draw_surface_clear(&surface, green);
+  micro_draw_clip_pop();
+  micro_draw_lazy_clear_resolve(&surface);
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      int inside = x >= clips[0].x && x < clips[0].x + clips[0].w
+        && y >= clips[0].y && y < clips[0].y + clips[0].h;
+      assert(memcmp(image + (y * WIDTH + x) * 4, inside ? green : gray, 4) == 0);
+    }
+  micro_draw_lazy_clear_free(&clear);
+
+  micro_draw_command_list_free(&list);
+  free(image);
+  free(expected);
+  free(background);
+  free(scaled);
+  free(sprite);
+  return 0;
+}
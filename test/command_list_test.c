@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  300
+#define HEIGHT 200
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned char sprite[16 * 16 * 4];
+
+// Draw the same scene on [data] right away, and record it in [list]
+static void scene(unsigned char *data, MicroDrawCommandList *list,
+                  MicroDrawPixel pixel, int frame)
+{
+  unsigned char white[4] = {255, 255, 255, 255};
+  unsigned char black[4] = {0, 0, 0, 255};
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char blue[4] = {0, 0, 255, 255};
+  unsigned char gray[4] = {128, 128, 128, 255};
+  unsigned char colors[5][4];
+  unsigned char *rgba[5] = { white, black, red, blue, gray };
+  for (int i = 0; i < 5; ++i)
+    micro_draw_color_from_rgba8(rgba[i], colors[i], pixel);
+
+  micro_draw_fill_rect(data, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT, colors[0], pixel);
+  assert(micro_draw_record_fill_rect(list, 0, 0, WIDTH, HEIGHT, colors[0], pixel)
+         == MICRO_DRAW_OK);
+  micro_draw_fill_circle(data, WIDTH, HEIGHT, 50 + frame, 60, 40, colors[2], pixel);
+  assert(micro_draw_record_fill_circle(list, 50 + frame, 60, 40, colors[2], pixel)
+         == MICRO_DRAW_OK);
+  micro_draw_fill_triangle(data, WIDTH, HEIGHT, 100, 150, 250, 20, 280, 190,
+                           colors[3], pixel);
+  assert(micro_draw_record_fill_triangle(list, 100, 150, 250, 20, 280, 190,
+                                         colors[3], pixel) == MICRO_DRAW_OK);
+  micro_draw_line(data, WIDTH, HEIGHT, 10, 190, 290, 10, colors[1], pixel);
+  assert(micro_draw_record_line(list, 10, 190, 290, 10, colors[1], pixel)
+         == MICRO_DRAW_OK);
+  micro_draw_line(data, WIDTH, HEIGHT, 150, 0, 160, 199, colors[1], pixel);
+  assert(micro_draw_record_line(list, 150, 0, 160, 199, colors[1], pixel)
+         == MICRO_DRAW_OK);
+  micro_draw_text(data, WIDTH, HEIGHT, pixel, "Hello\nworld", 20, 120, 0.3,
+                  colors[4]);
+  assert(micro_draw_record_text(list, "Hello\nworld", 20, 120, 0.3, colors[4],
+                                pixel) == MICRO_DRAW_OK);
+  micro_draw_overlap(sprite, 16, 16, MICRO_DRAW_RGBA8, data, WIDTH, HEIGHT,
+                     pixel, 200 + frame, 100);
+  assert(micro_draw_record_overlap(list, sprite, 16, 16, MICRO_DRAW_RGBA8,
+                                   200 + frame, 100) == MICRO_DRAW_OK);
+  // Partially and fully outside
+  micro_draw_fill_rect(data, WIDTH, HEIGHT, -20, -20, 40, 40, colors[1], pixel);
+  assert(micro_draw_record_fill_rect(list, -20, -20, 40, 40, colors[1], pixel)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_fill_circle(list, -100, 500, 30, colors[1], pixel)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_text(list, "away", WIDTH + 10, 0, 1, colors[1], pixel)
+         == MICRO_DRAW_OK);
+  return;
+}
+
+int main(void)
+{
+  for (int i = 0; i < 16 * 16 * 4; ++i)
+    sprite[i] = i * 7;
+
+  MicroDrawPixel pixels[4] = { MICRO_DRAW_RGBA8, MICRO_DRAW_RGB8,
+                               MICRO_DRAW_GRAY8, MICRO_DRAW_BLACK_WHITE };
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *replayed = malloc(WIDTH * HEIGHT * 4);
+  MicroDrawCommandList list = {0};
+
+  for (int i = 0; i < 4; ++i)
+  {
+    int size = WIDTH * HEIGHT * micro_draw_get_channels(pixels[i]);
+    MicroDrawSurface surface = {
+      .data = replayed,
+      .width = WIDTH,
+      .height = HEIGHT,
+      .stride = WIDTH * micro_draw_get_channels(pixels[i]),
+      .pixel = pixels[i],
+    };
+    // The list is reused across frames
+    for (int frame = 0; frame < 3; ++frame)
+    {
+      micro_draw_command_list_clear(&list);
+      scene(expected, &list, pixels[i], frame * 10);
+      assert(list.count == 10);
+      memset(replayed, 0x55, size);
+      micro_draw_execute(&list, &surface);
+      assert(memcmp(expected, replayed, size) == 0);
+    }
+  }
+
+  // The same list can be executed on any pixel format
+  micro_draw_command_list_clear(&list);
+  scene(expected, &list, MICRO_DRAW_RGBA8, 0);
+  scene(expected, &list, MICRO_DRAW_RGB8, 0);
+  MicroDrawSurface surface = {
+    .data = replayed,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .stride = WIDTH * 3,
+    .pixel = MICRO_DRAW_RGB8,
+  };
+  assert(micro_draw_execute(&list, &surface) == MICRO_DRAW_OK);
+  assert(memcmp(expected, replayed, WIDTH * HEIGHT * 3) == 0);
+
+  // Padded rows are not drawn on
+  unsigned char padded[48 * 2] = {0};
+  unsigned char white[4] = {255, 255, 255, 255};
+  MicroDrawSurface padded_surface = {
+    .data = padded,
+    .width = 8,
+    .height = 2,
+    .stride = 48,
+    .pixel = MICRO_DRAW_RGBA8,
+  };
+  micro_draw_command_list_clear(&list);
+  assert(micro_draw_record_fill_rect(&list, 0, 1, 1, 1, white,
+                                     MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  assert(micro_draw_execute(&list, &padded_surface)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+  assert(micro_draw_execute_tiled(&list, &padded_surface)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+  assert(micro_draw_surface_clear(&padded_surface, white)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+  for (size_t i = 0; i < sizeof(padded); ++i)
+    assert(padded[i] == 0);
+
+  micro_draw_command_list_free(&list);
+  assert(list.bytes == NULL && list.count == 0);
+  free(replayed);
+  free(expected);
+  return 0;
+}
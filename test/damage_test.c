@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  300
+#define HEIGHT 200
+#define TILE   MICRO_DRAW_DAMAGE_TILE_SIZE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static int inside(MicroDrawRect *rects, int count, int x, int y)
+{
+  for (int i = 0; i < count; ++i)
+    if (x >= rects[i].x && x < rects[i].x + rects[i].w
+        && y >= rects[i].y && y < rects[i].y + rects[i].h)
+      return 1;
+  return 0;
+}
+
+int main(void)
+{
+  MicroDrawDamage damage;
+  MicroDrawRect rects[64];
+  assert(micro_draw_damage_init(&damage, WIDTH, HEIGHT) == MICRO_DRAW_OK);
+  assert(micro_draw_damage_rects(&damage, rects, 64) == 0);
+
+  // A rectangle inside a single tile, and one partly outside
+  micro_draw_damage_add(&damage, (MicroDrawRect) { TILE + 1, TILE + 2, 3, 3 });
+  assert(damage.count == 1);
+  assert(micro_draw_damage_rects(&damage, rects, 64) == 1);
+  assert(rects[0].x == TILE && rects[0].y == TILE);
+  assert(rects[0].w == TILE && rects[0].h == TILE);
+  micro_draw_damage_add(&damage, (MicroDrawRect) { WIDTH - 5, -10, 100, 15 });
+  assert(micro_draw_damage_rects(&damage, rects, 64) == 2);
+  assert(rects[0].x == WIDTH / TILE * TILE && rects[0].y == 0);
+  assert(rects[0].w == WIDTH % TILE && rects[0].h == TILE);
+  micro_draw_damage_add(&damage, (MicroDrawRect) { -50, -50, 10, 10 });
+  micro_draw_damage_clear(&damage);
+  assert(damage.count == 0 && micro_draw_damage_rects(&damage, rects, 64) == 0);
+
+  // The same runs of tiles in consecutive rows are merged
+  micro_draw_damage_add(&damage, (MicroDrawRect) { 10, 10, 50, 100 });
+  micro_draw_damage_add(&damage, (MicroDrawRect) { 150, 40, 20, 20 });
+  assert(micro_draw_damage_rects(&damage, rects, 64) == 2);
+  assert(rects[0].x == 0 && rects[0].y == 0);
+  assert(rects[0].w == 4 * TILE && rects[0].h == 7 * TILE);
+  assert(rects[1].x == 9 * TILE && rects[1].y == 2 * TILE);
+  assert(rects[1].w == 2 * TILE && rects[1].h == 2 * TILE);
+
+  // With too many rectangles, the last one grows
+  micro_draw_damage_clear(&damage);
+  for (int i = 0; i < 10; ++i)
+    micro_draw_damage_add(&damage, (MicroDrawRect) { i * 2 * TILE, i * TILE, 1, 1 });
+  assert(micro_draw_damage_rects(&damage, rects, 3) == 3);
+  assert(rects[2].x == 4 * TILE && rects[2].y == 2 * TILE);
+  assert(rects[2].w == WIDTH - 4 * TILE && rects[2].h == 8 * TILE);
+
+  // A frame drawn on the previous one changes only the damaged area
+  unsigned char *previous = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char gray[4] = {100, 100, 100, 255};
+  unsigned char red[4] = {255, 0, 0, 255};
+  micro_draw_clear(previous, WIDTH, HEIGHT, gray, MICRO_DRAW_RGBA8);
+  MicroDrawCommandList list = {0};
+  assert(micro_draw_record_fill_circle(&list, 40, 150, 20, red, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_line(&list, 200, 10, 250, 60, red, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_text(&list, "ok", 100, 100, 0.5, red, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_fill_rect(&list, -100, 0, 10, 10, red, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  for (int tiled = 0; tiled < 2; ++tiled)
+  {
+    micro_draw_damage_clear(&damage);
+    memcpy(image, previous, WIDTH * HEIGHT * 4);
+    MicroDrawSurface surface = {
+      .data = image,
+      .width = WIDTH,
+      .height = HEIGHT,
+      .stride = WIDTH * 4,
+      .pixel = MICRO_DRAW_RGBA8,
+      .damage = &damage,
+    };
+    if (tiled)
+      assert(micro_draw_execute_tiled(&list, &surface) == MICRO_DRAW_OK);
+    else
+      micro_draw_execute(&list, &surface);
+    int count = micro_draw_damage_rects(&damage, rects, 64);
+    assert(count > 0 && damage.count < damage.columns * damage.rows / 4);
+    int changed = 0;
+    for (int y = 0; y < HEIGHT; ++y)
+      for (int x = 0; x < WIDTH; ++x)
+      {
+        int index = (y * WIDTH + x) * 4;
+        if (memcmp(image + index, previous + index, 4) == 0) continue;
+        assert(inside(rects, count, x, y));
+        changed++;
+      }
+    assert(changed > 0);
+  }
+
+  micro_draw_command_list_free(&list);
+  free(image);
+  free(previous);
+  micro_draw_damage_free(&damage);
+  assert(micro_draw_damage_init(&damage, 0, 10) == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  return 0;
+}
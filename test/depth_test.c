@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  203
+#define HEIGHT 157
+#define TILE   MICRO_DRAW_DEPTH_TILE_SIZE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned char red[4] = {255, 0, 0, 255};
+static unsigned char blue[4] = {0, 0, 255, 255};
+static unsigned char green[4] = {0, 255, 0, 255};
+
+// A far triangle crossing a near one, and a large one behind both
+static void draw(unsigned char *image, MicroDrawDepth *depth, int order)
+{
+  for (int i = 0; i < 3; ++i)
+  {
+    switch ((i + order) % 3)
+    {
+    case 0:
+      micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, depth,
+                                 10, 10, 0.2, 190, 30, 0.9, 40, 140, 0.5,
+                                 red, MICRO_DRAW_RGBA8);
+      break;
+    case 1:
+      // Other winding
+      micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, depth,
+                                 20, 120, 0.1, 180, 140, 0.7, 150, 5, 0.4,
+                                 blue, MICRO_DRAW_RGBA8);
+      break;
+    default:
+      micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, depth,
+                                 -100, -100, 0.95, 400, -10, 0.95, -10, 400, 0.95,
+                                 green, MICRO_DRAW_RGBA8);
+      break;
+    }
+  }
+  return;
+}
+
+// The range of every tile is the range of its depths
+static void check_tiles(MicroDrawDepth *depth)
+{
+  for (int tile_y = 0; tile_y < depth->rows; ++tile_y)
+    for (int tile_x = 0; tile_x < depth->columns; ++tile_x)
+    {
+      unsigned int min = 0xFFFFFFFF, max = 0;
+      for (int y = tile_y * TILE; y < (tile_y + 1) * TILE && y < depth->height; ++y)
+        for (int x = tile_x * TILE; x < (tile_x + 1) * TILE && x < depth->width; ++x)
+        {
+          unsigned int z = _micro_draw_depth_get(depth, y * depth->width + x);
+          min = z < min ? z : min;
+          max = z > max ? z : max;
+        }
+      assert(depth->tile_min[tile_y * depth->columns + tile_x] == min);
+      assert(depth->tile_max[tile_y * depth->columns + tile_x] == max);
+    }
+  return;
+}
+
+int main(void)
+{
+  MicroDrawDepth depth;
+  assert(micro_draw_depth_init(&depth, 0, 10, MICRO_DRAW_DEPTH16)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  assert(micro_draw_depth_init(&depth, 10, 10, _MICRO_DRAW_DEPTH_MAX)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+  micro_draw_depth_free(&depth);
+
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  MicroDrawDepthFormat formats[2] = { MICRO_DRAW_DEPTH16, MICRO_DRAW_DEPTH32 };
+  for (int f = 0; f < 2; ++f)
+  {
+    assert(micro_draw_depth_init(&depth, WIDTH, HEIGHT, formats[f]) == MICRO_DRAW_OK);
+    unsigned int far = (formats[f] == MICRO_DRAW_DEPTH16) ? 0xFFFF : 0xFFFFFFFF;
+    assert(depth.columns == (WIDTH + TILE - 1) / TILE);
+    assert(_micro_draw_depth_get(&depth, WIDTH * HEIGHT - 1) == far);
+    check_tiles(&depth);
+
+    // The same pixels as micro_draw_fill_triangle, at the interpolated
+    // depth
+    memset(image, 0, WIDTH * HEIGHT * 4);
+    memset(expected, 0, WIDTH * HEIGHT * 4);
+    micro_draw_fill_triangle(expected, WIDTH, HEIGHT, 5, 5, 190, 20, 100, 150,
+                             red, MICRO_DRAW_RGBA8);
+    micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, &depth, 5, 5, 0.5,
+                               190, 20, 0.5, 100, 150, 0.5, red, MICRO_DRAW_RGBA8);
+    assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+    unsigned int half = _micro_draw_depth_get(&depth, 20 * WIDTH + 40);
+    assert(half >= far / 2 - 1 && half <= far / 2 + 1);
+    check_tiles(&depth);
+    micro_draw_depth_clear(&depth, 1);
+    micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, &depth, 0, 0, 0,
+                               WIDTH * 2, 0, 1, 0, HEIGHT * 2, 0, red, MICRO_DRAW_RGBA8);
+    unsigned int step = _micro_draw_depth_get(&depth, 1) - _micro_draw_depth_get(&depth, 0);
+    for (int x = 1; x < WIDTH; ++x)
+    {
+      unsigned int z = _micro_draw_depth_get(&depth, x);
+      assert(z - _micro_draw_depth_get(&depth, x - 1) - step <= 1
+             || _micro_draw_depth_get(&depth, x - 1) + step - z <= 1);
+      assert(_micro_draw_depth_get(&depth, WIDTH * 7 + x) == z);
+    }
+
+    // The result does not depend on the order
+    for (int order = 0; order < 3; ++order)
+    {
+      unsigned char *target = (order == 0) ? expected : image;
+      memset(target, 0, WIDTH * HEIGHT * 4);
+      micro_draw_depth_clear(&depth, 1);
+      draw(target, &depth, order);
+      check_tiles(&depth);
+      if (order > 0)
+        assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+    }
+    // Each color where its triangle is the nearest
+    assert(memcmp(expected + (15 * WIDTH + 20) * 4, red, 4) == 0);
+    assert(memcmp(expected + (120 * WIDTH + 160) * 4, blue, 4) == 0);
+    assert(memcmp(expected + (150 * WIDTH + 5) * 4, green, 4) == 0);
+
+    // Behind everything, nothing changes
+    memcpy(image, expected, WIDTH * HEIGHT * 4);
+    micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, &depth,
+                               0, 0, 0.99, 300, 0, 0.99, 0, 300, 0.99,
+                               red, MICRO_DRAW_RGBA8);
+    assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+
+    // Only inside the clip
+    micro_draw_depth_clear(&depth, 1);
+    memset(image, 0, WIDTH * HEIGHT * 4);
+    assert(micro_draw_clip_push((MicroDrawRect) { 30, 40, 50, 20 }) == MICRO_DRAW_OK);
+    micro_draw_fill_triangle_z(image, WIDTH, HEIGHT, &depth,
+                               0, 0, 0, 300, 0, 0, 0, 300, 0, red, MICRO_DRAW_RGBA8);
+    micro_draw_clip_pop();
+    for (int y = 0; y < HEIGHT; ++y)
+      for (int x = 0; x < WIDTH; ++x)
+      {
+        int inside = x >= 30 && x < 80 && y >= 40 && y < 60;
+        assert(image[(y * WIDTH + x) * 4] == (inside ? 255 : 0));
+        assert(_micro_draw_depth_get(&depth, y * WIDTH + x) == (inside ? 0 : far));
+      }
+    check_tiles(&depth);
+    micro_draw_depth_free(&depth);
+  }
+
+  free(expected);
+  free(image);
+  return 0;
+}
@@ -8,28 +8,133 @@
 #include "../micro-draw.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 
-int main(void)
+static void write_file(const char *filename, const void *content, int size)
+{
+  FILE *file = fopen(filename, "wb");
+  assert(file != NULL);
+  fwrite(content, 1, size, file);
+  fclose(file);
+}
+
+// Read [content] as a ppm file and check that it is a 3x2 image
+static unsigned char *read_ppm(const void *content, int size,
+                               MicroDrawPixel expected_pixel)
 {
   unsigned char* data;
   int width, height;
   MicroDrawPixel pixel;
-
+  
+  write_file("/tmp/test-from-ppm.ppm", content, size);
   MicroDrawError error =
-          micro_draw_from_ppm("/tmp/test-to-ppm.ppm",
+          micro_draw_from_ppm("/tmp/test-from-ppm.ppm",
           &data,
           &width, &height,
           &pixel);
   if (error != MICRO_DRAW_OK)
   {
     fprintf(stderr, "Error %d opening ppm file\n", error);
-    return 1;
+    exit(1);
   }
+  assert(width == 3 && height == 2);
+  assert(pixel == expected_pixel);
+  return data;
+}
 
-  //printf("data_height: %d, data_width: %d, color_max: %d\n",
-  //       height, width, color_max);
+int main(void)
+{
+  // In PBM 1 is black, which is 0 in Black&White
+  const unsigned char bw[6] = {0, 1, 0, 1, 1, 0};
+  // Gray values 0, 51, 102, 153, 204, 255
+  const unsigned char gray[6] = {0, 51, 102, 153, 204, 255};
+  const unsigned char rgb[18] = {
+    255, 0, 0,    0, 255, 0,      0, 0, 255,
+    1, 2, 3,      250, 251, 252,  128, 128, 128,
+  };
+  unsigned char *data;
   
+  const char p1[] = "P1\n# comment\n3 2\n1 0 1\n001\n";
+  data = read_ppm(p1, sizeof(p1) - 1, MICRO_DRAW_BLACK_WHITE);
+  assert(memcmp(data, bw, 6) == 0);
+  free(data);
+
+  const unsigned char p4[] = { 'P', '4', ' ', '3', ' ', '2', '\n', 0xA0, 0x20 };
+  data = read_ppm(p4, sizeof(p4), MICRO_DRAW_BLACK_WHITE);
+  assert(memcmp(data, bw, 6) == 0);
   free(data);
+
+  const char p2[] = "P2 3 2 5\n0 1 2\n3 4 5\n";
+  data = read_ppm(p2, sizeof(p2) - 1, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < 6; ++i)
+    assert(data[i*4] == gray[i] && data[i*4+1] == gray[i]
+           && data[i*4+2] == gray[i] && data[i*4+3] == 255);
+  free(data);
+
+  const unsigned char p5[] = { 'P', '5', '\n', '3', ' ', '2', '\n', '5', '\n',
+                               0, 1, 2, 3, 4, 5 };
+  data = read_ppm(p5, sizeof(p5), MICRO_DRAW_RGBA8);
+  for (int i = 0; i < 6; ++i)
+    assert(data[i*4] == gray[i] && data[i*4+3] == 255);
+  free(data);
+
+  const char p3[] = "P3\n3 2\n#max\n255\n255 0 0 0 255 0 0 0 255\n"
+                    "1 2 3 250 251 252 128 128 128\n";
+  data = read_ppm(p3, sizeof(p3) - 1, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < 6; ++i)
+    assert(memcmp(data + i*4, rgb + i*3, 3) == 0 && data[i*4+3] == 255);
+  free(data);
+
+  unsigned char p6[15 + 18] = "P6\n3 2\n255\n";
+  memcpy(p6 + 11, rgb, 18);
+  data = read_ppm(p6, 11 + 18, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < 6; ++i)
+    assert(memcmp(data + i*4, rgb + i*3, 3) == 0 && data[i*4+3] == 255);
+  free(data);
+
+  // 16 bits samples
+  unsigned char p6_wide[13 + 36] = "P6 3 2 65535\n";
+  for (int i = 0; i < 18; ++i)
+  {
+    p6_wide[13 + i*2] = rgb[i];
+    p6_wide[13 + i*2 + 1] = rgb[i];
+  }
+  data = read_ppm(p6_wide, sizeof(p6_wide), MICRO_DRAW_RGBA8);
+  for (int i = 0; i < 6; ++i)
+    assert(memcmp(data + i*4, rgb + i*3, 3) == 0 && data[i*4+3] == 255);
+  free(data);
+
+  // A larger image, to go through the vectorized path
+  int width = 37, height = 11;
+  int size = 16 + width * height * 3;
+  unsigned char *big = malloc(size);
+  int header = snprintf((char*)big, 16, "P6\n%d %d\n255\n", width, height);
+  for (int i = 0; i < width * height * 3; ++i)
+    big[header + i] = i * 31;
+  write_file("/tmp/test-from-ppm.ppm", big, header + width * height * 3);
+  int w, h;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_ppm("/tmp/test-from-ppm.ppm", &data,
+                             &w, &h, &pixel) == MICRO_DRAW_OK);
+  assert(w == width && h == height);
+  for (int i = 0; i < width * height; ++i)
+    assert(memcmp(data + i*4, big + header + i*3, 3) == 0 && data[i*4+3] == 255);
+  free(data);
+  free(big);
+
+  // Errors
+  write_file("/tmp/test-from-ppm.ppm", "P9\n1 1\n", 7);
+  assert(micro_draw_from_ppm("/tmp/test-from-ppm.ppm", &data, &w, &h, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER);
+  write_file("/tmp/test-from-ppm.ppm", "P3\n1 0\n255\n", 11);
+  assert(micro_draw_from_ppm("/tmp/test-from-ppm.ppm", &data, &w, &h, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  write_file("/tmp/test-from-ppm.ppm", "P6\n2 2\n255\nabc", 14);
+  assert(micro_draw_from_ppm("/tmp/test-from-ppm.ppm", &data, &w, &h, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  assert(data == NULL);
   
   return 0;
 }
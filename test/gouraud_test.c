@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  211
+#define HEIGHT 149
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+int main(void)
+{
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char green[4] = {0, 255, 0, 255};
+  unsigned char blue[4] = {0, 0, 255, 128};
+
+  // With a single color, the same as micro_draw_fill_triangle with
+  // either winding
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  memset(expected, 0, WIDTH * HEIGHT * 4);
+  micro_draw_fill_triangle(expected, WIDTH, HEIGHT, 5, 5, 200, 30, 90, 140,
+                           red, MICRO_DRAW_RGBA8);
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, 5, 5, red, 200, 30, red,
+                                   90, 140, red, MICRO_DRAW_RGBA8);
+  assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, 5, 5, red, 90, 140, red,
+                                   200, 30, red, MICRO_DRAW_RGBA8);
+  assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+
+  // The vertices have their colors, the inside is blended linearly
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, 0, 0, red, 200, 0, green,
+                                   0, 140, blue, MICRO_DRAW_RGBA8);
+  assert(memcmp(image, red, 4) == 0);
+  assert(memcmp(image + 200 * 4, green, 4) == 0);
+  assert(memcmp(image + 140 * WIDTH * 4, blue, 4) == 0);
+  for (int y = 0; y < 140; y += 7)
+    for (int x = 0; x < 200; x += 5)
+    {
+      if (x * 140 + y * 200 > 200 * 140) continue;
+      unsigned char *color = image + (y * WIDTH + x) * 4;
+      double u = x / 200.0, v = y / 140.0;
+      double r = 255 * (1 - u - v), g = 255 * u, b = 255 * v, a = 255 - 127 * v;
+      assert(color[0] >= r - 1 && color[0] <= r + 1);
+      assert(color[1] >= g - 1 && color[1] <= g + 1);
+      assert(color[2] >= b - 1 && color[2] <= b + 1);
+      assert(color[3] >= a - 1 && color[3] <= a + 1);
+    }
+
+  // Other formats blend their channels
+  unsigned char black = 0, white = 255;
+  memset(image, 0, WIDTH * HEIGHT);
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, 0, 0, &black, 0, 100, &black,
+                                   200, 0, &white, MICRO_DRAW_GRAY8);
+  for (int x = 1; x < 100; ++x)
+    assert(image[WIDTH + x] >= image[WIDTH + x - 1]);
+  assert(image[WIDTH + 100] >= 126 && image[WIDTH + 100] <= 129);
+  unsigned char off = 0, on = 1;
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, 0, 0, &off, 0, 100, &off,
+                                   200, 0, &on, MICRO_DRAW_BLACK_WHITE);
+  for (int x = 0; x < 150; ++x)
+    assert(image[x] == (x >= 100));
+
+  // Only inside the clip
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  assert(micro_draw_clip_push((MicroDrawRect) { 40, 20, 30, 10 }) == MICRO_DRAW_OK);
+  micro_draw_fill_triangle_gouraud(image, WIDTH, HEIGHT, -50, -50, red, 500, -50, green,
+                                   -50, 500, blue, MICRO_DRAW_RGBA8);
+  micro_draw_clip_pop();
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      int inside = x >= 40 && x < 70 && y >= 20 && y < 30;
+      assert((image[(y * WIDTH + x) * 4 + 3] != 0) == inside);
+    }
+
+  free(expected);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_THREADS 4
+#include "../micro-draw.h"
+
+#define TILES 64
+#define JOBS  5000
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Every tile is rasterized, then encoded, then all the encoded tiles
+// are collected
+typedef struct {
+  int tile;
+  int rasterized;
+  int encoded;
+  int sum;
+} Tile;
+
+static Tile tiles[TILES];
+static int collected;
+
+static void rasterize(void *context)
+{
+  Tile *tile = context;
+  assert(!tile->rasterized && !tile->encoded);
+  // Uneven work
+  int sum = 0;
+  for (int i = 0; i < (tile->tile % 8) * 20000; ++i)
+    sum += i % 7;
+  tile->sum = sum;
+  tile->rasterized = 1;
+  return;
+}
+
+static void encode(void *context)
+{
+  Tile *tile = context;
+  assert(tile->rasterized && !tile->encoded);
+  tile->encoded = 1;
+  return;
+}
+
+static void collect(void *context)
+{
+  (void)context;
+  for (int i = 0; i < TILES; ++i)
+    assert(tiles[i].encoded);
+  collected++;
+  return;
+}
+
+static int counters[JOBS];
+
+static void count(void *context)
+{
+  __atomic_fetch_add((int*)context, 1, __ATOMIC_RELAXED);
+  return;
+}
+
+static int visited[1000];
+
+static void visit(void *context, int begin, int end)
+{
+  (void)context;
+  for (int i = begin; i < end; ++i)
+    __atomic_fetch_add(&visited[i], 1, __ATOMIC_RELAXED);
+  return;
+}
+
+// A job that runs a loop and other jobs
+static void nested(void *context)
+{
+  (void)context;
+  micro_draw_parallel_for(1000, 10, visit, NULL);
+  MicroDrawJob jobs[10];
+  for (int i = 0; i < 10; ++i)
+    micro_draw_job_init(&jobs[i], count, &counters[i]);
+  for (int i = 1; i < 10; ++i)
+    assert(micro_draw_job_depend(&jobs[i], &jobs[i - 1]) == MICRO_DRAW_OK);
+  micro_draw_run_jobs(jobs, 10);
+  return;
+}
+
+int main(void)
+{
+  MicroDrawJob *jobs = malloc(JOBS * sizeof(MicroDrawJob));
+
+  // Graph of jobs, each one before its dependencies in the array
+  MicroDrawJob *collect_job = &jobs[0];
+  MicroDrawJob *encode_jobs = &jobs[1];
+  MicroDrawJob *rasterize_jobs = &jobs[1 + TILES];
+  for (int run = 0; run < 2; ++run)
+  {
+    memset(tiles, 0, sizeof(tiles));
+    collected = 0;
+    micro_draw_job_init(collect_job, collect, NULL);
+    for (int i = 0; i < TILES; ++i)
+    {
+      tiles[i].tile = i;
+      micro_draw_job_init(&rasterize_jobs[i], rasterize, &tiles[i]);
+      micro_draw_job_init(&encode_jobs[i], encode, &tiles[i]);
+      assert(micro_draw_job_depend(&encode_jobs[i], &rasterize_jobs[i])
+             == MICRO_DRAW_OK);
+      assert(micro_draw_job_depend(collect_job, &encode_jobs[i]) == MICRO_DRAW_OK);
+    }
+    micro_draw_run_jobs(jobs, 1 + TILES * 2);
+    assert(collected == 1);
+    for (int i = 0; i < 1 + TILES * 2; ++i)
+      assert(jobs[i]._dependents == NULL && jobs[i]._pending == 1);
+  }
+
+  // More jobs than the deques can hold
+  memset(counters, 0, sizeof(counters));
+  for (int i = 0; i < JOBS; ++i)
+    micro_draw_job_init(&jobs[i], count, &counters[i]);
+  micro_draw_run_jobs(jobs, JOBS);
+  for (int i = 0; i < JOBS; ++i)
+    assert(counters[i] == 1);
+  micro_draw_run_jobs(jobs, JOBS);
+  for (int i = 0; i < JOBS; ++i)
+    assert(counters[i] == 2);
+
+  // Jobs running loops and jobs
+  memset(counters, 0, sizeof(counters));
+  for (int i = 0; i < 8; ++i)
+    micro_draw_job_init(&jobs[i], nested, NULL);
+  micro_draw_run_jobs(jobs, 8);
+  for (int i = 0; i < 1000; ++i)
+    assert(visited[i] == 8);
+  for (int i = 0; i < 10; ++i)
+    assert(counters[i] == 8);
+  micro_draw_run_jobs(jobs, 0);
+
+  free(jobs);
+  return 0;
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  300
+#define HEIGHT 200
+#define TILE   MICRO_DRAW_TILE_SIZE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+int main(void)
+{
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char blue[4] = {0, 0, 255, 255};
+  unsigned char *sprite = malloc(30 * 20 * 4);
+  for (int i = 0; i < 30 * 20 * 4; ++i)
+    sprite[i] = i * 11;
+  MicroDrawCommandList list = {0};
+  // Covers the tile (1, 1) and more
+  assert(micro_draw_record_fill_rect(&list, TILE - 3, TILE - 3, TILE + 6, TILE + 6,
+                                     red, MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  assert(micro_draw_record_fill_circle(&list, 200, 150, 30, blue, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_line(&list, 0, 199, 120, 0, blue, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_text(&list, "lazy", 10, 10, 0.3, blue, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  assert(micro_draw_record_overlap(&list, sprite, 30, 20, MICRO_DRAW_RGBA8, 250, 5)
+         == MICRO_DRAW_OK);
+
+  MicroDrawLazyClear clear;
+  assert(micro_draw_lazy_clear_init(&clear, WIDTH, HEIGHT) == MICRO_DRAW_OK);
+  assert(clear.columns == (WIDTH + TILE - 1) / TILE);
+  MicroDrawPixel pixels[4] = { MICRO_DRAW_RGBA8, MICRO_DRAW_RGB8,
+                               MICRO_DRAW_GRAY8, MICRO_DRAW_BLACK_WHITE };
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *lazy = malloc(WIDTH * HEIGHT * 4);
+  for (int i = 0; i < 4; ++i)
+    for (int tiled = 0; tiled < 2; ++tiled)
+    {
+      int channels = micro_draw_get_channels(pixels[i]);
+      int size = WIDTH * HEIGHT * channels;
+      unsigned char gray[4];
+      unsigned char gray_rgba[4] = {90, 90, 90, 255};
+      micro_draw_color_from_rgba8(gray_rgba, gray, pixels[i]);
+      MicroDrawSurface surface = {
+        .data = expected,
+        .width = WIDTH,
+        .height = HEIGHT,
+        .stride = WIDTH * channels,
+        .pixel = pixels[i],
+      };
+      micro_draw_surface_clear(&surface, gray);
+      micro_draw_execute(&list, &surface);
+
+      // Two frames on the same surface
+      surface.data = lazy;
+      surface.lazy_clear = &clear;
+      memset(lazy, 0x55, size);
+      for (int frame = 0; frame < 2; ++frame)
+      {
+        micro_draw_surface_clear(&surface, gray);
+        if (tiled)
+          assert(micro_draw_execute_tiled(&list, &surface) == MICRO_DRAW_OK);
+        else
+          micro_draw_execute(&list, &surface);
+      }
+      // The covered tile is not written by the clear, the tiles with
+      // nothing drawn are still pending
+      assert(clear.tiles[1 * clear.columns + 1] == 0);
+      assert(clear.tiles[(clear.rows - 1) * clear.columns] == 0);
+      int last = clear.rows * clear.columns - 1;
+      assert(clear.tiles[last] == 1 && clear.tiles[clear.columns + 4] == 1);
+      if (pixels[i] != MICRO_DRAW_BLACK_WHITE)
+      {
+        assert(lazy[size - 1] == 0x55);
+        assert(memcmp(expected, lazy, size) != 0);
+      }
+      micro_draw_lazy_clear_resolve(&surface);
+      for (int t = 0; t < clear.columns * clear.rows; ++t)
+        assert(clear.tiles[t] == 0);
+      assert(memcmp(expected, lazy, size) == 0);
+    }
+
+  // Without a lazy clear, the surface is written right away
+  MicroDrawSurface surface = {
+    .data = lazy,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .stride = WIDTH * 4,
+    .pixel = MICRO_DRAW_RGBA8,
+  };
+  micro_draw_surface_clear(&surface, red);
+  micro_draw_lazy_clear_resolve(&surface);
+  for (int i = 0; i < WIDTH * HEIGHT * 4; ++i)
+    assert(lazy[i] == red[i % 4]);
+
+  micro_draw_lazy_clear_free(&clear);
+  micro_draw_command_list_free(&list);
+  free(lazy);
+  free(expected);
+  free(sprite);
+  return 0;
+}
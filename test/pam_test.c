@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#include "../micro-draw.h"
+
+#define WIDTH  50
+#define HEIGHT 30
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void check_round_trip(MicroDrawPixel pixel)
+{
+  int channels = micro_draw_get_channels(pixel);
+  unsigned char *image = malloc(WIDTH * HEIGHT * channels);
+  for (int i = 0; i < WIDTH * HEIGHT * channels; ++i)
+    image[i] = (pixel == MICRO_DRAW_BLACK_WHITE) ? (i % 7 < 3) : i * 31;
+
+  assert(micro_draw_to_pam("/tmp/test-pam.pam", image, WIDTH, HEIGHT,
+                           pixel) == MICRO_DRAW_OK);
+  FILE *file = fopen("/tmp/test-pam.pam", "rb");
+  assert(file != NULL);
+  size_t size = micro_draw_pam_size(WIDTH, HEIGHT, pixel);
+  unsigned char *bytes = malloc(size + 1);
+  assert(fread(bytes, 1, size + 1, file) == size);
+  fclose(file);
+  // The raster is the image as it is in memory
+  assert(memcmp(bytes + size - WIDTH * HEIGHT * channels, image,
+                WIDTH * HEIGHT * channels) == 0);
+
+  unsigned char *buffer = malloc(size);
+  size_t written;
+  assert(micro_draw_to_pam_memory(buffer, size, &written, image, WIDTH, HEIGHT,
+                                  pixel) == MICRO_DRAW_OK);
+  assert(written == size && memcmp(buffer, bytes, size) == 0);
+
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel read_pixel;
+  assert(micro_draw_from_ppm("/tmp/test-pam.pam", &read, &width, &height,
+                             &read_pixel) == MICRO_DRAW_OK);
+  assert(width == WIDTH && height == HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT; ++i)
+  {
+    switch(pixel)
+    {
+    case MICRO_DRAW_RGBA8:
+      assert(read_pixel == MICRO_DRAW_RGBA8);
+      assert(memcmp(read + i * 4, image + i * 4, 4) == 0);
+      break;
+    case MICRO_DRAW_RGB8:
+      assert(read_pixel == MICRO_DRAW_RGBA8);
+      assert(memcmp(read + i * 4, image + i * 3, 3) == 0);
+      assert(read[i * 4 + 3] == 255);
+      break;
+    case MICRO_DRAW_GRAY8:
+      assert(read_pixel == MICRO_DRAW_RGBA8);
+      assert(read[i * 4] == image[i] && read[i * 4 + 2] == image[i]);
+      break;
+    case MICRO_DRAW_BLACK_WHITE:
+      assert(read_pixel == MICRO_DRAW_BLACK_WHITE);
+      assert(read[i] == image[i]);
+      break;
+    default:
+      assert(0);
+    }
+  }
+  free(read);
+
+#if defined(__unix__) || defined(__APPLE__)
+  MicroDrawSurface surface;
+  assert(micro_draw_ppm_map("/tmp/test-pam.pam", &surface) == MICRO_DRAW_OK);
+  assert(surface.pixel == pixel);
+  assert(memcmp(surface.data, image, WIDTH * HEIGHT * channels) == 0);
+  micro_draw_ppm_unmap(&surface);
+#endif
+
+  free(buffer);
+  free(bytes);
+  free(image);
+  return;
+}
+
+static MicroDrawError read_memory(const char *pam, size_t size,
+                                  unsigned char **data, int *width, int *height,
+                                  MicroDrawPixel *pixel)
+{
+  return micro_draw_from_ppm_memory((const unsigned char*)pam, size, data,
+                                    width, height, pixel);
+}
+
+int main(void)
+{
+  check_round_trip(MICRO_DRAW_RGBA8);
+  check_round_trip(MICRO_DRAW_RGB8);
+  check_round_trip(MICRO_DRAW_GRAY8);
+  check_round_trip(MICRO_DRAW_BLACK_WHITE);
+
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+
+  // Gray with alpha and a max value of 15, keys in any order
+  const char gray_alpha[] = "P7\n# comment\nHEIGHT 1\nWIDTH 2\nDEPTH 2\n"
+    "MAXVAL 15\nTUPLTYPE GRAYSCALE_ALPHA\nENDHDR\n\x0f\x00\x05\x0f";
+  assert(read_memory(gray_alpha, sizeof(gray_alpha) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_OK);
+  assert(width == 2 && height == 1 && pixel == MICRO_DRAW_RGBA8);
+  unsigned char expected_gray[8] = {255, 255, 255, 0, 85, 85, 85, 255};
+  assert(memcmp(read, expected_gray, 8) == 0);
+  free(read);
+
+  // Two bytes per sample
+  const char wide[] = "P7\nWIDTH 1\nHEIGHT 1\nDEPTH 4\nMAXVAL 65535\n"
+    "TUPLTYPE RGB_ALPHA\nENDHDR\n\xff\xff\x00\x00\x80\x00\x00\x00";
+  assert(read_memory(wide, sizeof(wide) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_OK);
+  assert(read[0] == 255 && read[1] == 0 && read[2] == 128 && read[3] == 0);
+  free(read);
+
+  // Invalid headers
+  const char no_end[] = "P7\nWIDTH 1\nHEIGHT 1\nDEPTH 1\nMAXVAL 255\n";
+  assert(read_memory(no_end, sizeof(no_end) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  const char no_depth[] = "P7\nWIDTH 1\nHEIGHT 1\nMAXVAL 255\nENDHDR\n\x01";
+  assert(read_memory(no_depth, sizeof(no_depth) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  const char unknown[] = "P7\nWIDTH 1\nHEIGHT 1\nDEPTH 1\nCOLOR 3\nENDHDR\n\x01";
+  assert(read_memory(unknown, sizeof(unknown) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  const char truncated[] = "P7\nWIDTH 2\nHEIGHT 1\nDEPTH 1\nMAXVAL 255\nENDHDR\n\x01";
+  assert(read_memory(truncated, sizeof(truncated) - 1, &read, &width, &height,
+                     &pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  return 0;
+}
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_Y4M
+#define MICRO_DRAW_THREADS 4
+#include "../micro-draw.h"
+
+#define WIDTH  613
+#define HEIGHT 411
+#define ITEMS  10007
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static int visited[ITEMS];
+
+static void visit(void *context, int begin, int end)
+{
+  int *grain = context;
+  assert(begin < end && end - begin <= *grain);
+  for (int i = begin; i < end; ++i)
+    __atomic_fetch_add(&visited[i], 1, __ATOMIC_RELAXED);
+  return;
+}
+
+// Every range starts another loop, which runs serially
+static void nested(void *context, int begin, int end)
+{
+  (void)context;
+  for (int i = begin; i < end; ++i)
+  {
+    int grain = 1;
+    micro_draw_parallel_for(1, 1, visit, &grain);
+    (void)i;
+  }
+  int grain = 3;
+  micro_draw_parallel_for(0, grain, visit, &grain);
+  return;
+}
+
+static void check_visited(int count, int times)
+{
+  for (int i = 0; i < count; ++i)
+    assert(visited[i] == times);
+  memset(visited, 0, sizeof(visited));
+  return;
+}
+
+int main(void)
+{
+  // Every item exactly once, with any grain
+  int grains[5] = { 1, 7, 100, ITEMS, ITEMS * 2 };
+  for (int i = 0; i < 5; ++i)
+  {
+    micro_draw_parallel_for(ITEMS, grains[i], visit, &grains[i]);
+    check_visited(ITEMS, 1);
+  }
+  micro_draw_parallel_for(ITEMS, 16, nested, NULL);
+  check_visited(1, ITEMS);
+  micro_draw_parallel_for(0, 16, nested, NULL);
+
+  // The parallel functions draw the same as pixel by pixel
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  unsigned char color[4] = { 10, 200, 30, 255 };
+  micro_draw_clear(image, WIDTH, HEIGHT, color, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < WIDTH * HEIGHT * 4; ++i)
+    assert(image[i] == color[i % 4]);
+
+  unsigned int seed = 5;
+  unsigned char *sprite = malloc(100 * 90 * 4);
+  for (int i = 0; i < 100 * 90 * 4; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    sprite[i] = seed >> 16;
+  }
+  memcpy(expected, image, WIDTH * HEIGHT * 4);
+  micro_draw_overlap(sprite, 100, 90, MICRO_DRAW_RGBA8, image, WIDTH, HEIGHT,
+                     MICRO_DRAW_RGBA8, -20, 350);
+  for (int y = 0; y < 90; ++y)
+    for (int x = 0; x < 100; ++x)
+    {
+      int dx = x - 20, dy = y + 350;
+      if (dx < 0 || dy >= HEIGHT) continue;
+      memcpy(expected + (dy * WIDTH + dx) * 4, sprite + (y * 100 + x) * 4, 4);
+    }
+  assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+
+  unsigned char *scaled = malloc(WIDTH * 2 * HEIGHT * 3);
+  micro_draw_scaled(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, scaled, WIDTH * 2,
+                    HEIGHT, MICRO_DRAW_RGB8);
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH * 2; ++x)
+      assert(memcmp(scaled + (y * WIDTH * 2 + x) * 3,
+                    image + (y * WIDTH + x / 2) * 4, 3) == 0);
+  free(scaled);
+
+  // Text drawn directly and through a command list
+  unsigned char white[4] = { 255, 255, 255, 255 };
+  memcpy(expected, image, WIDTH * HEIGHT * 4);
+  MicroDrawCommandList list = {0};
+  char text[] = "Parallel rows\nof text\n\nand more";
+  assert(micro_draw_record_text(&list, text, 3, -5, 2.5, white, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_OK);
+  MicroDrawSurface surface = {
+    .data = expected,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .stride = WIDTH * 4,
+    .pixel = MICRO_DRAW_RGBA8,
+  };
+  micro_draw_execute(&list, &surface);
+  micro_draw_text(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, text, 3, -5, 2.5, white);
+  assert(memcmp(image, expected, WIDTH * HEIGHT * 4) == 0);
+  micro_draw_command_list_free(&list);
+
+  // I420 rows are converted in pairs
+  int chroma = ((WIDTH + 1) / 2) * ((HEIGHT + 1) / 2);
+  unsigned char *planes = malloc(WIDTH * HEIGHT + chroma * 2);
+  unsigned char *planes_expected = malloc(WIDTH * HEIGHT + chroma * 2);
+  micro_draw_rgba8_to_i420(image, WIDTH, HEIGHT, planes, planes + WIDTH * HEIGHT,
+                           planes + WIDTH * HEIGHT + chroma);
+  // The rows one pair at a time
+  int chroma_width = (WIDTH + 1) / 2;
+  for (int y = 0; y < HEIGHT; y += 2)
+  {
+    int rows = _micro_draw_min(2, HEIGHT - y);
+    micro_draw_rgba8_to_i420(image + y * WIDTH * 4, WIDTH, rows,
+                             planes_expected + y * WIDTH,
+                             planes_expected + WIDTH * HEIGHT + y / 2 * chroma_width,
+                             planes_expected + WIDTH * HEIGHT + chroma
+                             + y / 2 * chroma_width);
+  }
+  assert(memcmp(planes, planes_expected, WIDTH * HEIGHT + chroma * 2) == 0);
+
+  free(planes_expected);
+  free(planes);
+  free(sprite);
+  free(expected);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PNG
+#include "../micro-draw.h"
+
+#define WIDTH  203
+#define HEIGHT 150
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned int read_u32(const unsigned char *p)
+{
+  return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16
+    | (unsigned int)p[2] << 8 | p[3];
+}
+
+// Bit by bit CRC32, to check the sliced one
+static unsigned int crc32(const unsigned char *bytes, size_t size)
+{
+  unsigned int crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; ++i)
+  {
+    crc ^= bytes[i];
+    for (int k = 0; k < 8; ++k)
+      crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+  }
+  return ~crc;
+}
+
+// Minimal inflate of stored and fixed Huffman blocks
+typedef struct {
+  const unsigned char *p;
+  unsigned int bit;
+} Bits;
+
+static unsigned int get_bits(Bits *in, int count)
+{
+  unsigned int value = 0;
+  for (int i = 0; i < count; ++i, ++in->bit)
+    value |= ((in->p[in->bit / 8] >> (in->bit % 8)) & 1) << i;
+  return value;
+}
+
+// Fixed Huffman codes are read from their most significant bit
+static int get_code(Bits *in, int count)
+{
+  int value = 0;
+  for (int i = 0; i < count; ++i)
+    value = (value << 1) | get_bits(in, 1);
+  return value;
+}
+
+static int get_symbol(Bits *in)
+{
+  int code = get_code(in, 7);
+  if (code <= 23) return 256 + code;
+  code = (code << 1) | get_bits(in, 1);
+  if (code >= 0x30 && code <= 0xBF) return code - 0x30;
+  if (code >= 0xC0 && code <= 0xC7) return 280 + code - 0xC0;
+  code = (code << 1) | get_bits(in, 1);
+  assert(code >= 0x190 && code <= 0x1FF);
+  return 144 + code - 0x190;
+}
+
+static size_t inflate(const unsigned char *src, unsigned char *dest)
+{
+  static const int base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23,
+    27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const int extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  Bits in = { src, 0 };
+  size_t size = 0;
+  int final;
+  do
+  {
+    final = get_bits(&in, 1);
+    int type = get_bits(&in, 2);
+    if (type == 0)
+    {
+      in.bit = (in.bit + 7) / 8 * 8;
+      const unsigned char *p = in.p + in.bit / 8;
+      int length = p[0] | p[1] << 8;
+      assert((p[2] | p[3] << 8) == (~length & 0xFFFF));
+      memcpy(dest + size, p + 4, length);
+      size += length;
+      in.bit += (4 + length) * 8;
+      continue;
+    }
+    assert(type == 1);
+    for (;;)
+    {
+      int symbol = get_symbol(&in);
+      if (symbol < 256)
+      {
+        dest[size++] = symbol;
+        continue;
+      }
+      if (symbol == 256) break;
+      int length = base[symbol - 257] + get_bits(&in, extra[symbol - 257]);
+      // Only distance 1 is written
+      assert(get_code(&in, 5) == 0);
+      for (int i = 0; i < length; ++i, ++size)
+        dest[size] = dest[size - 1];
+    }
+  } while (!final);
+  return (in.bit + 7) / 8;
+}
+
+static unsigned char unfilter(int filter, unsigned char x,
+                              unsigned char a, unsigned char b)
+{
+  switch(filter)
+  {
+  case 0: return x;
+  case 1: return x + a;
+  case 2: return x + b;
+  default: assert(0);
+  }
+  return 0;
+}
+
+static void check_png(unsigned char *image, MicroDrawPixel pixel,
+                      MicroDrawPNGCompression compression)
+{
+  size_t capacity = micro_draw_png_max_size(WIDTH, HEIGHT, pixel);
+  unsigned char *png = malloc(capacity);
+  size_t size;
+  assert(micro_draw_to_png_memory(png, capacity, &size, image, WIDTH, HEIGHT,
+                                  pixel, compression) == MICRO_DRAW_OK);
+  assert(size <= capacity);
+  assert(memcmp(png, "\x89PNG\r\n\x1a\n", 8) == 0);
+
+  // Chunks and their CRC
+  const unsigned char *p = png + 8;
+  const unsigned char *idat = NULL;
+  int channels = 0, depth = 0;
+  while (p < png + size)
+  {
+    unsigned int length = read_u32(p);
+    assert(read_u32(p + 8 + length) == crc32(p + 4, length + 4));
+    if (memcmp(p + 4, "IHDR", 4) == 0)
+    {
+      assert(read_u32(p + 8) == WIDTH && read_u32(p + 12) == HEIGHT);
+      depth = p[16];
+      channels = (p[17] == 6) ? 4 : (p[17] == 2) ? 3 : 1;
+    }
+    if (memcmp(p + 4, "IDAT", 4) == 0)
+      idat = p + 8;
+    p += length + 12;
+  }
+  assert(p == png + size && idat != NULL);
+
+  // Inflate and unfilter
+  int row_size = (depth == 1) ? (WIDTH + 7) / 8 : WIDTH * channels;
+  int bpp = (depth == 1) ? 1 : channels;
+  unsigned char *raw = malloc((size_t)(row_size + 1) * HEIGHT);
+  assert(idat[0] == 0x78 && ((idat[0] << 8) | idat[1]) % 31 == 0);
+  size_t used = inflate(idat + 2, raw);
+  unsigned int adler_a = 1, adler_b = 0;
+  for (int i = 0; i < (row_size + 1) * HEIGHT; ++i)
+  {
+    adler_a = (adler_a + raw[i]) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  assert(read_u32(idat + 2 + used) == (adler_b << 16 | adler_a));
+
+  for (int y = 0; y < HEIGHT; ++y)
+  {
+    unsigned char *row = raw + y * (row_size + 1);
+    unsigned char *prev = (y > 0) ? row - (row_size + 1) : NULL;
+    int filter = row[0];
+    if (compression == MICRO_DRAW_PNG_STORED) assert(filter == 0);
+    // Unfilter in place, moving the row one byte back
+    for (int i = 0; i < row_size; ++i)
+    {
+      unsigned char a = (i >= bpp) ? row[i - bpp] : 0;
+      unsigned char b = (prev != NULL) ? prev[i] : 0;
+      row[i] = unfilter(filter, row[i + 1], a, b);
+    }
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      if (depth == 1)
+        assert(((row[x / 8] >> (7 - x % 8)) & 1) == (image[y * WIDTH + x] != 0));
+      else
+        assert(memcmp(row + x * channels, image + (y * WIDTH + x) * channels,
+                      channels) == 0);
+    }
+  }
+
+  // Too small
+  assert(micro_draw_to_png_memory(png, size - 1, &size, image, WIDTH, HEIGHT,
+                                  pixel, compression) == MICRO_DRAW_ERROR_WRITE_FILE);
+  free(raw);
+  free(png);
+  return;
+}
+
+int main(void)
+{
+  MicroDrawPixel pixels[4] = { MICRO_DRAW_RGBA8, MICRO_DRAW_RGB8,
+                               MICRO_DRAW_GRAY8, MICRO_DRAW_BLACK_WHITE };
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char white[4] = {255, 255, 255, 255};
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char black[4] = {0, 0, 0, 255};
+  for (int i = 0; i < 4; ++i)
+  {
+    int channels = micro_draw_get_channels(pixels[i]);
+    // Flat areas and a gradient
+    micro_draw_clear(image, WIDTH, HEIGHT, white, pixels[i]);
+    micro_draw_fill_circle(image, WIDTH, HEIGHT, 60, 60, 40,
+                           (pixels[i] == MICRO_DRAW_BLACK_WHITE) ? black : red,
+                           pixels[i]);
+    for (int y = 100; y < HEIGHT; ++y)
+      for (int x = 0; x < WIDTH * channels; ++x)
+        image[y * WIDTH * channels + x] = (pixels[i] == MICRO_DRAW_BLACK_WHITE)
+          ? (x / 3 + y) % 2 : x + y;
+    check_png(image, pixels[i], MICRO_DRAW_PNG_STORED);
+    check_png(image, pixels[i], MICRO_DRAW_PNG_RLE);
+
+    // Noise is the worst case
+    unsigned int seed = 7;
+    for (int b = 0; b < WIDTH * HEIGHT * channels; ++b)
+    {
+      seed = seed * 1103515245 + 12345;
+      image[b] = (pixels[i] == MICRO_DRAW_BLACK_WHITE) ? (seed >> 20) & 1 : seed >> 16;
+    }
+    check_png(image, pixels[i], MICRO_DRAW_PNG_STORED);
+    check_png(image, pixels[i], MICRO_DRAW_PNG_RLE);
+  }
+
+  // The flat frame compresses
+  micro_draw_clear(image, WIDTH, HEIGHT, white, MICRO_DRAW_RGBA8);
+  size_t capacity = micro_draw_png_max_size(WIDTH, HEIGHT, MICRO_DRAW_RGBA8);
+  unsigned char *png = malloc(capacity);
+  size_t size;
+  assert(micro_draw_to_png_memory(png, capacity, &size, image, WIDTH, HEIGHT,
+                                  MICRO_DRAW_RGBA8, MICRO_DRAW_PNG_RLE) == MICRO_DRAW_OK);
+  assert(size < (size_t)WIDTH * HEIGHT / 20);
+  // The repeats not written yet fit too
+  unsigned char *zeros = calloc(1000 * 1000, 1);
+  for (size_t small = 0; small < 3000; small += 7)
+  {
+    unsigned char *buffer = malloc(small);
+    assert(micro_draw_to_png_memory(buffer, small, &size, zeros, 1000, 1000,
+                                    MICRO_DRAW_GRAY8, MICRO_DRAW_PNG_RLE)
+           == MICRO_DRAW_ERROR_WRITE_FILE);
+    free(buffer);
+  }
+  free(zeros);
+  assert(micro_draw_to_png("/tmp/test-png.png", image, WIDTH, HEIGHT,
+                           MICRO_DRAW_RGBA8, MICRO_DRAW_PNG_RLE) == MICRO_DRAW_OK);
+  free(png);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#include "../micro-draw.h"
+
+#define WIDTH  300
+#define HEIGHT 200
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+int main(void)
+{
+  int data_size = WIDTH * HEIGHT * micro_draw_get_channels(MICRO_DRAW_RGB8);
+  unsigned char* data = malloc(data_size);
+  unsigned char white[3] = {255, 255, 255};
+  unsigned char red[3] = {255, 0, 0};
+  micro_draw_clear(data, WIDTH, HEIGHT, white, MICRO_DRAW_RGB8);
+  micro_draw_fill_circle(data, WIDTH, HEIGHT, WIDTH / 2, HEIGHT / 2,
+                         50, red, MICRO_DRAW_RGB8);
+  assert(micro_draw_to_ppm("/tmp/test-ppm-map.ppm", data, WIDTH, HEIGHT,
+                           MICRO_DRAW_RGB8) == MICRO_DRAW_OK);
+
+  MicroDrawSurface surface;
+  assert(micro_draw_ppm_map("/tmp/test-ppm-map.ppm", &surface) == MICRO_DRAW_OK);
+  assert(surface.width == WIDTH && surface.height == HEIGHT);
+  assert(surface.pixel == MICRO_DRAW_RGB8);
+  assert(surface.stride == WIDTH * 3);
+  assert(memcmp(surface.data, data, data_size) == 0);
+
+  // Composite the mapped image
+  unsigned char *rgba = malloc(WIDTH * HEIGHT * 4);
+  micro_draw_overlap(surface.data, surface.width, surface.height, surface.pixel,
+                     rgba, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, 0, 0);
+  assert(rgba[(HEIGHT / 2 * WIDTH + WIDTH / 2) * 4 + 1] == 0);
+  assert(rgba[3] == 255);
+  micro_draw_ppm_unmap(&surface);
+  assert(surface.data == NULL);
+
+  // Graymap with a comment in the header
+  FILE *file = fopen("/tmp/test-ppm-map.pgm", "wb");
+  fprintf(file, "P5\n# gray\n4 1\n255\n");
+  fwrite("\x01\x02\x03\x04", 1, 4, file);
+  fclose(file);
+  assert(micro_draw_ppm_map("/tmp/test-ppm-map.pgm", &surface) == MICRO_DRAW_OK);
+  assert(surface.pixel == MICRO_DRAW_GRAY8);
+  assert(memcmp(surface.data, "\x01\x02\x03\x04", 4) == 0);
+  micro_draw_ppm_unmap(&surface);
+
+  // Truncated raster
+  file = fopen("/tmp/test-ppm-map.pgm", "wb");
+  fprintf(file, "P5 4 2 255\n1234");
+  fclose(file);
+  assert(micro_draw_ppm_map("/tmp/test-ppm-map.pgm", &surface)
+         == MICRO_DRAW_ERROR_INVALID_FORMAT);
+
+  // ASCII files can not be mapped
+  file = fopen("/tmp/test-ppm-map.pgm", "wb");
+  fprintf(file, "P2 1 1 255\n1\n");
+  fclose(file);
+  assert(micro_draw_ppm_map("/tmp/test-ppm-map.pgm", &surface)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+
+  free(rgba);
+  free(data);
+  return 0;
+}
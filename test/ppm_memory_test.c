@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define _POSIX_C_SOURCE 200809L // pipe
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#include "../micro-draw.h"
+
+#define WIDTH  61
+#define HEIGHT 40
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+static void draw(unsigned char *data, MicroDrawPixel pixel, int frame)
+{
+  unsigned char white[4] = {255, 255, 255, 255};
+  unsigned char red[4] = {255, 0, 0, 255};
+  unsigned char black[4] = {0, 0, 0, 255};
+  micro_draw_clear(data, WIDTH, HEIGHT, white, pixel);
+  micro_draw_fill_circle(data, WIDTH, HEIGHT, 10 + frame * 20, HEIGHT / 2, 12,
+                         (pixel == MICRO_DRAW_BLACK_WHITE) ? black : red, pixel);
+  return;
+}
+
+// Encode in memory, compare with the file written by micro_draw_to_ppm
+// and decode it back
+static void check_memory(MicroDrawPixel pixel)
+{
+  int pixel_size = micro_draw_get_channels(pixel);
+  unsigned char *image = malloc(WIDTH * HEIGHT * pixel_size);
+  draw(image, pixel, 0);
+
+  size_t size = micro_draw_ppm_size(WIDTH, HEIGHT, pixel);
+  assert(size > 0);
+  unsigned char *buffer = malloc(size);
+  size_t written;
+  assert(micro_draw_to_ppm_memory(buffer, size - 1, &written, image,
+                                  WIDTH, HEIGHT, pixel)
+         == MICRO_DRAW_ERROR_WRITE_FILE);
+  assert(micro_draw_to_ppm_memory(buffer, size, &written, image,
+                                  WIDTH, HEIGHT, pixel) == MICRO_DRAW_OK);
+  assert(written == size);
+
+  assert(micro_draw_to_ppm("/tmp/test-ppm-memory.ppm", image, WIDTH, HEIGHT,
+                           pixel) == MICRO_DRAW_OK);
+  FILE *file = fopen("/tmp/test-ppm-memory.ppm", "rb");
+  assert(file != NULL);
+  unsigned char *expected = malloc(size + 1);
+  assert(fread(expected, 1, size + 1, file) == size);
+  fclose(file);
+  assert(memcmp(buffer, expected, size) == 0);
+
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel read_pixel;
+  assert(micro_draw_from_ppm_memory(buffer, size, &read, &width, &height,
+                                    &read_pixel) == MICRO_DRAW_OK);
+  assert(width == WIDTH && height == HEIGHT);
+  if (pixel == MICRO_DRAW_BLACK_WHITE)
+  {
+    assert(read_pixel == MICRO_DRAW_BLACK_WHITE);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i)
+      assert(read[i] == (image[i] != 0));
+  }
+  else
+  {
+    assert(read_pixel == MICRO_DRAW_RGBA8);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i)
+      assert(read[i * 4] == image[i * pixel_size]);
+  }
+  free(read);
+
+  // Truncated raster
+  assert(micro_draw_from_ppm_memory(buffer, size - 1, &read, &width, &height,
+                                    &read_pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+
+  free(expected);
+  free(buffer);
+  free(image);
+  return;
+}
+
+int main(void)
+{
+  check_memory(MICRO_DRAW_RGBA8);
+  check_memory(MICRO_DRAW_RGB8);
+  check_memory(MICRO_DRAW_GRAY8);
+  check_memory(MICRO_DRAW_BLACK_WHITE);
+
+  // ASCII raster in memory
+  const char *ascii = "P2\n# comment\n3 2\n4\n0 2 4\n4 2 0\n";
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_ppm_memory((const unsigned char*)ascii, strlen(ascii),
+                                    &read, &width, &height, &pixel) == MICRO_DRAW_OK);
+  assert(width == 3 && height == 2 && pixel == MICRO_DRAW_RGBA8);
+  assert(read[0] == 0 && read[4] == 128 && read[8] == 255 && read[12] == 255);
+  free(read);
+  assert(micro_draw_from_ppm_memory((const unsigned char*)"P9", 2, &read, &width,
+                                    &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER);
+
+  unsigned char *frames[2];
+  for (int frame = 0; frame < 2; ++frame)
+  {
+    frames[frame] = malloc(WIDTH * HEIGHT * 4);
+    draw(frames[frame], MICRO_DRAW_RGBA8, frame);
+  }
+
+  // Many images one after the other in the same FILE
+  FILE *file = tmpfile();
+  assert(file != NULL);
+  for (int frame = 0; frame < 2; ++frame)
+    assert(micro_draw_to_ppm_file(file, frames[frame], WIDTH, HEIGHT,
+                                  MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  rewind(file);
+  for (int frame = 0; frame < 2; ++frame)
+  {
+    assert(micro_draw_from_ppm_file(file, &read, &width, &height,
+                                    &pixel) == MICRO_DRAW_OK);
+    assert(width == WIDTH && height == HEIGHT);
+    assert(memcmp(read, frames[frame], WIDTH * HEIGHT * 4) == 0);
+    free(read);
+  }
+  assert(micro_draw_from_ppm_file(file, &read, &width, &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER);
+  fclose(file);
+
+  // Same through a pipe, the frames fit in its buffer
+  int fds[2];
+  assert(pipe(fds) == 0);
+  for (int frame = 0; frame < 2; ++frame)
+    assert(micro_draw_to_ppm_fd(fds[1], frames[frame], WIDTH, HEIGHT,
+                                MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  close(fds[1]);
+  for (int frame = 0; frame < 2; ++frame)
+  {
+    assert(micro_draw_from_ppm_fd(fds[0], &read, &width, &height,
+                                  &pixel) == MICRO_DRAW_OK);
+    assert(width == WIDTH && height == HEIGHT);
+    assert(memcmp(read, frames[frame], WIDTH * HEIGHT * 4) == 0);
+    free(read);
+  }
+  assert(micro_draw_from_ppm_fd(fds[0], &read, &width, &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER);
+  close(fds[0]);
+
+  free(frames[0]);
+  free(frames[1]);
+  return 0;
+}
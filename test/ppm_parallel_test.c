@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#define MICRO_DRAW_THREADS 4
+#include "../micro-draw.h"
+
+#define WIDTH  640
+#define HEIGHT 480
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Write [image] as an ASCII netpbm of [type] 1, 2 or 3 in [buffer].
+// Lines have [per_line] values, a comment is added every [comments]
+// lines if not 0.
+static size_t write_ascii(char *buffer, int type, const unsigned char *image,
+                          int per_line, int comments)
+{
+  size_t size = sprintf(buffer, "P%d\n%d %d\n", type, WIDTH, HEIGHT);
+  if (type != 1) size += sprintf(buffer + size, "255\n");
+  int values = WIDTH * HEIGHT * (type == 3 ? 3 : 1);
+  for (int i = 0; i < values; ++i)
+  {
+    if (type == 1)
+      size += sprintf(buffer + size, "%d", image[i] ? 0 : 1);
+    else
+      size += sprintf(buffer + size, "%d ",
+                      image[(type == 3) ? i / 3 * 4 + i % 3 : i * 4]);
+    if ((i + 1) % per_line == 0)
+    {
+      buffer[size++] = '\n';
+      if (comments && (i + 1) / per_line % comments == 0)
+        size += sprintf(buffer + size, "# 1 2 3 comment\n");
+    }
+  }
+  return size;
+}
+
+static void check(const char *buffer, size_t size, const unsigned char *image,
+                  int type)
+{
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_ppm_memory((const unsigned char*)buffer, size, &read,
+                                    &width, &height, &pixel) == MICRO_DRAW_OK);
+  assert(width == WIDTH && height == HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT; ++i)
+  {
+    if (type == 1)
+    {
+      assert(pixel == MICRO_DRAW_BLACK_WHITE && read[i] == (image[i] != 0));
+    }
+    else
+    {
+      assert(pixel == MICRO_DRAW_RGBA8);
+      for (int c = 0; c < 3; ++c)
+        assert(read[i * 4 + c] == image[i * 4 + (type == 3 ? c : 0)]);
+      assert(read[i * 4 + 3] == 255);
+    }
+  }
+  free(read);
+  return;
+}
+
+int main(void)
+{
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned int seed = 3;
+  for (int i = 0; i < WIDTH * HEIGHT * 4; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    image[i] = (i % 1000 < 500) ? (unsigned int)i / 4 : seed >> 16;
+  }
+  for (int i = 0; i < WIDTH * HEIGHT; ++i) image[i * 4 + 3] = 255;
+  unsigned char *bits = malloc(WIDTH * HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT; ++i) bits[i] = (image[i * 4] > 128);
+
+  // Enough space for two images
+  size_t capacity = (size_t)WIDTH * HEIGHT * 3 * 8 + 1024;
+  char *buffer = malloc(capacity * 2);
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+
+  // Short lines, long lines and comments
+  size_t size = write_ascii(buffer, 3, image, 15, 0);
+  check(buffer, size, image, 3);
+  size = write_ascii(buffer, 3, image, WIDTH * HEIGHT * 3, 0);
+  check(buffer, size, image, 3);
+  size = write_ascii(buffer, 3, image, 15, 7);
+  check(buffer, size, image, 3);
+  size = write_ascii(buffer, 2, image, 20, 3);
+  check(buffer, size, image, 2);
+  size = write_ascii(buffer, 1, bits, 70, 0);
+  check(buffer, size, bits, 1);
+  size = write_ascii(buffer, 1, bits, WIDTH * HEIGHT, 0);
+  check(buffer, size, bits, 1);
+
+  // A long comment on a single line
+  size = write_ascii(buffer, 2, image, WIDTH * HEIGHT, 0);
+  memmove(buffer + 300000, buffer, size);
+  size_t header = strlen("P2\n640 480\n255\n");
+  memcpy(buffer, buffer + 300000, header);
+  memset(buffer + header, ' ', 300000);
+  buffer[header + 1] = '#';
+  buffer[header + 300000 - 1] = '\n';
+  size += 300000;
+  check(buffer, size, image, 2);
+
+  // A comment after a long value, longer than a chunk, on the same line
+  // as the values
+  size_t comment = 1500000;
+  size_t zeros = 1500000;
+  size = write_ascii(buffer, 2, image, WIDTH * HEIGHT, 0);
+  char *first = strchr(buffer + header, ' ');
+  size_t tail = size - (first - buffer);
+  memmove(first + zeros + comment, first, tail);
+  memmove(buffer + header + zeros, buffer + header, first - (buffer + header));
+  memset(buffer + header, '0', zeros);
+  first += zeros;
+  first[0] = '#';
+  for (size_t i = 1; i < comment - 1; ++i)
+    first[i] = (i % 2) ? ' ' : '1';
+  first[comment - 1] = '\n';
+  size += zeros + comment;
+  check(buffer, size, image, 2);
+
+  // Two images one after the other
+  size = write_ascii(buffer, 3, image, 15, 0);
+  size_t second = write_ascii(buffer + size, 2, image, 15, 0);
+  check(buffer, size + second, image, 3);
+  check(buffer + size, second, image, 2);
+
+  // Invalid and truncated rasters
+  const unsigned char *p = (const unsigned char*)buffer;
+  size = write_ascii(buffer, 3, image, 15, 0);
+  buffer[size / 2] = 'x';
+  assert(micro_draw_from_ppm_memory(p, size, &read, &width, &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  size = write_ascii(buffer, 3, image, 15, 0);
+  memcpy(buffer + size / 2 - 5, " 256 ", 5);
+  assert(micro_draw_from_ppm_memory(p, size, &read, &width, &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  size = write_ascii(buffer, 3, image, 15, 0);
+  assert(micro_draw_from_ppm_memory(p, size - 100, &read, &width, &height, &pixel)
+         == MICRO_DRAW_ERROR_INVALID_FORMAT);
+
+  // Through a file
+  size = write_ascii(buffer, 3, image, 15, 0);
+  FILE *file = fopen("/tmp/test-ppm-parallel.ppm", "wb");
+  assert(file != NULL);
+  assert(fwrite(buffer, 1, size, file) == size);
+  fclose(file);
+  assert(micro_draw_from_ppm("/tmp/test-ppm-parallel.ppm", &read, &width, &height,
+                             &pixel) == MICRO_DRAW_OK);
+  assert(memcmp(read, image, WIDTH * HEIGHT * 4) == 0);
+  free(read);
+
+  free(buffer);
+  free(bits);
+  free(image);
+  return 0;
+}
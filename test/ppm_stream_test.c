@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_PPM
+#include "../micro-draw.h"
+
+#define WIDTH  301
+#define HEIGHT 200
+#define BAND   16
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Read [filename] in bands of [band] rows and compare it with the
+// whole image read by micro_draw_from_ppm
+static void check_reader(const char *filename, int band)
+{
+  unsigned char *expected;
+  int width, height;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_ppm(filename, &expected, &width, &height,
+                             &pixel) == MICRO_DRAW_OK);
+  int row_size = width * micro_draw_get_channels(pixel);
+
+  MicroDrawPPMReader reader;
+  assert(micro_draw_ppm_reader_begin(&reader, filename) == MICRO_DRAW_OK);
+  assert(reader.width == width && reader.height == height);
+  assert(reader.pixel == pixel);
+  unsigned char *rows = malloc(band * row_size);
+  for (int row = 0; row < height; row += band)
+  {
+    int count = (height - row < band) ? height - row : band;
+    assert(micro_draw_ppm_reader_read_rows(&reader, rows, count) == MICRO_DRAW_OK);
+    assert(memcmp(rows, expected + row * row_size, count * row_size) == 0);
+  }
+  assert(micro_draw_ppm_reader_read_rows(&reader, rows, 1)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  micro_draw_ppm_reader_end(&reader);
+  free(rows);
+  free(expected);
+}
+
+int main(void)
+{
+  unsigned char *band = malloc(WIDTH * BAND * 4);
+  unsigned char white[4] = {255, 255, 255, 255};
+  unsigned char blue[4] = {0, 0, 255, 255};
+
+  // Render a poster band by band, the circle crosses the bands
+  MicroDrawPPMWriter writer;
+  assert(micro_draw_ppm_writer_begin(&writer, "/tmp/test-ppm-stream.ppm",
+                                     WIDTH, HEIGHT,
+                                     MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  for (int row = 0; row < HEIGHT; row += BAND)
+  {
+    int count = (HEIGHT - row < BAND) ? HEIGHT - row : BAND;
+    micro_draw_clear(band, WIDTH, count, white, MICRO_DRAW_RGBA8);
+    micro_draw_fill_circle(band, WIDTH, count, WIDTH / 2, HEIGHT / 2 - row,
+                           80, blue, MICRO_DRAW_RGBA8);
+    assert(micro_draw_ppm_writer_write_rows(&writer, band, count) == MICRO_DRAW_OK);
+  }
+  assert(micro_draw_ppm_writer_end(&writer) == MICRO_DRAW_OK);
+
+  // Same as the whole image
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  micro_draw_clear(image, WIDTH, HEIGHT, white, MICRO_DRAW_RGBA8);
+  micro_draw_fill_circle(image, WIDTH, HEIGHT, WIDTH / 2, HEIGHT / 2,
+                         80, blue, MICRO_DRAW_RGBA8);
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_ppm("/tmp/test-ppm-stream.ppm", &read, &width, &height,
+                             &pixel) == MICRO_DRAW_OK);
+  assert(memcmp(read, image, WIDTH * HEIGHT * 4) == 0);
+  free(read);
+  check_reader("/tmp/test-ppm-stream.ppm", 7);
+
+  // Empty images
+  assert(micro_draw_ppm_writer_begin(&writer, "/tmp/test-ppm-stream-empty.ppm",
+                                     0, HEIGHT, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  assert(micro_draw_ppm_writer_begin(&writer, "/tmp/test-ppm-stream-empty.ppm",
+                                     0, HEIGHT, MICRO_DRAW_BLACK_WHITE)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+
+  // Missing rows
+  assert(micro_draw_ppm_writer_begin(&writer, "/tmp/test-ppm-stream.pbm",
+                                     WIDTH, HEIGHT,
+                                     MICRO_DRAW_BLACK_WHITE) == MICRO_DRAW_OK);
+  for (int i = 0; i < WIDTH * BAND; ++i)
+    band[i] = (i % 7) < 3;
+  assert(micro_draw_ppm_writer_write_rows(&writer, band, BAND) == MICRO_DRAW_OK);
+  assert(micro_draw_ppm_writer_end(&writer) == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  
+  // Black&White
+  assert(micro_draw_ppm_writer_begin(&writer, "/tmp/test-ppm-stream.pbm",
+                                     WIDTH, BAND * 3,
+                                     MICRO_DRAW_BLACK_WHITE) == MICRO_DRAW_OK);
+  for (int i = 0; i < 3; ++i)
+    assert(micro_draw_ppm_writer_write_rows(&writer, band, BAND) == MICRO_DRAW_OK);
+  assert(micro_draw_ppm_writer_end(&writer) == MICRO_DRAW_OK);
+  check_reader("/tmp/test-ppm-stream.pbm", 5);
+
+  // ASCII rasters larger than the reader buffer, with comments
+  FILE *file = fopen("/tmp/test-ppm-stream-ascii.ppm", "wb");
+  fprintf(file, "P3\n%d %d\n1000\n", WIDTH, HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT * 3; ++i)
+  {
+    fprintf(file, "%d%s", (i * 7919) % 1001, (i % 11 == 10) ? "\n" : "  ");
+    if (i % 1000 == 999) fprintf(file, "# comment\n");
+  }
+  fclose(file);
+  check_reader("/tmp/test-ppm-stream-ascii.ppm", 3);
+  
+  file = fopen("/tmp/test-ppm-stream-ascii.pbm", "wb");
+  fprintf(file, "P1\n%d %d\n", WIDTH, HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT; ++i)
+    fprintf(file, "%d%s", (i % 5) == 0, (i % 70 == 69) ? "\n" : "");
+  fclose(file);
+  check_reader("/tmp/test-ppm-stream-ascii.pbm", 9);
+  
+  free(image);
+  free(band);
+  return 0;
+}
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_QOI
+#include "../micro-draw.h"
+
+#define WIDTH  200
+#define HEIGHT 150
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Flat areas, gradients, noise and changing alpha, to use every chunk
+static void draw(unsigned char *data, MicroDrawPixel pixel)
+{
+  unsigned char gray[4] = {200, 200, 200, 255};
+  unsigned char blue[4] = {20, 40, 220, 128};
+  micro_draw_clear(data, WIDTH, HEIGHT, gray, pixel);
+  micro_draw_fill_rect(data, WIDTH, HEIGHT, 10, 10, 80, 40, blue, pixel);
+  int channels = micro_draw_get_channels(pixel);
+  unsigned int seed = 1;
+  for (int y = 60; y < HEIGHT; ++y)
+  {
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      unsigned char *px = data + (y * WIDTH + x) * channels;
+      seed = seed * 1103515245 + 12345;
+      for (int c = 0; c < channels; ++c)
+      {
+        if (y < 100)
+          px[c] = x + y * c;
+        else if (y < 120)
+          px[c] = x * 2 + ((seed >> (16 + c)) & 7);
+        else
+          px[c] = seed >> (8 + c * 4);
+      }
+    }
+  }
+  return;
+}
+
+static void check_round_trip(MicroDrawPixel pixel)
+{
+  int channels = micro_draw_get_channels(pixel);
+  unsigned char *image = malloc(WIDTH * HEIGHT * channels);
+  draw(image, pixel);
+
+  assert(micro_draw_to_qoi("/tmp/test-qoi.qoi", image, WIDTH, HEIGHT,
+                           pixel) == MICRO_DRAW_OK);
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel read_pixel;
+  assert(micro_draw_from_qoi("/tmp/test-qoi.qoi", &read, &width, &height,
+                             &read_pixel) == MICRO_DRAW_OK);
+  assert(width == WIDTH && height == HEIGHT);
+  for (int i = 0; i < WIDTH * HEIGHT; ++i)
+  {
+    switch(pixel)
+    {
+    case MICRO_DRAW_RGBA8:
+      assert(read_pixel == MICRO_DRAW_RGBA8);
+      assert(memcmp(read + i * 4, image + i * 4, 4) == 0);
+      break;
+    case MICRO_DRAW_RGB8:
+      assert(read_pixel == MICRO_DRAW_RGB8);
+      assert(memcmp(read + i * 3, image + i * 3, 3) == 0);
+      break;
+    case MICRO_DRAW_GRAY8:
+      assert(read_pixel == MICRO_DRAW_RGB8);
+      assert(read[i * 3] == image[i] && read[i * 3 + 2] == image[i]);
+      break;
+    case MICRO_DRAW_BLACK_WHITE:
+      assert(read_pixel == MICRO_DRAW_RGB8);
+      assert(read[i * 3] == (image[i] ? 255 : 0));
+      break;
+    default:
+      assert(0);
+    }
+  }
+  free(read);
+  free(image);
+  return;
+}
+
+int main(void)
+{
+  check_round_trip(MICRO_DRAW_RGBA8);
+  check_round_trip(MICRO_DRAW_RGB8);
+  check_round_trip(MICRO_DRAW_GRAY8);
+  check_round_trip(MICRO_DRAW_BLACK_WHITE);
+
+  // A flat frame compresses to runs
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+  unsigned char white[4] = {255, 255, 255, 255};
+  micro_draw_clear(image, WIDTH, HEIGHT, white, MICRO_DRAW_RGBA8);
+  size_t capacity = micro_draw_qoi_max_size(WIDTH, HEIGHT, MICRO_DRAW_RGBA8);
+  assert(capacity == (size_t)WIDTH * HEIGHT * 5 + 22);
+  unsigned char *buffer = malloc(capacity);
+  size_t size;
+  assert(micro_draw_to_qoi_memory(buffer, capacity, &size, image, WIDTH, HEIGHT,
+                                  MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  assert(size < (size_t)WIDTH * HEIGHT / 50);
+  assert(micro_draw_to_qoi_memory(buffer, 20, &size, image, WIDTH, HEIGHT,
+                                  MICRO_DRAW_RGBA8) == MICRO_DRAW_ERROR_WRITE_FILE);
+
+  // Exact chunks: a run of the starting pixel, then a small difference
+  unsigned char two[8] = {0, 0, 0, 255, 1, 1, 1, 255};
+  assert(micro_draw_to_qoi_memory(buffer, capacity, &size, two, 2, 1,
+                                  MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  unsigned char expected[] = {'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 1, 4, 0,
+                              0xc0, 0x7f, 0, 0, 0, 0, 0, 0, 0, 1};
+  assert(size == sizeof(expected) && memcmp(buffer, expected, size) == 0);
+
+  // Any smaller buffer is not written past, with a run before a full
+  // pixel
+  unsigned char run_rgba[8] = {0, 0, 0, 255, 10, 20, 30, 40};
+  assert(micro_draw_to_qoi_memory(buffer, capacity, &size, run_rgba, 2, 1,
+                                  MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+  size_t needed = size;
+  for (size_t small = 0; small <= needed; ++small)
+  {
+    unsigned char *exact = malloc(small > 0 ? small : 1);
+    assert(micro_draw_to_qoi_memory(exact, small, &size, run_rgba, 2, 1,
+                                    MICRO_DRAW_RGBA8)
+           == ((small == needed) ? MICRO_DRAW_OK : MICRO_DRAW_ERROR_WRITE_FILE));
+    free(exact);
+  }
+
+  // Invalid files
+  unsigned char *read;
+  int width, height;
+  MicroDrawPixel pixel;
+  assert(micro_draw_from_qoi_memory(expected, sizeof(expected) - 3, &read, &width,
+                                    &height, &pixel) == MICRO_DRAW_ERROR_INVALID_FORMAT);
+  expected[0] = 'x';
+  assert(micro_draw_from_qoi_memory(expected, sizeof(expected), &read, &width,
+                                    &height, &pixel) == MICRO_DRAW_ERROR_INVALID_MAGIC_NUMBER);
+
+  free(buffer);
+  free(image);
+  return 0;
+}
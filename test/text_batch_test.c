@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH   800
+#define HEIGHT  600
+#define COLUMNS 8
+#define ROWS    60
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+int main(void)
+{
+  int data_size = WIDTH * HEIGHT * micro_draw_get_channels(MICRO_DRAW_RGBA8);
+  unsigned char* expected = malloc(data_size);
+  unsigned char* data = malloc(data_size);
+  unsigned char black[4] = {0, 0, 0, 255};
+  unsigned char colors[2][4] = {
+    {255, 255, 255, 255},
+    {255, 0, 0, 255},
+  };
+  float scale = 0.2;
+  
+  // A table of numbers, partially outside of the data
+  static char cells[COLUMNS * ROWS][16];
+  static MicroDrawTextItem items[COLUMNS * ROWS];
+  for (int row = 0; row < ROWS; ++row)
+  {
+    for (int col = 0; col < COLUMNS; ++col)
+    {
+      int i = row * COLUMNS + col;
+      snprintf(cells[i], sizeof(cells[i]), "%d", i * 7919 % 100000);
+      items[i] = (MicroDrawTextItem) {
+        .text = cells[i],
+        .x = col * 110 - 20,
+        .y = row * 12 - 5,
+        .color = colors[i % 2],
+      };
+    }
+  }
+
+  micro_draw_clear(expected, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < COLUMNS * ROWS; ++i)
+    micro_draw_text(expected, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, items[i].text,
+                    items[i].x, items[i].y, scale, items[i].color);
+
+  micro_draw_clear(data, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  assert(micro_draw_text_batch(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, NULL,
+                               scale, items, COLUMNS * ROWS) == MICRO_DRAW_OK);
+  assert(memcmp(data, expected, data_size) == 0);
+
+  // Bitmap font, with a single 8x2 glyph for 'a'
+  unsigned char atlas[2] = {0xAA, 0x55};
+  MicroDrawFontGlyph glyph = {
+    .codepoint = 'a', .offset = 0, .x = 1, .y = 1,
+    .width = 8, .height = 2, .advance = 10,
+  };
+  MicroDrawFontRange range = { .codepoint = 'a', .count = 1, .glyph = 0 };
+  MicroDrawFont font = {
+    .atlas = atlas, .atlas_size = 2,
+    .glyphs = &glyph, .glyphs_count = 1,
+    .ranges = &range, .ranges_count = 1,
+    .line_height = 4,
+  };
+  for (int i = 0; i < COLUMNS * ROWS; ++i)
+    items[i].text = "aa\naa";
+  
+  micro_draw_clear(expected, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  for (int i = 0; i < COLUMNS * ROWS; ++i)
+    micro_draw_text_font(expected, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, &font,
+                         items[i].text, items[i].x, items[i].y, items[i].color);
+  micro_draw_clear(data, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  assert(micro_draw_text_batch(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, &font,
+                               1.0, items, COLUMNS * ROWS) == MICRO_DRAW_OK);
+  assert(memcmp(data, expected, data_size) == 0);
+
+  // Nothing to draw
+  assert(micro_draw_text_batch(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, NULL,
+                               scale, items, 0) == MICRO_DRAW_OK);
+  
+  free(data);
+  free(expected);
+  return 0;
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  400
+#define HEIGHT 200
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+int main(void)
+{
+  int data_size = WIDTH * HEIGHT * micro_draw_get_channels(MICRO_DRAW_RGBA8);
+  unsigned char* expected = malloc(data_size);
+  unsigned char* data = malloc(data_size);
+  unsigned char black[4] = {0, 0, 0, 255};
+  unsigned char white[4] = {255, 255, 255, 255};
+  char *text = "hello,\nworld!";
+
+  MicroDrawRect rect = micro_draw_text_measure(text, 10, 20, 0.5);
+  assert(rect.x == 10 && rect.y == 20);
+  assert(rect.w == 6 * 25);
+  assert(rect.h == 2 * 25);
+
+  MicroDrawTextLayout layout = {0};
+  assert(micro_draw_text_layout(&layout, text, 0.5) == MICRO_DRAW_OK);
+  assert(layout.lines == 2);
+  assert(layout.glyphs_count == 12);
+  assert(layout.width == rect.w && layout.height == rect.h);
+
+  // A layout draws the same pixels as micro_draw_text
+  micro_draw_clear(expected, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  micro_draw_text(expected, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                  text, 10, 20, 0.5, white);
+  micro_draw_clear(data, WIDTH, HEIGHT, black, MICRO_DRAW_RGBA8);
+  micro_draw_text_layout_draw(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                              &layout, 10, 20, white);
+  assert(memcmp(data, expected, data_size) == 0);
+
+  // Rebuilding reuses the layout
+  assert(micro_draw_text_layout(&layout, "abc", 1.0) == MICRO_DRAW_OK);
+  assert(layout.lines == 1 && layout.glyphs_count == 3);
+  assert(layout.width == 150 && layout.height == 50);
+  
+  micro_draw_text_layout_free(&layout);
+  free(data);
+  free(expected);
+  return 0;
+}
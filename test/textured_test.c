@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#include "../micro-draw.h"
+
+#define WIDTH  150
+#define HEIGHT 110
+#define SIZE   32
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned char texture_data[SIZE * SIZE * 4];
+static MicroDrawSurface texture = {
+  .data = texture_data,
+  .width = SIZE,
+  .height = SIZE,
+  .stride = SIZE * 4,
+  .pixel = MICRO_DRAW_RGBA8,
+};
+
+// A square of [size] pixels at [x, y], showing [repeat] times the
+// texture in each direction
+static void draw_square(unsigned char *image, int x, int y, int size, float repeat,
+                        MicroDrawFilter filter, MicroDrawWrap wrap)
+{
+  MicroDrawVertex top_left = { x, y, 0, 0, 1 };
+  MicroDrawVertex top_right = { x + size, y, repeat, 0, 1 };
+  MicroDrawVertex bottom_left = { x, y + size, 0, repeat, 1 };
+  MicroDrawVertex bottom_right = { x + size, y + size, repeat, repeat, 1 };
+  micro_draw_fill_triangle_textured(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                    top_left, top_right, bottom_left,
+                                    &texture, filter, wrap);
+  micro_draw_fill_triangle_textured(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                                    bottom_right, bottom_left, top_right,
+                                    &texture, filter, wrap);
+  return;
+}
+
+static unsigned char *texel(int x, int y)
+{
+  return texture_data + (y * SIZE + x) * 4;
+}
+
+int main(void)
+{
+  unsigned int seed = 3;
+  for (int i = 0; i < SIZE * SIZE * 4; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    texture_data[i] = seed >> 16;
+  }
+  unsigned char *image = malloc(WIDTH * HEIGHT * 4);
+
+  // One pixel of the texture for each pixel of the image, with any
+  // filter
+  for (int filter = 0; filter < _MICRO_DRAW_FILTER_MAX; ++filter)
+  {
+    memset(image, 0, WIDTH * HEIGHT * 4);
+    draw_square(image, 10, 20, SIZE, 1, filter, MICRO_DRAW_WRAP_CLAMP);
+    for (int y = 0; y < SIZE; ++y)
+      for (int x = 0; x < SIZE; ++x)
+        assert(memcmp(image + ((y + 20) * WIDTH + x + 10) * 4, texel(x, y), 4) == 0);
+  }
+
+  // Outside of the texture, it repeats or the edges are stretched
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  draw_square(image, 0, 0, SIZE * 3, 3, MICRO_DRAW_FILTER_NEAREST, MICRO_DRAW_WRAP_REPEAT);
+  for (int y = 0; y < SIZE * 3; ++y)
+    for (int x = 0; x < SIZE * 3; ++x)
+      assert(memcmp(image + (y * WIDTH + x) * 4, texel(x % SIZE, y % SIZE), 4) == 0);
+  draw_square(image, 0, 0, SIZE * 3, 3, MICRO_DRAW_FILTER_NEAREST, MICRO_DRAW_WRAP_CLAMP);
+  for (int y = 0; y < SIZE * 3; ++y)
+    for (int x = 0; x < SIZE * 3; ++x)
+      assert(memcmp(image + (y * WIDTH + x) * 4,
+                    texel(x < SIZE ? x : SIZE - 1, y < SIZE ? y : SIZE - 1), 4) == 0);
+
+  // Bilinear sampling halfway between two pixels is their average
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  draw_square(image, 0, 0, SIZE * 2, 1, MICRO_DRAW_FILTER_BILINEAR, MICRO_DRAW_WRAP_CLAMP);
+  for (int y = 0; y < SIZE * 2 - 2; y += 2)
+    for (int x = 0; x < SIZE * 2 - 2; x += 2)
+      for (int c = 0; c < 4; ++c)
+      {
+        // Pixel [2 x + 1] samples the texture at x + 0.5 + 0.25
+        int top = texel(x / 2, y / 2)[c] * 3 + texel(x / 2 + 1, y / 2)[c];
+        int bottom = texel(x / 2, y / 2 + 1)[c] * 3 + texel(x / 2 + 1, y / 2 + 1)[c];
+        int expected = (top * 3 + bottom) / 16;
+        int value = image[((y + 1) * WIDTH + x + 1) * 4 + c];
+        assert(value >= expected - 1 && value <= expected + 1);
+      }
+
+  // In perspective, the mapping is exact at the span ends and close
+  // in between, and not the same as the flat one
+  unsigned char *flat = malloc(WIDTH * HEIGHT * 4);
+  MicroDrawVertex a = { 0, 0, 0, 0, 1 };
+  MicroDrawVertex b = { 140, 10, 1, 0, 4 };
+  MicroDrawVertex c = { 20, 100, 0, 1, 2 };
+  texture.pixel = MICRO_DRAW_GRAY8;
+  texture.stride = SIZE;
+  for (int i = 0; i < SIZE * SIZE; ++i)
+    texture_data[i] = i % SIZE * 8;
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  micro_draw_fill_triangle_textured(image, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, a, b, c,
+                                    &texture, MICRO_DRAW_FILTER_NEAREST,
+                                    MICRO_DRAW_WRAP_CLAMP);
+  a.w = b.w = c.w = 1;
+  memset(flat, 0, WIDTH * HEIGHT * 4);
+  micro_draw_fill_triangle_textured(flat, WIDTH, HEIGHT, MICRO_DRAW_RGBA8, a, b, c,
+                                    &texture, MICRO_DRAW_FILTER_NEAREST,
+                                    MICRO_DRAW_WRAP_CLAMP);
+  int different = 0;
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      int w0 = (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+      int w1 = (c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x);
+      int w2 = (a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x);
+      unsigned char *color = image + (y * WIDTH + x) * 4;
+      if (!((w0 >= 0 && w1 >= 0 && w2 >= 0) || (w0 <= 0 && w1 <= 0 && w2 <= 0)))
+      {
+        assert(color[3] == 0);
+        continue;
+      }
+      // The barycentric coordinates of the pixel center, corrected by
+      // the depths
+      double area = w0 + w1 + w2;
+      double px = x + 0.5, py = y + 0.5;
+      double lb = ((c.x - a.x) * (py - a.y) - (c.y - a.y) * (px - a.x)) / -area;
+      double lc = ((b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x)) / area;
+      double la = 1 - lb - lc;
+      double u = (lb / 4) / (la / 1 + lb / 4 + lc / 2);
+      double expected = _micro_draw_min(_micro_draw_max((int)(u * SIZE), 0), SIZE - 1) * 8;
+      assert(color[3] == 255 && color[0] >= expected - 8 && color[0] <= expected + 8);
+      different += flat[(y * WIDTH + x) * 4] != color[0];
+    }
+  assert(different > 100);
+
+  // Only inside the clip
+  memset(image, 0, WIDTH * HEIGHT * 4);
+  assert(micro_draw_clip_push((MicroDrawRect) { 5, 6, 20, 10 }) == MICRO_DRAW_OK);
+  draw_square(image, 0, 0, 100, 1, MICRO_DRAW_FILTER_BILINEAR, MICRO_DRAW_WRAP_REPEAT);
+  micro_draw_clip_pop();
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x)
+    {
+      int inside = x >= 5 && x < 25 && y >= 6 && y < 16;
+      assert(image[(y * WIDTH + x) * 4 + 3] == (inside ? 255 : 0));
+    }
+
+  free(flat);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_THREADS 4
+#include "../micro-draw.h"
+
+#define WIDTH  517
+#define HEIGHT 301
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static unsigned int seed = 1;
+
+static int random_int(int min, int max)
+{
+  seed = seed * 1103515245 + 12345;
+  return min + (int)((seed >> 8) % (unsigned int)(max - min + 1));
+}
+
+// Primitives of any kind all over the surface, and a bit outside
+static void record(MicroDrawCommandList *list, unsigned char *sprite)
+{
+  for (int i = 0; i < 300; ++i)
+  {
+    unsigned char color[4] = { random_int(0, 255), random_int(0, 255),
+                               random_int(0, 255), 255 };
+    int x = random_int(-50, WIDTH + 50), y = random_int(-50, HEIGHT + 50);
+    switch (random_int(0, 5))
+    {
+    case 0:
+      assert(micro_draw_record_line(list, x, y, random_int(-50, WIDTH + 50),
+                                    random_int(-50, HEIGHT + 50), color,
+                                    MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+      break;
+    case 1:
+      assert(micro_draw_record_fill_rect(list, x, y, random_int(1, 200),
+                                         random_int(1, 200), color,
+                                         MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+      break;
+    case 2:
+      assert(micro_draw_record_fill_circle(list, x, y, random_int(1, 100), color,
+                                           MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+      break;
+    case 3:
+      assert(micro_draw_record_fill_triangle(list, x, y, x + random_int(-150, 150),
+                                             y + random_int(-150, 150),
+                                             x + random_int(-150, 150),
+                                             y + random_int(-150, 150), color,
+                                             MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+      break;
+    case 4:
+      assert(micro_draw_record_text(list, "Tiles\nin order", x, y,
+                                    random_int(1, 10) / 10.0, color,
+                                    MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+      break;
+    default:
+      assert(micro_draw_record_overlap(list, sprite, 70, 40, MICRO_DRAW_RGBA8,
+                                       x, y) == MICRO_DRAW_OK);
+      break;
+    }
+  }
+  return;
+}
+
+int main(void)
+{
+  unsigned char *sprite = malloc(70 * 40 * 4);
+  for (int i = 0; i < 70 * 40 * 4; ++i)
+    sprite[i] = i * 13;
+  MicroDrawCommandList list = {0};
+  record(&list, sprite);
+
+  MicroDrawPixel pixels[4] = { MICRO_DRAW_RGBA8, MICRO_DRAW_RGB8,
+                               MICRO_DRAW_GRAY8, MICRO_DRAW_BLACK_WHITE };
+  unsigned char *expected = malloc(WIDTH * HEIGHT * 4);
+  unsigned char *tiled = malloc(WIDTH * HEIGHT * 4);
+  for (int i = 0; i < 4; ++i)
+  {
+    int size = WIDTH * HEIGHT * micro_draw_get_channels(pixels[i]);
+    memset(expected, 0, size);
+    memset(tiled, 0, size);
+    MicroDrawSurface surface = {
+      .width = WIDTH,
+      .height = HEIGHT,
+      .stride = WIDTH * micro_draw_get_channels(pixels[i]),
+      .pixel = pixels[i],
+    };
+    surface.data = expected;
+    micro_draw_execute(&list, &surface);
+    surface.data = tiled;
+    assert(micro_draw_execute_tiled(&list, &surface) == MICRO_DRAW_OK);
+    assert(memcmp(expected, tiled, size) == 0);
+  }
+
+  // Smaller than a tile, and empty
+  MicroDrawSurface small = {
+    .data = tiled,
+    .width = 10,
+    .height = 7,
+    .stride = 40,
+    .pixel = MICRO_DRAW_RGBA8,
+  };
+  memset(tiled, 0, 10 * 7 * 4);
+  assert(micro_draw_execute_tiled(&list, &small) == MICRO_DRAW_OK);
+  small.data = expected;
+  memset(expected, 0, 10 * 7 * 4);
+  micro_draw_execute(&list, &small);
+  assert(memcmp(expected, tiled, 10 * 7 * 4) == 0);
+  micro_draw_command_list_clear(&list);
+  assert(micro_draw_execute_tiled(&list, &small) == MICRO_DRAW_OK);
+
+  micro_draw_command_list_free(&list);
+  free(tiled);
+  free(expected);
+  free(sprite);
+  return 0;
+}
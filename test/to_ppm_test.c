@@ -11,6 +11,7 @@
 #define HEIGHT 500
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 int main(void)
@@ -34,6 +35,45 @@ int main(void)
                            data,
                            WIDTH, HEIGHT,
                            MICRO_DRAW_RGBA8) == MICRO_DRAW_OK);
+
+  // Read it back
+  unsigned char *read_data;
+  int read_width, read_height;
+  MicroDrawPixel read_pixel;
+  assert(micro_draw_from_ppm("/tmp/test-to-ppm.ppm", &read_data,
+                             &read_width, &read_height,
+                             &read_pixel) == MICRO_DRAW_OK);
+  assert(read_width == WIDTH && read_height == HEIGHT);
+  assert(read_pixel == MICRO_DRAW_RGBA8);
+  assert(memcmp(read_data, data, data_size) == 0);
+  free(read_data);
+
+  // Black&White, with rows not multiple of a byte
+  int bw_width = 13, bw_height = 3;
+  unsigned char bw[13 * 3];
+  for (int i = 0; i < bw_width * bw_height; ++i)
+    bw[i] = (i % 3 == 0);
+  assert(micro_draw_to_ppm("/tmp/test-to-ppm.pbm", bw, bw_width, bw_height,
+                           MICRO_DRAW_BLACK_WHITE) == MICRO_DRAW_OK);
+  assert(micro_draw_from_ppm("/tmp/test-to-ppm.pbm", &read_data,
+                             &read_width, &read_height,
+                             &read_pixel) == MICRO_DRAW_OK);
+  assert(read_width == bw_width && read_height == bw_height);
+  assert(read_pixel == MICRO_DRAW_BLACK_WHITE);
+  assert(memcmp(read_data, bw, bw_width * bw_height) == 0);
+  free(read_data);
+
+  // Empty images
+  FILE *file = fopen("/tmp/test-to-ppm-empty.ppm", "wb");
+  assert(file != NULL);
+  assert(micro_draw_to_ppm_file(file, data, 0, 1, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  assert(micro_draw_to_pam_file(file, data, 1, 0, MICRO_DRAW_BLACK_WHITE)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
+  fclose(file);
+  size_t size;
+  assert(micro_draw_to_ppm_memory(data, data_size, &size, data, 0, 1, MICRO_DRAW_RGBA8)
+         == MICRO_DRAW_ERROR_INVALID_IMAGE_SIZE);
   
   free(data);
   return 0;
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_BITMAP_FONTS
+#include "../micro-draw.h"
+
+#define WIDTH  64
+#define HEIGHT 16
+#define GLYPHS 3000
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static int is_set(unsigned char *data, int x, int y)
+{
+  return data[(y * WIDTH + x) * 4] == 255;
+}
+
+// Write [codepoint] as UTF-8
+static int utf8_encode(int codepoint, unsigned char *out)
+{
+  if (codepoint < 0x80) { out[0] = codepoint; return 1; }
+  if (codepoint < 0x800)
+  {
+    out[0] = 0xC0 | (codepoint >> 6);
+    out[1] = 0x80 | (codepoint & 0x3F);
+    return 2;
+  }
+  if (codepoint < 0x10000)
+  {
+    out[0] = 0xE0 | (codepoint >> 12);
+    out[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+    out[2] = 0x80 | (codepoint & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (codepoint >> 18);
+  out[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+  out[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+  out[3] = 0x80 | (codepoint & 0x3F);
+  return 4;
+}
+
+// Codepoint of the glyph [i]: ASCII, then CJK, then emojis
+static int glyph_codepoint(int i)
+{
+  if (i < 128) return i;
+  if (i < 2900) return 0x4E00 + (i - 128);
+  return 0x1F600 + (i - 2900);
+}
+
+int main(void)
+{
+  // A PSF2 font with a unicode table, 8x1 glyphs whose bits are the
+  // glyph index modulo 256
+  int size = 32 + GLYPHS + GLYPHS * 5;
+  unsigned char *psf2 = calloc(size, 1);
+  unsigned char header[32] = {
+    0x72, 0xb5, 0x4a, 0x86, 0, 0, 0, 0, 32, 0, 0, 0, 1, 0, 0, 0,
+    GLYPHS & 0xFF, GLYPHS >> 8, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 8, 0, 0, 0,
+  };
+  memcpy(psf2, header, 32);
+  unsigned char *table = psf2 + 32 + GLYPHS;
+  for (int i = 0; i < GLYPHS; ++i)
+  {
+    psf2[32 + i] = i & 0xFF;
+    table += utf8_encode(glyph_codepoint(i), table);
+    *table++ = 0xFF;
+  }
+  
+  MicroDrawFont font;
+  assert(micro_draw_font_from_psf2(&font, psf2, table - psf2) == MICRO_DRAW_OK);
+  // Contiguous codepoints are merged
+  assert(font.ranges_count == 3);
+  for (int i = 0; i < GLYPHS; ++i)
+    assert(micro_draw_font_glyph(&font, glyph_codepoint(i)) == i);
+  assert(micro_draw_font_glyph(&font, 0x3000) == 0);
+  assert(micro_draw_font_glyph(&font, 0x10FFFF) == 0);
+
+  // Each codepoint draws one glyph
+  unsigned char* data = calloc(WIDTH * HEIGHT, 4);
+  unsigned char white[4] = {255, 255, 255, 255};
+  char text[32] = {0};
+  int len = 0;
+  len += utf8_encode(0x4E00 + 1, (unsigned char*)text + len); // glyph 129
+  len += utf8_encode(0x1F600 + 2, (unsigned char*)text + len); // glyph 2902
+  text[len++] = (char)0xFF; // Invalid, glyph 0
+  text[len++] = 'A';
+  micro_draw_text_font(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                       &font, text, 0, 0, white);
+  for (int bit = 0; bit < 8; ++bit)
+  {
+    assert(is_set(data, bit, 0) == !!(129 & (0x80 >> bit)));
+    assert(is_set(data, 8 + bit, 0) == !!((2902 & 0xFF) & (0x80 >> bit)));
+    assert(!is_set(data, 16 + bit, 0));
+    assert(is_set(data, 24 + bit, 0) == !!('A' & (0x80 >> bit)));
+  }
+  micro_draw_font_free(&font);
+
+  // The default font draws one blank glyph per non-ASCII codepoint
+  MicroDrawRect rect = micro_draw_text_measure(text, 0, 0, 0.1);
+  assert(rect.w == 4 * 5);
+  micro_draw_text(data, WIDTH, HEIGHT, MICRO_DRAW_RGBA8,
+                  text, 0, 0, 0.1, white);
+  
+  free(data);
+  free(psf2);
+  return 0;
+}
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#define MICRO_DRAW_IMPLEMENTATION
+#define MICRO_DRAW_Y4M
+#include "../micro-draw.h"
+
+#define WIDTH  37
+#define HEIGHT 21
+#define FRAMES 5
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static int near(int value, double expected)
+{
+  return value >= expected - 2 && value <= expected + 2;
+}
+
+// Compare with the BT.601 formulas in floating point, on sizes that
+// use both the vector and the scalar code
+static void check_conversion(int width, int height)
+{
+  unsigned char *image = malloc(width * height * 4);
+  unsigned int seed = width * 31 + height;
+  for (int i = 0; i < width * height * 4; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    image[i] = seed >> 16;
+  }
+  int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  unsigned char *y_plane = malloc(width * height);
+  unsigned char *u_plane = malloc(chroma_width * chroma_height);
+  unsigned char *v_plane = malloc(chroma_width * chroma_height);
+  micro_draw_rgba8_to_i420(image, width, height, y_plane, u_plane, v_plane);
+
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+    {
+      unsigned char *px = image + (y * width + x) * 4;
+      assert(near(y_plane[y * width + x],
+                  16 + 0.257 * px[0] + 0.504 * px[1] + 0.098 * px[2]));
+    }
+  for (int y = 0; y < chroma_height; ++y)
+    for (int x = 0; x < chroma_width; ++x)
+    {
+      double r = 0, g = 0, b = 0;
+      for (int dy = 0; dy < 2; ++dy)
+        for (int dx = 0; dx < 2; ++dx)
+        {
+          int sx = (x * 2 + dx < width) ? x * 2 + dx : x * 2;
+          int sy = (y * 2 + dy < height) ? y * 2 + dy : y * 2;
+          unsigned char *px = image + (sy * width + sx) * 4;
+          r += px[0] / 4.0;
+          g += px[1] / 4.0;
+          b += px[2] / 4.0;
+        }
+      assert(near(u_plane[y * chroma_width + x],
+                  128 - 0.148 * r - 0.291 * g + 0.439 * b));
+      assert(near(v_plane[y * chroma_width + x],
+                  128 + 0.439 * r - 0.368 * g - 0.071 * b));
+    }
+  free(v_plane);
+  free(u_plane);
+  free(y_plane);
+  free(image);
+  return;
+}
+
+int main(void)
+{
+  check_conversion(64, 32);
+  check_conversion(WIDTH, HEIGHT);
+  check_conversion(1, 1);
+
+  // Known colors
+  unsigned char colors[3][4] = { {255, 0, 0, 255}, {255, 255, 255, 255},
+                                 {0, 0, 0, 255} };
+  unsigned char expected[3][3] = { {82, 90, 240}, {235, 128, 128}, {16, 128, 128} };
+  unsigned char *image = malloc(16 * 2 * 4);
+  unsigned char planes[16 * 2 + 8 * 2];
+  for (int c = 0; c < 3; ++c)
+  {
+    micro_draw_clear(image, 16, 2, colors[c], MICRO_DRAW_RGBA8);
+    micro_draw_rgba8_to_i420(image, 16, 2, planes, planes + 32, planes + 40);
+    for (int i = 0; i < 32; ++i) assert(planes[i] == expected[c][0]);
+    for (int i = 0; i < 8; ++i) assert(planes[32 + i] == expected[c][1]);
+    for (int i = 0; i < 8; ++i) assert(planes[40 + i] == expected[c][2]);
+  }
+  free(image);
+
+  // Stream of frames
+  image = malloc(WIDTH * HEIGHT * 4);
+  MicroDrawY4MWriter writer;
+  assert(micro_draw_y4m_writer_begin(&writer, "/tmp/test-y4m.y4m", WIDTH, HEIGHT,
+                                     30, 1) == MICRO_DRAW_OK);
+  for (int frame = 0; frame < FRAMES; ++frame)
+  {
+    micro_draw_clear(image, WIDTH, HEIGHT, colors[2], MICRO_DRAW_RGBA8);
+    micro_draw_fill_rect(image, WIDTH, HEIGHT, frame * 4, 0, 4, HEIGHT,
+                         colors[1], MICRO_DRAW_RGBA8);
+    assert(micro_draw_y4m_writer_write_frame(&writer, image, MICRO_DRAW_RGBA8)
+           == MICRO_DRAW_OK);
+  }
+  assert(micro_draw_y4m_writer_write_frame(&writer, image, MICRO_DRAW_RGB8)
+         == MICRO_DRAW_ERROR_UNSUPPORTED_FORMAT);
+  assert(writer.frames_written == FRAMES);
+  assert(micro_draw_y4m_writer_end(&writer) == MICRO_DRAW_OK);
+
+  FILE *file = fopen("/tmp/test-y4m.y4m", "rb");
+  assert(file != NULL);
+  char header[64];
+  assert(fgets(header, sizeof(header), file) != NULL);
+  assert(strcmp(header, "YUV4MPEG2 W37 H21 F30:1 Ip A1:1 C420jpeg\n") == 0);
+  int frame_size = WIDTH * HEIGHT + 2 * ((WIDTH + 1) / 2) * ((HEIGHT + 1) / 2);
+  unsigned char *frame_data = malloc(frame_size);
+  for (int frame = 0; frame < FRAMES; ++frame)
+  {
+    char marker[6];
+    assert(fread(marker, 1, 6, file) == 6 && memcmp(marker, "FRAME\n", 6) == 0);
+    assert(fread(frame_data, 1, frame_size, file) == (size_t)frame_size);
+    for (int x = 0; x < WIDTH; ++x)
+      assert(frame_data[x] == ((x / 4 == frame) ? 235 : 16));
+  }
+  assert(fgetc(file) == EOF);
+  fclose(file);
+  free(frame_data);
+  free(image);
+  return 0;
+}